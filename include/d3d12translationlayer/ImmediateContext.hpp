@@ -730,6 +730,25 @@ public:
 
     void UAVBarrier() noexcept;
 
+    // UAV hazard tracking for the command list being recorded. Accesses through UAVs stay pending until
+    // the next UAV barrier or command list submission. A later access needs a barrier first if it reads
+    // or writes something pending a write, or writes something pending a read. Each resource identity
+    // is stamped with the epoch of its last pending access, and UAV barriers and submissions start a new
+    // epoch, so nothing needs to be cleared or allocated.
+    bool HasUAVHazard(Resource* pResource, bool bWrite) const noexcept;
+    void AddPendingUAVAccess(Resource* pResource, bool bWrite) noexcept;
+
+    // Redundant state filtering for compute work recorded into the current command list. State that's
+    // already set isn't set again. Everything is forgotten when the command list is submitted, and
+    // descriptor tables are also forgotten when a descriptor heap rolls over.
+    void SetComputeRootSignature(ID3D12RootSignature* pRootSignature) noexcept;
+    void SetComputePipelineState(ID3D12PipelineState* pPSO) noexcept;
+    // Tables are identified by the descriptors they were copied from, plus a caller-defined tag for any
+    // descriptors which were created in place. Changing the root signature unbinds all of them.
+    bool IsComputeDescriptorTableBound(UINT RootParameter, D3D12_CPU_DESCRIPTOR_HANDLE const* pSources, UINT NumSources, UINT64 Tag) const noexcept;
+    void SetComputeDescriptorTable(UINT RootParameter, D3D12_GPU_DESCRIPTOR_HANDLE Table,
+                                   D3D12_CPU_DESCRIPTOR_HANDLE const* pSources, UINT NumSources, UINT64 Tag) noexcept(false);
+
 public:
     
     void Dispatch( UINT, UINT, UINT );
@@ -866,6 +885,51 @@ public: // variables
     UINT ReserveSlotsForBindings(OnlineDescriptorHeap& Heap, UINT (ImmediateContext::*pfnCalcRequiredSlots)()) noexcept(false);
     UINT ReserveSlots(OnlineDescriptorHeap& Heap, UINT NumSlots) noexcept(false);
 
+    UINT64 m_UAVBarrierEpoch = 1;
+
+    struct BoundDescriptorTable
+    {
+        UINT m_RootParameter;
+        D3D12_GPU_DESCRIPTOR_HANDLE m_Table;
+        UINT64 m_Tag;
+        std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> m_Sources;
+    };
+    struct ComputeBindings
+    {
+        ID3D12RootSignature* m_pRootSignature = nullptr;
+        ID3D12PipelineState* m_pPSO = nullptr;
+        std::vector<BoundDescriptorTable> m_Tables;
+    } m_ComputeBindings;
+
+    // Persistently mapped upload memory for constants which are written once by the CPU and read by
+    // the command list being recorded. Suballocated linearly, and reclaimed as command lists complete.
+    struct ConstantUploadRing
+    {
+        unique_comptr<ID3D12Resource> m_pBuffer;
+        BYTE* m_pCPUBase = nullptr;
+        D3D12_GPU_VIRTUAL_ADDRESS m_GPUBase = 0;
+        UINT m_NumUnits = 0;
+        CFencedRingBuffer m_RingBuffer;
+    } m_ConstantUploadRing;
+
+    static constexpr UINT ConstantUploadUnitSize = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+    static constexpr UINT ConstantUploadRingStartingUnits = 4096; // 1MB
+    static constexpr UINT ConstantUploadRingMaxUnits = 64 * 1024; // 16MB
+
+    struct ConstantUploadAllocation
+    {
+        void* m_pCPUAddress;
+        D3D12_GPU_VIRTUAL_ADDRESS m_GPUAddress;
+    };
+    ConstantUploadAllocation AllocateConstantUpload(UINT Size) noexcept(false);
+    // Allocates and fills an upload, unless the previous one in this command list had the same contents,
+    // in which case that one is returned again.
+    ConstantUploadAllocation UploadConstants(void const* pData, UINT Size) noexcept(false);
+    void RollOverConstantUploadRing(UINT MinUnits) noexcept(false);
+    // The previous upload in this command list, and a copy of its contents. Empty if there wasn't one.
+    std::vector<BYTE> m_LastConstantUploadData;
+    ConstantUploadAllocation m_LastConstantUpload = {};
+
     D3D12_CPU_DESCRIPTOR_HANDLE m_NullUAV;
 
     // Offline descriptor heaps
@@ -534,6 +534,10 @@ namespace D3D12TranslationLayer
             std::unique_ptr<ResidencyManagedObjectWrapper> m_pResidencyHandle;
 
             UINT64 m_LastUAVAccess = 0;
+
+            // The ImmediateContext UAV barrier epochs in which this was last read or written through a UAV
+            UINT64 m_LastUAVReadEpoch = 0;
+            UINT64 m_LastUAVWriteEpoch = 0;
         };
 
         std::unique_ptr<SResourceIdentity> AllocateResourceIdentity(UINT NumSubresources, bool bSimultaneousAccess)
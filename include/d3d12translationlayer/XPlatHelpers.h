@@ -2,6 +2,14 @@
 // Licensed under the MIT License.
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#ifndef _WIN32
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
 namespace XPlatHelpers
 {
 #ifdef _WIN32
@@ -19,6 +27,13 @@ namespace XPlatHelpers
     }
     inline void CloseEvent(Event e) { CloseHandle(e); }
     inline Event EventFromHANDLE(HANDLE h) { return h; }
+
+    // Blocks while Address holds Expected. Can return spuriously, so callers re-check the value.
+    inline void WaitOnAddress(std::atomic<uint32_t>& Address, uint32_t Expected)
+    {
+        (void)::WaitOnAddress(&Address, &Expected, sizeof(Expected), INFINITE);
+    }
+    inline void WakeByAddressAll(std::atomic<uint32_t>& Address) { ::WakeByAddressAll(&Address); }
 #else
     using Event = int;
     constexpr Event InvalidEvent = -1;
@@ -44,6 +59,15 @@ namespace XPlatHelpers
     {
         return static_cast<int>(reinterpret_cast<intptr_t>(h));
     }
+
+    inline void WaitOnAddress(std::atomic<uint32_t>& Address, uint32_t Expected)
+    {
+        syscall(SYS_futex, &Address, FUTEX_WAIT_PRIVATE, Expected, nullptr, nullptr, 0);
+    }
+    inline void WakeByAddressAll(std::atomic<uint32_t>& Address)
+    {
+        syscall(SYS_futex, &Address, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+    }
 #endif
 
     class unique_event
@@ -54,15 +78,15 @@ namespace XPlatHelpers
         unique_event() = default;
         unique_event(Event e) : m_event(e) { }
         unique_event(Event e, copy_tag) : m_event(DuplicateEvent(e)) { }
-        unique_event(unique_event&& e) : m_event(e.detach()) { }
-        unique_event& operator=(unique_event&& e)
+        unique_event(unique_event&& e) noexcept : m_event(e.detach()) { }
+        unique_event& operator=(unique_event&& e) noexcept
         {
             close();
             m_event = e.detach();
             return *this;
         }
         ~unique_event() { close(); }
-        void close()
+        void close() noexcept
         {
             if (*this)
             {
@@ -73,7 +97,7 @@ namespace XPlatHelpers
         void reset(Event e = InvalidEvent) { close(); m_event = e; }
         void create() { reset(CreateEvent()); }
         Event get() { return m_event; }
-        Event detach() { Event e = m_event; m_event = InvalidEvent; return e; }
+        Event detach() noexcept { Event e = m_event; m_event = InvalidEvent; return e; }
         void set() const { SetEvent(m_event); }
         bool poll() const { return WaitForEvent(m_event, 0); }
         void wait() const { WaitForEvent(m_event); }
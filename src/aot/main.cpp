@@ -0,0 +1,254 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+// Precompiles OpenCL programs into a shader cache bundle, which the ICD can load read-only
+// through CLON12_SHADER_CACHE_BUNDLE so that the first run on a machine doesn't pay for compilation.
+// Rather than reimplementing how the ICD keys its caches, this drives the ICD itself with its file cache
+// pointed at the bundle, so whatever it would look up at runtime is exactly what gets stored.
+// Only the specialization that the ICD compiles speculatively at kernel creation is stored, so kernels
+// with local or sampler arguments still compile their final shaders at runtime. Pipeline state objects
+// are specific to a driver, so they aren't stored, and are still created on first use.
+
+#define CL_TARGET_OPENCL_VERSION 220
+#include <CL/cl.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+static void PrintUsage()
+{
+    fprintf(stderr,
+        "Usage: openclon12aot -o <bundle> [-clear] [-options \"<build options>\"] [-sm <6.x>] [-device <index>] <input>...\n"
+        "  Inputs are OpenCL C source, or SPIR-V modules.\n"
+        "  -clear    Empty the bundle first, rather than adding to it.\n"
+        "  -sm       Highest shader model to compile for. Has to match the machines the bundle is for.\n"
+        "  -device   Which device to compile on. Its hardware and driver have to match the machines the bundle is for.\n");
+}
+
+static bool ReadFile(std::string const& path, std::vector<char>& contents)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static bool IsSpirv(std::vector<char> const& contents)
+{
+    uint32_t magic = 0;
+    if (contents.size() < sizeof(magic))
+    {
+        return false;
+    }
+    memcpy(&magic, contents.data(), sizeof(magic));
+    return magic == 0x07230203;
+}
+
+static void PrintBuildLog(cl_program program, cl_device_id device)
+{
+    size_t size = 0;
+    if (clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &size) != CL_SUCCESS || size <= 1)
+    {
+        return;
+    }
+    std::string log(size, '\0');
+    if (clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, size, log.data(), nullptr) == CL_SUCCESS)
+    {
+        fprintf(stderr, "%s\n", log.c_str());
+    }
+}
+
+// Local memory sizes and samplers are compiled into the shader, so those aren't known until the app sets them.
+static void ReportRuntimeSpecializations(cl_kernel kernel)
+{
+    char name[256] = {};
+    cl_uint numArgs = 0;
+    clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, sizeof(name) - 1, name, nullptr);
+    clGetKernelInfo(kernel, CL_KERNEL_NUM_ARGS, sizeof(numArgs), &numArgs, nullptr);
+    for (cl_uint i = 0; i < numArgs; ++i)
+    {
+        cl_kernel_arg_address_qualifier addressQualifier = 0;
+        char typeName[256] = {};
+        if (clGetKernelArgInfo(kernel, i, CL_KERNEL_ARG_ADDRESS_QUALIFIER, sizeof(addressQualifier), &addressQualifier, nullptr) != CL_SUCCESS ||
+            clGetKernelArgInfo(kernel, i, CL_KERNEL_ARG_TYPE_NAME, sizeof(typeName) - 1, typeName, nullptr) != CL_SUCCESS)
+        {
+            continue;
+        }
+        if (addressQualifier == CL_KERNEL_ARG_ADDRESS_LOCAL || strcmp(typeName, "sampler_t") == 0)
+        {
+            printf("  %s: not precompiled, argument %u is %s\n", name, i,
+                   addressQualifier == CL_KERNEL_ARG_ADDRESS_LOCAL ? "a local pointer" : "a sampler");
+            return;
+        }
+    }
+    printf("  %s\n", name);
+}
+
+static bool CompileInput(cl_context context, cl_device_id device, std::string const& path, std::string const& options)
+{
+    std::vector<char> contents;
+    if (!ReadFile(path, contents))
+    {
+        fprintf(stderr, "Failed to read %s\n", path.c_str());
+        return false;
+    }
+
+    cl_int error = CL_SUCCESS;
+    cl_program program = nullptr;
+    if (IsSpirv(contents))
+    {
+        program = clCreateProgramWithIL(context, contents.data(), contents.size(), &error);
+    }
+    else
+    {
+        const char* source = contents.data();
+        size_t length = contents.size();
+        program = clCreateProgramWithSource(context, 1, &source, &length, &error);
+    }
+    if (!program)
+    {
+        fprintf(stderr, "Failed to create a program from %s: %d\n", path.c_str(), error);
+        return false;
+    }
+
+    bool success = false;
+    error = clBuildProgram(program, 1, &device, options.c_str(), nullptr, nullptr);
+    if (error != CL_SUCCESS)
+    {
+        fprintf(stderr, "Failed to build %s: %d\n", path.c_str(), error);
+        PrintBuildLog(program, device);
+    }
+    else
+    {
+        // Creating the kernels is what compiles their shaders; each one is in the bundle once this returns.
+        cl_uint numKernels = 0;
+        error = clCreateKernelsInProgram(program, 0, nullptr, &numKernels);
+        std::vector<cl_kernel> kernels(numKernels);
+        if (error == CL_SUCCESS && numKernels)
+        {
+            error = clCreateKernelsInProgram(program, numKernels, kernels.data(), nullptr);
+        }
+        if (error != CL_SUCCESS)
+        {
+            fprintf(stderr, "Failed to create kernels for %s: %d\n", path.c_str(), error);
+        }
+        else
+        {
+            printf("%s:\n", path.c_str());
+            for (cl_kernel kernel : kernels)
+            {
+                ReportRuntimeSpecializations(kernel);
+                clReleaseKernel(kernel);
+            }
+            success = true;
+        }
+    }
+    clReleaseProgram(program);
+    return success;
+}
+
+int main(int argc, char** argv)
+{
+    std::string output, options, shaderModel;
+    std::vector<std::string> inputs;
+    cl_uint deviceIndex = 0;
+    bool clear = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-o") == 0 && hasValue)
+            output = argv[++i];
+        else if (strcmp(argv[i], "-options") == 0 && hasValue)
+            options = argv[++i];
+        else if (strcmp(argv[i], "-sm") == 0 && hasValue)
+            shaderModel = argv[++i];
+        else if (strcmp(argv[i], "-device") == 0 && hasValue)
+            deviceIndex = (cl_uint)strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "-clear") == 0)
+            clear = true;
+        else if (argv[i][0] == '-')
+        {
+            PrintUsage();
+            return 1;
+        }
+        else
+            inputs.push_back(argv[i]);
+    }
+    if (output.empty() || inputs.empty())
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    std::error_code ec;
+    auto outputPath = std::filesystem::absolute(output, ec);
+    if (ec)
+    {
+        fprintf(stderr, "Invalid output path %s\n", output.c_str());
+        return 1;
+    }
+    if (clear)
+    {
+        std::filesystem::remove(outputPath, ec);
+    }
+
+    // Has to happen before the ICD reads any of these, which is when it creates its first device.
+    // The in-memory tier is turned off so that every lookup reaches the bundle.
+    _putenv_s("CLON12_SHADER_CACHE", "file");
+    _putenv_s("CLON12_SHADER_CACHE_FILE", outputPath.string().c_str());
+    _putenv_s("CLON12_SHADER_CACHE_MAX_MB", "65536");
+    _putenv_s("CLON12_SHADER_CACHE_MEMORY_MB", "0");
+    _putenv_s("CLON12_SHADER_CACHE_BUNDLE", "");
+    _putenv_s("CLON12_DISABLE_SPECULATIVE_SPECIALIZATION", "");
+    _putenv_s("CLON12_SYNCHRONOUS_SPECULATIVE_SPECIALIZATION", "1");
+    if (!shaderModel.empty())
+    {
+        _putenv_s("CLON12_MAX_SHADER_MODEL", shaderModel.c_str());
+    }
+
+    cl_platform_id platform = nullptr;
+    cl_uint numDevices = 0;
+    if (clGetPlatformIDs(1, &platform, nullptr) != CL_SUCCESS ||
+        clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 0, nullptr, &numDevices) != CL_SUCCESS ||
+        deviceIndex >= numDevices)
+    {
+        fprintf(stderr, "Device %u not found\n", deviceIndex);
+        return 1;
+    }
+    std::vector<cl_device_id> devices(numDevices);
+    clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, numDevices, devices.data(), nullptr);
+    cl_device_id device = devices[deviceIndex];
+
+    char deviceName[256] = {};
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(deviceName) - 1, deviceName, nullptr);
+    printf("Compiling for %s into %s\n", deviceName, outputPath.string().c_str());
+
+    cl_int error = CL_SUCCESS;
+    cl_context context = clCreateContext(nullptr, 1, &device, nullptr, nullptr, &error);
+    if (!context)
+    {
+        fprintf(stderr, "Failed to create a context: %d\n", error);
+        return 1;
+    }
+
+    int failures = 0;
+    for (auto& input : inputs)
+    {
+        if (!CompileInput(context, device, input, options))
+        {
+            ++failures;
+        }
+    }
+    clReleaseContext(context);
+    return failures ? 1 : 0;
+}
@@ -241,6 +241,19 @@ void ImmediateContext::PostSubmitNotification()
         m_ViewHeap.m_DescriptorRingBuffer.Deallocate(completedFence);
         m_SamplerHeap.m_DescriptorRingBuffer.Deallocate(completedFence);
     }
+    if (m_ConstantUploadRing.m_pBuffer)
+    {
+        m_ConstantUploadRing.m_RingBuffer.Deallocate(completedFence);
+    }
+
+    // Separate ExecuteCommandLists calls are fully serialized
+    ++m_UAVBarrierEpoch;
+
+    // The new command list starts out with nothing bound
+    m_ComputeBindings.m_pRootSignature = nullptr;
+    m_ComputeBindings.m_pPSO = nullptr;
+    m_ComputeBindings.m_Tables.clear();
+    m_LastConstantUploadData.clear();
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -283,6 +296,9 @@ void ImmediateContext::RollOverHeap(OnlineDescriptorHeap& Heap) noexcept(false)
 
     ID3D12DescriptorHeap* pHeaps[2] = {m_ViewHeap.m_pDescriptorHeap.get(), m_SamplerHeap.m_pDescriptorHeap.get()};
     GetGraphicsCommandList()->SetDescriptorHeaps(ComputeOnly() ? 1 : 2, pHeaps);
+
+    // Tables from the previous heap need to be set again
+    m_ComputeBindings.m_Tables.clear();
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
@@ -310,6 +326,76 @@ UINT ImmediateContext::ReserveSlots(OnlineDescriptorHeap& Heap, UINT NumSlots) n
     return offset;
 }
 
+//----------------------------------------------------------------------------------------------------------------------------------
+void ImmediateContext::RollOverConstantUploadRing(UINT MinUnits) noexcept(false)
+{
+    auto& Ring = m_ConstantUploadRing;
+    UINT NumUnits = ConstantUploadRingStartingUnits;
+    if (Ring.m_pBuffer)
+    {
+        // Defer delete the current buffer, and grow unless we're already at the max size
+        AddObjectToDeferredDeletionQueue(Ring.m_pBuffer.get(), GetCommandListID());
+        NumUnits = Ring.m_NumUnits < ConstantUploadRingMaxUnits ? Ring.m_NumUnits * 2 : Ring.m_NumUnits;
+    }
+
+    // The ring buffer hands out less than half of its size at a time
+    while (MinUnits >= NumUnits / 2)
+    {
+        NumUnits *= 2;
+    }
+
+    UINT64 Size = (UINT64)NumUnits * ConstantUploadUnitSize;
+    Ring.m_pBuffer = TryAllocateResourceWithFallback([&]() { return AllocateHeap(Size, 0, AllocatorHeapType::Upload); },
+        ResourceAllocationContext::ImmediateContextThreadLongLived);
+
+    // AllocateHeap leaves the buffer mapped, this just retrieves the pointer
+    CD3DX12_RANGE NullRange(0, 0);
+    void* pData = nullptr;
+    ThrowFailure(Ring.m_pBuffer->Map(0, &NullRange, &pData));
+    Ring.m_pCPUBase = static_cast<BYTE*>(pData);
+    Ring.m_GPUBase = Ring.m_pBuffer->GetGPUVirtualAddress();
+    Ring.m_NumUnits = NumUnits;
+    Ring.m_RingBuffer = CFencedRingBuffer(NumUnits);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+ImmediateContext::ConstantUploadAllocation ImmediateContext::AllocateConstantUpload(UINT Size) noexcept(false)
+{
+    UINT NumUnits = Align<UINT>(Size, ConstantUploadUnitSize) / ConstantUploadUnitSize;
+    if (!m_ConstantUploadRing.m_pBuffer || NumUnits >= m_ConstantUploadRing.m_NumUnits / 2)
+    {
+        RollOverConstantUploadRing(NumUnits);
+    }
+
+    UINT Offset = 0;
+    while (FAILED(m_ConstantUploadRing.m_RingBuffer.Allocate(NumUnits, GetCommandListID(), Offset)))
+    {
+        RollOverConstantUploadRing(NumUnits);
+    }
+
+    UINT64 ByteOffset = (UINT64)Offset * ConstantUploadUnitSize;
+    return { m_ConstantUploadRing.m_pCPUBase + ByteOffset, m_ConstantUploadRing.m_GPUBase + ByteOffset };
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+ImmediateContext::ConstantUploadAllocation ImmediateContext::UploadConstants(void const* pData, UINT Size) noexcept(false)
+{
+    // Uploads from earlier in this command list stay valid until it completes. The comparison is against
+    // a copy in ordinary memory, since the ring is write-combined and reading it back is slow.
+    if (!m_LastConstantUploadData.empty() && m_LastConstantUploadData.size() == Size &&
+        memcmp(m_LastConstantUploadData.data(), pData, Size) == 0)
+    {
+        return m_LastConstantUpload;
+    }
+
+    auto Allocation = AllocateConstantUpload(Size);
+    memcpy(Allocation.m_pCPUAddress, pData, Size);
+    // Reuses the vector's capacity, so this only allocates when the args grow past what's been seen
+    m_LastConstantUploadData.assign(static_cast<BYTE const*>(pData), static_cast<BYTE const*>(pData) + Size);
+    m_LastConstantUpload = Allocation;
+    return Allocation;
+}
+
 //----------------------------------------------------------------------------------------------------------------------------------
 UINT ImmediateContext::ReserveSlotsForBindings(OnlineDescriptorHeap& Heap, UINT (ImmediateContext::*pfnCalcRequiredSlots)()) noexcept(false)
 {
@@ -586,6 +672,79 @@ void ImmediateContext::UAVBarrier() noexcept
     BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
 
     GetGraphicsCommandList()->ResourceBarrier(1, &BarrierDesc);
+    ++m_UAVBarrierEpoch;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+bool ImmediateContext::HasUAVHazard(Resource* pResource, bool bWrite) const noexcept
+{
+    auto pIdentity = pResource->GetIdentity();
+    return pIdentity->m_LastUAVWriteEpoch == m_UAVBarrierEpoch ||
+        (bWrite && pIdentity->m_LastUAVReadEpoch == m_UAVBarrierEpoch);
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+void ImmediateContext::AddPendingUAVAccess(Resource* pResource, bool bWrite) noexcept
+{
+    auto pIdentity = pResource->GetIdentity();
+    (bWrite ? pIdentity->m_LastUAVWriteEpoch : pIdentity->m_LastUAVReadEpoch) = m_UAVBarrierEpoch;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+void ImmediateContext::SetComputeRootSignature(ID3D12RootSignature* pRootSignature) noexcept
+{
+    if (m_ComputeBindings.m_pRootSignature == pRootSignature)
+    {
+        return;
+    }
+    GetGraphicsCommandList()->SetComputeRootSignature(pRootSignature);
+    m_ComputeBindings.m_pRootSignature = pRootSignature;
+    // Root arguments don't survive a root signature change
+    m_ComputeBindings.m_Tables.clear();
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+void ImmediateContext::SetComputePipelineState(ID3D12PipelineState* pPSO) noexcept
+{
+    if (m_ComputeBindings.m_pPSO == pPSO)
+    {
+        return;
+    }
+    GetGraphicsCommandList()->SetPipelineState(pPSO);
+    m_ComputeBindings.m_pPSO = pPSO;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+bool ImmediateContext::IsComputeDescriptorTableBound(UINT RootParameter, D3D12_CPU_DESCRIPTOR_HANDLE const* pSources, UINT NumSources, UINT64 Tag) const noexcept
+{
+    for (auto& Table : m_ComputeBindings.m_Tables)
+    {
+        if (Table.m_RootParameter == RootParameter)
+        {
+            return Table.m_Tag == Tag &&
+                Table.m_Sources.size() == NumSources &&
+                std::equal(Table.m_Sources.begin(), Table.m_Sources.end(), pSources,
+                           [](D3D12_CPU_DESCRIPTOR_HANDLE a, D3D12_CPU_DESCRIPTOR_HANDLE b) { return a.ptr == b.ptr; });
+        }
+    }
+    return false;
+}
+
+//----------------------------------------------------------------------------------------------------------------------------------
+void ImmediateContext::SetComputeDescriptorTable(UINT RootParameter, D3D12_GPU_DESCRIPTOR_HANDLE Table,
+                                                 D3D12_CPU_DESCRIPTOR_HANDLE const* pSources, UINT NumSources, UINT64 Tag) noexcept(false)
+{
+    GetGraphicsCommandList()->SetComputeRootDescriptorTable(RootParameter, Table);
+
+    auto Iter = std::find_if(m_ComputeBindings.m_Tables.begin(), m_ComputeBindings.m_Tables.end(),
+                             [RootParameter](BoundDescriptorTable const& t) { return t.m_RootParameter == RootParameter; });
+    if (Iter == m_ComputeBindings.m_Tables.end())
+    {
+        Iter = m_ComputeBindings.m_Tables.insert(Iter, BoundDescriptorTable{ RootParameter });
+    }
+    Iter->m_Table = Table;
+    Iter->m_Tag = Tag;
+    Iter->m_Sources.assign(pSources, pSources + NumSources);
 }
 
 //----------------------------------------------------------------------------------------------------------------------------------
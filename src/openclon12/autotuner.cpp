@@ -0,0 +1,227 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+#include "autotuner.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <random>
+#include <sstream>
+
+LocalSizeAutotuner::LocalSizeAutotuner(std::string PersistPath, uint32_t SamplesPerCandidate)
+    : m_PersistPath(std::move(PersistPath))
+    , m_SamplesPerCandidate(std::max(SamplesPerCandidate, 1u))
+    , m_TempFileTag(((uint64_t)std::random_device{}() << 32) | std::random_device{}())
+{
+    if (!m_PersistPath.empty())
+    {
+        std::ifstream file(m_PersistPath);
+        if (file)
+        {
+            Load(file);
+        }
+    }
+}
+
+auto LocalSizeAutotuner::GenerateCandidates(std::array<uint32_t, 3> const& GlobalSize, uint32_t WorkDim, LocalSize const& Heuristic)
+    -> std::vector<LocalSize>
+{
+    std::vector<LocalSize> Candidates = { Heuristic };
+    for (uint32_t Threads = 32; Threads <= MaxThreadsPerGroup; Threads *= 2)
+    {
+        for (bool Spread : { false, true })
+        {
+            LocalSize Size = { 1, 1, 1 };
+            uint32_t Remaining = Threads;
+            bool Progress = true;
+            while (Remaining > 1 && Progress)
+            {
+                Progress = false;
+                for (uint32_t dim = 0; dim < WorkDim && Remaining > 1; ++dim)
+                {
+                    // Double this dimension as long as it still evenly divides the global size
+                    while (Remaining > 1 &&
+                           Size[dim] * 2 <= MaxDims[dim] &&
+                           GlobalSize[dim] % (Size[dim] * 2) == 0)
+                    {
+                        Size[dim] *= 2;
+                        Remaining /= 2;
+                        Progress = true;
+                        if (Spread)
+                            break;
+                    }
+                }
+            }
+
+            if (Remaining == 1 && std::find(Candidates.begin(), Candidates.end(), Size) == Candidates.end())
+            {
+                Candidates.push_back(Size);
+            }
+        }
+    }
+    return Candidates;
+}
+
+auto LocalSizeAutotuner::Select(Key const& key, LocalSize const& Heuristic, uint32_t WorkDim) -> Selection
+{
+    std::lock_guard Lock(m_Lock);
+    auto [iter, inserted] = m_Entries.try_emplace(key);
+    Entry& entry = iter->second;
+    if (inserted)
+    {
+        entry.Candidates = GenerateCandidates(key.GlobalSize, WorkDim, Heuristic);
+        if (entry.Candidates.size() == 1)
+        {
+            // Nothing to choose between
+            entry.Tuned = Heuristic;
+            entry.Candidates.clear();
+        }
+        else
+        {
+            entry.SamplesIssued.resize(entry.Candidates.size(), 0);
+            entry.SamplesCompleted.resize(entry.Candidates.size(), 0);
+            entry.BestTime.resize(entry.Candidates.size(), UINT64_MAX);
+        }
+    }
+
+    if (entry.Tuned)
+    {
+        return { *entry.Tuned, std::nullopt };
+    }
+
+    // Hand out the least-sampled candidate that still needs timings. Launches that fail never report
+    // back, so keep handing out candidates until every one has completed all of its samples.
+    uint32_t Best = UINT32_MAX;
+    for (uint32_t i = 0; i < entry.Candidates.size(); ++i)
+    {
+        if (entry.SamplesCompleted[i] >= m_SamplesPerCandidate)
+            continue;
+        if (Best == UINT32_MAX || entry.SamplesIssued[i] < entry.SamplesIssued[Best])
+            Best = i;
+    }
+    assert(Best != UINT32_MAX);
+    ++entry.SamplesIssued[Best];
+    return { entry.Candidates[Best], Best };
+}
+
+bool LocalSizeAutotuner::ReportTiming(Key const& key, uint32_t Candidate, uint64_t Nanoseconds)
+{
+    std::lock_guard Lock(m_Lock);
+    auto iter = m_Entries.find(key);
+    if (iter == m_Entries.end() || iter->second.Tuned || Candidate >= iter->second.Candidates.size())
+    {
+        return false;
+    }
+
+    Entry& entry = iter->second;
+    ++entry.SamplesCompleted[Candidate];
+    // The fastest sample is the one least disturbed by whatever else the GPU was doing
+    entry.BestTime[Candidate] = std::min(entry.BestTime[Candidate], Nanoseconds);
+
+    if (std::any_of(entry.SamplesCompleted.begin(), entry.SamplesCompleted.end(),
+                    [this](uint32_t Samples) { return Samples < m_SamplesPerCandidate; }))
+    {
+        return false;
+    }
+
+    // min_element picks the first of equal times, which favors the heuristic
+    size_t Winner = std::min_element(entry.BestTime.begin(), entry.BestTime.end()) - entry.BestTime.begin();
+    entry.Tuned = entry.Candidates[Winner];
+    entry.Candidates = {};
+    entry.SamplesIssued = {};
+    entry.SamplesCompleted = {};
+    entry.BestTime = {};
+    return true;
+}
+
+auto LocalSizeAutotuner::GetTunedSize(Key const& key) const -> std::optional<LocalSize>
+{
+    std::lock_guard Lock(m_Lock);
+    auto iter = m_Entries.find(key);
+    return iter == m_Entries.end() ? std::nullopt : iter->second.Tuned;
+}
+
+void LocalSizeAutotuner::Save(std::ostream& stream) const
+{
+    std::lock_guard Lock(m_Lock);
+    WriteEntries(stream);
+}
+
+void LocalSizeAutotuner::WriteEntries(std::ostream& stream) const
+{
+    for (auto& [key, entry] : m_Entries)
+    {
+        if (!entry.Tuned)
+            continue;
+        auto& Size = *entry.Tuned;
+        stream << key.Adapter << ' ' << key.Kernel << ' '
+            << key.GlobalSize[0] << ' ' << key.GlobalSize[1] << ' ' << key.GlobalSize[2] << ' '
+            << Size[0] << ' ' << Size[1] << ' ' << Size[2] << '\n';
+    }
+}
+
+void LocalSizeAutotuner::Load(std::istream& stream)
+{
+    std::lock_guard Lock(m_Lock);
+    std::string Line;
+    while (std::getline(stream, Line))
+    {
+        std::istringstream LineStream(Line);
+        Key key;
+        LocalSize Size;
+        if (!(LineStream >> key.Adapter >> key.Kernel
+                         >> key.GlobalSize[0] >> key.GlobalSize[1] >> key.GlobalSize[2]
+                         >> Size[0] >> Size[1] >> Size[2]))
+        {
+            continue;
+        }
+        if (Size[0] == 0 || Size[1] == 0 || Size[2] == 0 ||
+            (uint32_t)Size[0] * Size[1] * Size[2] > MaxThreadsPerGroup ||
+            Size[0] > MaxDims[0] || Size[1] > MaxDims[1] || Size[2] > MaxDims[2] ||
+            key.GlobalSize[0] % Size[0] || key.GlobalSize[1] % Size[1] || key.GlobalSize[2] % Size[2])
+        {
+            continue;
+        }
+        m_Entries[key] = Entry{ {}, {}, {}, {}, Size };
+    }
+}
+
+void LocalSizeAutotuner::Persist() const
+{
+    if (m_PersistPath.empty())
+    {
+        return;
+    }
+
+    std::lock_guard PersistLock(m_PersistLock);
+    std::ostringstream Contents;
+    Save(Contents);
+
+    // Write the whole table next to the target and swap it in, so a reader never sees a partially
+    // written file. The temp name is unique to this instance, so processes tuning concurrently don't
+    // write into each other's temp files; the last one to finish wins the rename.
+    char Tag[24];
+    snprintf(Tag, sizeof(Tag), ".%016llx", (unsigned long long)m_TempFileTag);
+    std::string TempPath = m_PersistPath + Tag + ".tmp";
+    {
+        std::ofstream file(TempPath, std::ios::trunc);
+        file << Contents.str();
+        if (!file.flush())
+        {
+            file.close();
+            std::error_code ec;
+            std::filesystem::remove(TempPath, ec);
+            return;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(TempPath, m_PersistPath, ec);
+    if (ec)
+    {
+        std::filesystem::remove(TempPath, ec);
+    }
+}
@@ -0,0 +1,100 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Picks local work sizes for NDRange enqueues that leave them up to the implementation.
+// Each (device, kernel, global size) tuple starts out untuned: its launches cycle through a set of
+// candidate local sizes, and the caller reports how long each of those trials took on the GPU.
+// Once every candidate has been timed SamplesPerCandidate times, the fastest one is locked in and
+// used from then on. Tuned sizes can be persisted, so tuning only happens once per machine.
+// This class only makes decisions, it's up to the caller to measure the trials.
+class LocalSizeAutotuner
+{
+public:
+    using LocalSize = std::array<uint16_t, 3>;
+
+    // Matches the D3D12 compute limits, which bound every candidate.
+    static constexpr LocalSize MaxDims = { 1024, 1024, 64 };
+    static constexpr uint32_t MaxThreadsPerGroup = 1024;
+    static constexpr uint32_t DefaultSamplesPerCandidate = 3;
+
+    // Adapter and Kernel are opaque identifiers, which can't contain whitespace.
+    struct Key
+    {
+        std::string Adapter;
+        std::string Kernel;
+        std::array<uint32_t, 3> GlobalSize;
+
+        bool operator<(Key const& o) const
+        {
+            return std::tie(Adapter, Kernel, GlobalSize) < std::tie(o.Adapter, o.Kernel, o.GlobalSize);
+        }
+    };
+
+    struct Selection
+    {
+        LocalSize Size;
+        // Set if this launch is a trial, whose GPU time should be passed to ReportTiming.
+        std::optional<uint32_t> Candidate;
+    };
+
+    // If PersistPath is non-empty, previous results are loaded from it, and Persist rewrites it.
+    LocalSizeAutotuner(std::string PersistPath = {}, uint32_t SamplesPerCandidate = DefaultSamplesPerCandidate);
+
+    // Heuristic is the local size that would be used without tuning. It's always the first
+    // candidate, so it wins ties.
+    Selection Select(Key const& key, LocalSize const& Heuristic, uint32_t WorkDim);
+
+    // Returns true if this timing completed tuning for the tuple, which the caller should follow up
+    // with a Persist call. That does file I/O, so it's best done off of any latency-sensitive thread.
+    bool ReportTiming(Key const& key, uint32_t Candidate, uint64_t Nanoseconds);
+
+    // Rewrites the persist file, if there is one, with everything tuned so far.
+    // Only takes the lock long enough to snapshot the table.
+    void Persist() const;
+
+    std::optional<LocalSize> GetTunedSize(Key const& key) const;
+
+    // One line per tuned tuple. Lines that can't be parsed are skipped when loading.
+    void Save(std::ostream& stream) const;
+    void Load(std::istream& stream);
+
+    // Power-of-two local sizes from 32 to MaxThreadsPerGroup threads which evenly divide the global size,
+    // both filling the dimensions in order and spreading evenly across them, after the heuristic.
+    static std::vector<LocalSize> GenerateCandidates(std::array<uint32_t, 3> const& GlobalSize, uint32_t WorkDim, LocalSize const& Heuristic);
+
+private:
+    struct Entry
+    {
+        // Trial state, released once tuned.
+        std::vector<LocalSize> Candidates;
+        std::vector<uint32_t> SamplesIssued;
+        std::vector<uint32_t> SamplesCompleted;
+        std::vector<uint64_t> BestTime;
+
+        std::optional<LocalSize> Tuned;
+    };
+
+    // Called with the lock held.
+    void WriteEntries(std::ostream& stream) const;
+
+    const std::string m_PersistPath;
+    const uint32_t m_SamplesPerCandidate;
+    // Distinguishes this instance's temp files from those of other processes sharing the persist file
+    const uint64_t m_TempFileTag;
+
+    mutable std::mutex m_Lock;
+    // Serializes writers of the persist file, which don't hold m_Lock
+    mutable std::mutex m_PersistLock;
+    std::map<Key, Entry> m_Entries;
+};
@@ -0,0 +1,100 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+#include "blobcache.hpp"
+#include "spookyv2.h"
+
+BlobCache::BlobCache(size_t BudgetBytes)
+    : m_ShardBudget(BudgetBytes / NumShards)
+{
+}
+
+void BlobCache::Insert(Key const& key, Blob blob)
+{
+    if (!blob.first || blob.second > m_ShardBudget)
+    {
+        return;
+    }
+
+    Shard& shard = GetShard(key);
+    std::lock_guard Lock(shard.Lock);
+    if (auto iter = shard.Map.find(key); iter != shard.Map.end())
+    {
+        shard.Bytes -= iter->second->second.second;
+        shard.Entries.erase(iter->second);
+        shard.Map.erase(iter);
+    }
+
+    while (shard.Bytes + blob.second > m_ShardBudget)
+    {
+        auto& oldest = shard.Entries.back();
+        shard.Bytes -= oldest.second.second;
+        shard.Map.erase(oldest.first);
+        shard.Entries.pop_back();
+    }
+
+    size_t size = blob.second;
+    shard.Entries.emplace_front(key, std::move(blob));
+    try
+    {
+        shard.Map.emplace(key, shard.Entries.begin());
+    }
+    catch (...)
+    {
+        shard.Entries.pop_front();
+        throw;
+    }
+    shard.Bytes += size;
+}
+
+auto BlobCache::Find(Key const& key) -> Blob
+{
+    if (m_ShardBudget == 0)
+    {
+        return {};
+    }
+
+    Shard& shard = GetShard(key);
+    std::lock_guard Lock(shard.Lock);
+    auto iter = shard.Map.find(key);
+    if (iter == shard.Map.end())
+    {
+        return {};
+    }
+    shard.Entries.splice(shard.Entries.begin(), shard.Entries, iter->second);
+    return iter->second->second;
+}
+
+void BlobCache::Clear()
+{
+    for (auto& shard : m_Shards)
+    {
+        std::lock_guard Lock(shard.Lock);
+        shard.Map.clear();
+        shard.Entries.clear();
+        shard.Bytes = 0;
+    }
+}
+
+size_t BlobCache::GetByteSize() const
+{
+    size_t bytes = 0;
+    for (auto& shard : m_Shards)
+    {
+        std::lock_guard Lock(shard.Lock);
+        bytes += shard.Bytes;
+    }
+    return bytes;
+}
+
+auto BlobCache::HashKey(const void* const* Parts, const size_t* PartSizes, unsigned NumParts) noexcept -> Key
+{
+    SpookyHash hasher;
+    hasher.Init(0, 0);
+    for (unsigned i = 0; i < NumParts; ++i)
+    {
+        hasher.Update(Parts[i], PartSizes[i]);
+    }
+    Key key;
+    hasher.Final(&key[0], &key[1]);
+    return key;
+}
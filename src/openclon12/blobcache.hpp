@@ -0,0 +1,58 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+// An in-memory LRU cache of immutable blobs, keyed by 128-bit hashes. Blobs are shared with whoever
+// finds them, so a hit doesn't copy anything, and an evicted blob stays alive until its last user is done.
+// Keys are split across shards which each have their own lock and an even share of the budget,
+// so concurrent lookups rarely wait on each other.
+class BlobCache
+{
+public:
+    using Key = std::array<uint64_t, 2>;
+    using Blob = std::pair<std::shared_ptr<const unsigned char[]>, size_t>;
+
+    static constexpr size_t NumShards = 16;
+
+    // A budget of 0 disables the cache.
+    explicit BlobCache(size_t BudgetBytes);
+
+    // Blobs larger than a shard's share of the budget aren't kept.
+    void Insert(Key const& key, Blob blob);
+    Blob Find(Key const& key);
+    void Clear();
+
+    size_t GetByteSize() const;
+    size_t GetMaxBlobSize() const noexcept { return m_ShardBudget; }
+
+    // Hashes the parts in place, as if they were concatenated.
+    static Key HashKey(const void* const* Parts, const size_t* PartSizes, unsigned NumParts) noexcept;
+    static Key HashKey(const void* Data, size_t Size) noexcept { return HashKey(&Data, &Size, 1); }
+
+private:
+    struct KeyHash
+    {
+        size_t operator()(Key const& key) const noexcept { return (size_t)(key[0] ^ key[1]); }
+    };
+    struct Shard
+    {
+        mutable std::mutex Lock;
+        // Most recently used first
+        std::list<std::pair<Key, Blob>> Entries;
+        std::unordered_map<Key, decltype(Entries)::iterator, KeyHash> Map;
+        size_t Bytes = 0;
+    };
+
+    Shard& GetShard(Key const& key) { return m_Shards[key[1] % NumShards]; }
+
+    const size_t m_ShardBudget;
+    std::array<Shard, NumShards> m_Shards;
+};
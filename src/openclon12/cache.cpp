@@ -5,116 +5,296 @@
 #include "platform.hpp"
 #include "cache.hpp"
 #include "compiler.hpp"
-#include <numeric>
+#include "filecache.hpp"
+#include <filesystem>
+#include <string_view>
 
 #pragma warning(disable: 4100)
 
-ShaderCache::ShaderCache(ID3D12Device* d, bool driverVersioned)
+namespace
 {
-#ifdef __ID3D12ShaderCacheSession_INTERFACE_DEFINED__
-    ComPtr<ID3D12Device9> device9;
-    if (FAILED(d->QueryInterface(device9.ReleaseAndGetAddressOf())))
-        return;
+    enum class CacheBackend { Default, D3D12, File, None };
+
+    CacheBackend GetRequestedBackend()
+    {
+        char *backendStr = nullptr;
+        CacheBackend backend = CacheBackend::Default;
+        if (_dupenv_s(&backendStr, nullptr, "CLON12_SHADER_CACHE") == 0 && backendStr)
+        {
+            if (_stricmp(backendStr, "d3d12") == 0)
+                backend = CacheBackend::D3D12;
+            else if (_stricmp(backendStr, "file") == 0)
+                backend = CacheBackend::File;
+            else if (_stricmp(backendStr, "none") == 0)
+                backend = CacheBackend::None;
+        }
+        free(backendStr);
+        return backend;
+    }
+
+    std::filesystem::path GetCacheDirectory()
+    {
+        wchar_t *dirStr = nullptr;
+        std::filesystem::path dir;
+        if (_wdupenv_s(&dirStr, nullptr, L"CLON12_SHADER_CACHE_DIR") == 0 && dirStr && *dirStr)
+        {
+            dir = dirStr;
+        }
+        else
+        {
+            free(dirStr);
+            dirStr = nullptr;
+            if (_wdupenv_s(&dirStr, nullptr, L"LOCALAPPDATA") == 0 && dirStr && *dirStr)
+                dir = std::filesystem::path(dirStr) / L"OpenCLOn12" / L"ShaderCache";
+            else
+                dir = std::filesystem::temp_directory_path() / L"OpenCLOn12" / L"ShaderCache";
+        }
+        free(dirStr);
+        return dir;
+    }
+
+    // CLON12_SHADER_CACHE_FILE puts every cache that isn't driver-versioned in one file, which is how
+    // openclon12aot builds bundles. Driver-versioned caches hold PSOs, which bundles don't carry.
+    // Otherwise the compiler version goes in the file name, since a file written with another version
+    // gets emptied, and different builds of the ICD on the same machine would keep emptying each other's.
+    std::filesystem::path GetCacheFilePath(std::wstring const& fileName, bool driverVersioned, uint64_t version)
+    {
+        wchar_t *fileStr = nullptr;
+        std::filesystem::path path;
+        if (!driverVersioned &&
+            _wdupenv_s(&fileStr, nullptr, L"CLON12_SHADER_CACHE_FILE") == 0 && fileStr && *fileStr)
+        {
+            path = fileStr;
+        }
+        free(fileStr);
+        if (path.empty())
+        {
+            auto dir = GetCacheDirectory();
+            std::error_code ec;
+            std::filesystem::create_directories(dir, ec);
+            std::filesystem::path name(fileName);
+            wchar_t versionStr[24];
+            swprintf_s(versionStr, L"_v%016llx", (unsigned long long)version);
+            path = dir / (name.stem().wstring() + versionStr + name.extension().wstring());
+        }
+        return path;
+    }
+
+    std::vector<std::filesystem::path> GetBundlePaths()
+    {
+        wchar_t *bundlesStr = nullptr;
+        std::vector<std::filesystem::path> paths;
+        if (_wdupenv_s(&bundlesStr, nullptr, L"CLON12_SHADER_CACHE_BUNDLE") == 0 && bundlesStr)
+        {
+            std::wstring_view bundles(bundlesStr);
+            while (!bundles.empty())
+            {
+                size_t end = bundles.find(L';');
+                if (end != 0)
+                {
+                    paths.emplace_back(bundles.substr(0, end));
+                }
+                bundles.remove_prefix(end == bundles.npos ? bundles.size() : end + 1);
+            }
+        }
+        free(bundlesStr);
+        return paths;
+    }
 
-    D3D12_SHADER_CACHE_SESSION_DESC Desc = {};
-    // {17CB474E-4C55-4DBC-BC2E-D5132115BDA3}
-    Desc.Identifier = { 0x17cb474e, 0x4c55, 0x4dbc, { 0xbc, 0x2e, 0xd5, 0x13, 0x21, 0x15, 0xbd, 0xa3 } };
-    Desc.Mode = D3D12_SHADER_CACHE_MODE_DISK;
-    Desc.Flags = driverVersioned ? D3D12_SHADER_CACHE_FLAG_DRIVER_VERSIONED : D3D12_SHADER_CACHE_FLAG_NONE;
+    uint64_t GetFileCacheMaxSize()
+    {
+        char *sizeStr = nullptr;
+        uint64_t sizeMB = FileCache::DefaultMaxSize / (1024 * 1024);
+        if (_dupenv_s(&sizeStr, nullptr, "CLON12_SHADER_CACHE_MAX_MB") == 0 &&
+            sizeStr && *sizeStr)
+        {
+            sizeMB = strtoull(sizeStr, nullptr, 10);
+        }
+        free(sizeStr);
+        return sizeMB * 1024 * 1024;
+    }
+
+    size_t GetHotTierBudget()
+    {
+        char *sizeStr = nullptr;
+        size_t sizeMB = 32;
+        if (_dupenv_s(&sizeStr, nullptr, "CLON12_SHADER_CACHE_MEMORY_MB") == 0 &&
+            sizeStr && *sizeStr)
+        {
+            sizeMB = (size_t)strtoul(sizeStr, nullptr, 10);
+        }
+        free(sizeStr);
+        return sizeMB * 1024 * 1024;
+    }
+}
 
+ShaderCache::ShaderCache(ID3D12Device* d, bool driverVersioned, std::wstring const& fileName)
+    : m_HotTier(GetHotTierBudget())
+{
     auto pCompiler = g_Platform->GetCompiler();
     if (!pCompiler)
         return;
-    Desc.Version = pCompiler->GetVersionForCache();
 
-    (void)device9->CreateShaderCacheSession(&Desc, IID_PPV_ARGS(&m_pSession));
+    CacheBackend backend = GetRequestedBackend();
+    if (backend == CacheBackend::None)
+        return;
+
+    // Bundles aren't keyed by adapter or driver, and a PSO blob from another one would be rejected,
+    // so only DXIL is looked up in them
+    if (!driverVersioned)
+    {
+        for (auto& path : GetBundlePaths())
+        {
+            try
+            {
+                m_Bundles.push_back(std::make_unique<FileCache>(path, pCompiler->GetVersionForCache(),
+                                                                FileCache::DefaultMaxSize, FileCache::Access::ReadOnly));
+            }
+            catch (...) {}
+        }
+    }
+
+#ifdef __ID3D12ShaderCacheSession_INTERFACE_DEFINED__
+    if (backend != CacheBackend::File)
+    {
+        ComPtr<ID3D12Device9> device9;
+        if (SUCCEEDED(d->QueryInterface(device9.ReleaseAndGetAddressOf())))
+        {
+            D3D12_SHADER_CACHE_SESSION_DESC Desc = {};
+            // {17CB474E-4C55-4DBC-BC2E-D5132115BDA3}
+            Desc.Identifier = { 0x17cb474e, 0x4c55, 0x4dbc, { 0xbc, 0x2e, 0xd5, 0x13, 0x21, 0x15, 0xbd, 0xa3 } };
+            Desc.Mode = D3D12_SHADER_CACHE_MODE_DISK;
+            Desc.Flags = driverVersioned ? D3D12_SHADER_CACHE_FLAG_DRIVER_VERSIONED : D3D12_SHADER_CACHE_FLAG_NONE;
+            Desc.Version = pCompiler->GetVersionForCache();
+
+            (void)device9->CreateShaderCacheSession(&Desc, IID_PPV_ARGS(&m_pSession));
+        }
+    }
+    if (m_pSession)
+        return;
 #endif
+    if (backend == CacheBackend::D3D12)
+        return;
+
+    // Driver versioning is up to the caller, by putting the driver version in the file name.
+    try
+    {
+        m_pFileCache = std::make_unique<FileCache>(GetCacheFilePath(fileName, driverVersioned, pCompiler->GetVersionForCache()),
+                                                   pCompiler->GetVersionForCache(), GetFileCacheMaxSize());
+    }
+    catch (...) {}
 }
 
+ShaderCache::~ShaderCache() = default;
+
 void ShaderCache::Store(const void* key, size_t keySize, const void* value, size_t valueSize) noexcept
 {
-#ifdef __ID3D12ShaderCacheSession_INTERFACE_DEFINED__
     std::shared_lock Lock(m_ResetLock);
+#ifdef __ID3D12ShaderCacheSession_INTERFACE_DEFINED__
     if (m_pSession)
     {
         (void)m_pSession->StoreValue(key, (UINT)keySize, value, (UINT)valueSize);
     }
 #endif
-}
-
-void ShaderCache::Store(const void* const* keys, const size_t* keySizes, unsigned keyParts, const void* value, size_t valueSize)
-{
-#ifdef __ID3D12ShaderCacheSession_INTERFACE_DEFINED__
-    std::shared_lock Lock(m_ResetLock);
-    if (m_pSession)
+    if (m_pFileCache)
     {
-        size_t combinedSize = std::accumulate(keySizes, keySizes + keyParts, (size_t)0);
-        std::unique_ptr<byte[]> combinedKey(new byte[combinedSize]);
-
-        unsigned i = 0;
-        for (byte* ptr = combinedKey.get(); ptr != combinedKey.get() + combinedSize; ptr += keySizes[i++])
+        try
         {
-            memcpy(ptr, keys[i], keySizes[i]);
+            (void)m_pFileCache->Store(&key, &keySize, 1, value, valueSize);
         }
+        catch (...) {}
+    }
 
-        Store(combinedKey.get(), combinedSize, value, valueSize);
+    if (HasCache() && valueSize <= m_HotTier.GetMaxBlobSize())
+    {
+        try
+        {
+            std::shared_ptr<byte[]> copy(new byte[valueSize]);
+            memcpy(copy.get(), value, valueSize);
+            m_HotTier.Insert(BlobCache::HashKey(key, keySize), { std::move(copy), valueSize });
+        }
+        catch (...) {}
     }
-#endif
+}
+
+void ShaderCache::Store(const void* const* keys, const size_t* keySizes, unsigned keyParts, const void* value, size_t valueSize) noexcept
+{
+    auto digest = BlobCache::HashKey(keys, keySizes, keyParts);
+    Store(digest.data(), sizeof(digest), value, valueSize);
 }
 
 ShaderCache::FoundValue ShaderCache::Find(const void* key, size_t keySize)
 {
-#ifdef __ID3D12ShaderCacheSession_INTERFACE_DEFINED__
     std::shared_lock Lock(m_ResetLock);
-    if (m_pSession)
+    if (!HasCache())
+        return {};
+
+    auto hotKey = BlobCache::HashKey(key, keySize);
+    if (auto found = m_HotTier.Find(hotKey); found.first)
+    {
+        return found;
+    }
+
+    FoundValue value;
+    for (auto& bundle : m_Bundles)
+    {
+        if (auto found = bundle->Find(&key, &keySize, 1); found.first)
+        {
+            value = { std::move(found.first), found.second };
+            break;
+        }
+    }
+#ifdef __ID3D12ShaderCacheSession_INTERFACE_DEFINED__
+    if (m_pSession && !value.first)
     {
         UINT valueSize = 0;
         if (SUCCEEDED(m_pSession->FindValue(key, (UINT)keySize, nullptr, &valueSize)))
         {
-            ShaderCache::FoundValue value(new byte[valueSize], valueSize);
-            if (SUCCEEDED(m_pSession->FindValue(key, (UINT)keySize, value.first.get(), &valueSize)))
+            std::shared_ptr<byte[]> data(new byte[valueSize]);
+            if (SUCCEEDED(m_pSession->FindValue(key, (UINT)keySize, data.get(), &valueSize)))
             {
-                return value;
+                value = { std::move(data), valueSize };
             }
         }
     }
 #endif
-    return {};
+    if (m_pFileCache && !value.first)
+    {
+        auto found = m_pFileCache->Find(&key, &keySize, 1);
+        value = { std::move(found.first), found.second };
+    }
+
+    if (value.first)
+    {
+        m_HotTier.Insert(hotKey, value);
+    }
+    return value;
 }
 
 ShaderCache::FoundValue ShaderCache::Find(const void* const* keys, const size_t* keySizes, unsigned keyParts)
 {
-#ifdef __ID3D12ShaderCacheSession_INTERFACE_DEFINED__
-    std::shared_lock Lock(m_ResetLock);
-    if (m_pSession)
-    {
-        size_t combinedSize = std::accumulate(keySizes, keySizes + keyParts, (size_t)0);
-        std::unique_ptr<byte[]> combinedKey(new byte[combinedSize]);
-
-        unsigned i = 0;
-        for (byte* ptr = combinedKey.get(); ptr != combinedKey.get() + combinedSize; ptr += keySizes[i++])
-        {
-            memcpy(ptr, keys[i], keySizes[i]);
-        }
-
-        return Find(combinedKey.get(), combinedSize);
-    }
-#endif
-    return {};
+    auto digest = BlobCache::HashKey(keys, keySizes, keyParts);
+    return Find(digest.data(), sizeof(digest));
 }
 
 void ShaderCache::Close()
 {
-#ifdef __ID3D12ShaderCacheSession_INTERFACE_DEFINED__
     std::unique_lock Lock(m_ResetLock);
+#ifdef __ID3D12ShaderCacheSession_INTERFACE_DEFINED__
     m_pSession.Reset();
 #endif
+    m_pFileCache.reset();
+    m_Bundles.clear();
+    m_HotTier.Clear();
 }
 
 void ShaderCache::Clear()
 {
-#ifdef __ID3D12ShaderCacheSession_INTERFACE_DEFINED__
     std::unique_lock Lock(m_ResetLock);
+    m_HotTier.Clear();
+    // Bundles can't be emptied, so stop using them. They were likely built with another driver.
+    m_Bundles.clear();
+#ifdef __ID3D12ShaderCacheSession_INTERFACE_DEFINED__
     if (m_pSession)
     {
         m_pSession->SetDeleteOnDestroy();
@@ -125,6 +305,11 @@ void ShaderCache::Clear()
 
         m_pSession.Reset();
         (void)device9->CreateShaderCacheSession(&Desc, IID_PPV_ARGS(&m_pSession));
+        return;
     }
 #endif
+    if (m_pFileCache)
+    {
+        m_pFileCache->Clear();
+    }
 }
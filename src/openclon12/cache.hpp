@@ -3,38 +3,60 @@
 #pragma once
 
 #include "d3d12.h"
+#include "blobcache.hpp"
 #include <memory>
+#include <string>
 #include <utility>
+#include <vector>
 #include <shared_mutex>
 #include <wrl/client.h>
 
+class FileCache;
+
+// Backed by a D3D shader cache session when the runtime supports them, and by a FileCache otherwise.
+// CLON12_SHADER_CACHE picks the backend instead: "d3d12", "file", or "none".
+// Values found or stored are also kept in memory, so a program that's built again in the same process
+// doesn't go back to the disk. CLON12_SHADER_CACHE_MEMORY_MB sizes that.
+// Bundles of precompiled programs from openclon12aot, listed in CLON12_SHADER_CACHE_BUNDLE, are
+// mapped read-only and searched before the backend. Driver-versioned caches don't use them.
 class ShaderCache
 {
 public:
-    ShaderCache(ID3D12Device*, bool driverVersioned);
+    // FileName is the name used for this cache when it's stored in a file, which goes in
+    // CLON12_SHADER_CACHE_DIR if that's set.
+    ShaderCache(ID3D12Device*, bool driverVersioned, std::wstring const& fileName);
+    ~ShaderCache();
 
     bool HasCache() const
     {
 #ifdef __ID3D12ShaderCacheSession_INTERFACE_DEFINED__
-        return m_pSession;
-#else
-        return false;
+        if (m_pSession)
+            return true;
 #endif
+        return m_pFileCache != nullptr || !m_Bundles.empty();
     }
 
     void Store(const void* key, size_t keySize, const void* value, size_t valueSize) noexcept;
-    void Store(const void* const* keys, const size_t* keySizes, unsigned keyParts, const void* value, size_t valueSize);
+    // Keys in several parts are hashed in place into a 128-bit key, which is what's stored.
+    // The parts are never concatenated, so large ones like program source are cheap to use directly.
+    void Store(const void* const* keys, const size_t* keySizes, unsigned keyParts, const void* value, size_t valueSize) noexcept;
 
-    using FoundValue = std::pair<std::unique_ptr<byte[]>, size_t>;
+    // Values are shared with the in-memory cache, and must not be modified.
+    using FoundValue = BlobCache::Blob;
     FoundValue Find(const void* key, size_t keySize);
     FoundValue Find(const void* const* keys, const size_t* keySizes, unsigned keyParts);
 
     void Close();
     void Clear();
 
-#ifdef __ID3D12ShaderCacheSession_INTERFACE_DEFINED__
 private:
+#ifdef __ID3D12ShaderCacheSession_INTERFACE_DEFINED__
     Microsoft::WRL::ComPtr<ID3D12ShaderCacheSession> m_pSession;
-    std::shared_mutex m_ResetLock;
 #endif
+    std::unique_ptr<FileCache> m_pFileCache;
+    std::vector<std::unique_ptr<FileCache>> m_Bundles;
+    std::shared_mutex m_ResetLock;
+
+    // Keyed by a hash of the key
+    BlobCache m_HotTier;
 };
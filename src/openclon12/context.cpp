@@ -715,3 +715,97 @@ void Context::AddDestructionCallback(DestructorCallback::Fn pfn, void *pUserData
     std::lock_guard DestructorLock(m_DestructorLock);
     m_DestructorCallbacks.push_back({ pfn, pUserData });
 }
+
+TaskPoolLock Context::GetTaskPoolLock()
+{
+    TaskPoolLock lock;
+    lock.m_Lock = std::unique_lock<std::recursive_mutex>{ m_TaskPoolLock };
+    return lock;
+}
+
+void Context::FlushAllDevices(TaskPoolLock const& Lock)
+{
+    for (auto& [device, d3dDevice] : m_AssociatedDevices)
+    {
+        d3dDevice->Flush(Lock);
+    }
+}
+
+void* TaskAllocator::Allocate(size_t Size)
+{
+    size_t TotalSize = Size + sizeof(BlockHeader);
+    size_t Bucket = (TotalSize + BucketGranularity - 1) / BucketGranularity - 1;
+    BlockHeader* Header;
+    if (Bucket >= NumBuckets)
+    {
+        // Unusually large tasks just go to the heap
+        Header = static_cast<BlockHeader*>(::operator new(TotalSize));
+    }
+    else
+    {
+        std::lock_guard Lock(m_Lock);
+        FreeBlock*& FreeList = m_FreeLists[Bucket];
+        if (!FreeList)
+        {
+            size_t BlockSize = (Bucket + 1) * BucketGranularity;
+            std::unique_ptr<char[]> Slab(new char[BlockSize * BlocksPerSlab]);
+            m_Slabs.push_back(std::move(Slab));
+            char* SlabData = m_Slabs.back().get();
+            for (size_t i = BlocksPerSlab; i-- > 0; )
+            {
+                auto Block = reinterpret_cast<FreeBlock*>(SlabData + i * BlockSize);
+                Block->m_Next = FreeList;
+                FreeList = Block;
+            }
+        }
+        Header = reinterpret_cast<BlockHeader*>(FreeList);
+        FreeList = FreeList->m_Next;
+        ++m_OutstandingBlocks;
+    }
+    Header->m_Allocator = this;
+    Header->m_Bucket = Bucket;
+    return Header + 1;
+}
+
+void TaskAllocator::Free(void* p) noexcept
+{
+    if (!p)
+    {
+        return;
+    }
+    BlockHeader* Header = static_cast<BlockHeader*>(p) - 1;
+    TaskAllocator* Allocator = Header->m_Allocator;
+    size_t Bucket = Header->m_Bucket;
+    if (Bucket >= NumBuckets)
+    {
+        ::operator delete(Header);
+        return;
+    }
+
+    bool Destroy;
+    {
+        std::lock_guard Lock(Allocator->m_Lock);
+        auto Block = reinterpret_cast<FreeBlock*>(Header);
+        Block->m_Next = Allocator->m_FreeLists[Bucket];
+        Allocator->m_FreeLists[Bucket] = Block;
+        Destroy = --Allocator->m_OutstandingBlocks == 0 && !Allocator->m_OwnerAlive;
+    }
+    if (Destroy)
+    {
+        delete Allocator;
+    }
+}
+
+void TaskAllocator::ReleaseOwner() noexcept
+{
+    bool Destroy;
+    {
+        std::lock_guard Lock(m_Lock);
+        m_OwnerAlive = false;
+        Destroy = m_OutstandingBlocks == 0;
+    }
+    if (Destroy)
+    {
+        delete this;
+    }
+}
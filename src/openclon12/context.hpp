@@ -36,6 +36,41 @@ protected:
     decltype(&glDeleteSync) m_DeleteSync;
 };
 
+// Recycles task allocations for a context. Blocks are bucketed by size and kept on free lists,
+// so steady-state enqueues don't go to the general-purpose heap. A task's destructor can release
+// the last reference on its context before the memory is returned, so the allocator stays alive
+// until both its context and every block it handed out are gone.
+class TaskAllocator
+{
+public:
+    static TaskAllocator* Create() { return new TaskAllocator; }
+    void ReleaseOwner() noexcept;
+
+    void* Allocate(size_t Size);
+    static void Free(void* p) noexcept;
+
+private:
+    TaskAllocator() = default;
+    ~TaskAllocator() = default;
+
+    struct alignas(std::max_align_t) BlockHeader
+    {
+        TaskAllocator* m_Allocator;
+        size_t m_Bucket;
+    };
+    struct FreeBlock { FreeBlock* m_Next; };
+
+    static constexpr size_t BucketGranularity = 64;
+    static constexpr size_t NumBuckets = 16;
+    static constexpr size_t BlocksPerSlab = 32;
+
+    std::mutex m_Lock;
+    FreeBlock* m_FreeLists[NumBuckets] = {};
+    std::vector<std::unique_ptr<char[]>> m_Slabs;
+    size_t m_OutstandingBlocks = 0;
+    bool m_OwnerAlive = true;
+};
+
 class Context : public CLChildBase<Context, Platform, cl_context>
 {
 public:
@@ -64,6 +99,11 @@ private:
     std::unique_ptr<GLInteropManager> m_GLInteropManager;
     ID3D12CommandQueue *m_GLCommandQueue = nullptr; // weak
 
+    std::recursive_mutex m_TaskPoolLock;
+
+    struct TaskAllocatorOwner { void operator()(TaskAllocator* p) const noexcept { p->ReleaseOwner(); } };
+    std::unique_ptr<TaskAllocator, TaskAllocatorOwner> m_TaskAllocator{ TaskAllocator::Create() };
+
     static void CL_CALLBACK DummyCallback(const char*, const void*, size_t, void*) {}
 
     friend cl_int CL_API_CALL clGetContextInfo(cl_context, cl_context_info, size_t, void*, size_t*);
@@ -108,4 +148,8 @@ public:
     std::vector<D3DDeviceAndRef> GetDevices() const noexcept { return m_AssociatedDevices; }
 
     void AddDestructionCallback(DestructorCallback::Fn pfn, void* pUserData);
+
+    TaskPoolLock GetTaskPoolLock();
+    TaskAllocator& GetTaskAllocator() const noexcept { return *m_TaskAllocator; }
+    void FlushAllDevices(TaskPoolLock const& Lock);
 };
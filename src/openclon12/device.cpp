@@ -337,6 +337,19 @@ Device::Device(Platform& parent, IDXCoreAdapter* pAdapter)
 
 Device::~Device() = default;
 
+static uint32_t GetMaxSubmissionsInFlight()
+{
+    char *maxSubmissionsStr = nullptr;
+    uint32_t maxSubmissions = 2;
+    if (_dupenv_s(&maxSubmissionsStr, nullptr, "CLON12_MAX_SUBMISSIONS_IN_FLIGHT") == 0 &&
+        maxSubmissionsStr && *maxSubmissionsStr)
+    {
+        maxSubmissions = (uint32_t)strtoul(maxSubmissionsStr, nullptr, 10);
+    }
+    free(maxSubmissionsStr);
+    return maxSubmissions;
+}
+
 static ImmCtx::CreationArgs GetImmCtxCreationArgs()
 {
     ImmCtx::CreationArgs Args = {};
@@ -344,6 +357,25 @@ static ImmCtx::CreationArgs GetImmCtxCreationArgs()
     return Args;
 }
 
+// Cache files can be shared by every process using the same hardware. PSOs are only
+// valid for the driver that created them, so those also go by driver version.
+static std::wstring GetShaderCacheFileName(Device &parent, bool driverVersioned)
+{
+    auto& HWIDs = parent.GetHardwareIds();
+    wchar_t Name[96];
+    if (driverVersioned)
+    {
+        swprintf_s(Name, L"clon12_%04x_%04x_%08x_%02x_driver_%016llx.cache", HWIDs.vendorID, HWIDs.deviceID,
+                   HWIDs.subSysID, HWIDs.revision, parent.GetDriverVersion());
+    }
+    else
+    {
+        swprintf_s(Name, L"clon12_%04x_%04x_%08x_%02x.cache", HWIDs.vendorID, HWIDs.deviceID,
+                   HWIDs.subSysID, HWIDs.revision);
+    }
+    return Name;
+}
+
 D3DDevice::D3DDevice(Device &parent, ID3D12Device *pDevice, ID3D12CommandQueue *pQueue,
                      D3D12_FEATURE_DATA_D3D12_OPTIONS &options, bool IsImportedDevice)
     : m_IsImportedDevice(IsImportedDevice)
@@ -351,13 +383,12 @@ D3DDevice::D3DDevice(Device &parent, ID3D12Device *pDevice, ID3D12CommandQueue *
     , m_spDevice(pDevice)
     , m_ImmCtx(options, pDevice, pQueue, GetImmCtxCreationArgs())
     , m_RecordingSubmission(new Submission)
-    , m_ShaderCache(pDevice, false)
-    , m_DriverShaderCache(pDevice, true)
+    , m_MaxSubmissionsInFlight(GetMaxSubmissionsInFlight())
+    , m_ExecutionStrand(BackgroundTaskScheduler::Scheduler::CreateStrandKey())
+    , m_CompletionStrand(BackgroundTaskScheduler::Scheduler::CreateStrandKey())
+    , m_ShaderCache(pDevice, false, GetShaderCacheFileName(parent, false))
+    , m_DriverShaderCache(pDevice, true, GetShaderCacheFileName(parent, true))
 {
-    BackgroundTaskScheduler::SchedulingMode mode{ 1u, BackgroundTaskScheduler::Priority::Normal };
-    m_ExecutionScheduler.SetSchedulingMode(mode);
-    m_CompletionScheduler.SetSchedulingMode(mode);
-
     auto commandQueue = m_ImmCtx.GetCommandQueue();
     (void)commandQueue->GetTimestampFrequency(&m_TimestampFrequency);
 
@@ -370,6 +401,14 @@ D3DDevice::D3DDevice(Device &parent, ID3D12Device *pDevice, ID3D12CommandQueue *
         (INT64)Task::TimestampToNanoseconds(GPUTimestamp, m_TimestampFrequency);
 }
 
+D3DDevice::~D3DDevice()
+{
+    // Recording can queue completion work, so drain it first
+    auto& Scheduler = g_Platform->GetDeviceScheduler();
+    Scheduler.CancelStrand(m_ExecutionStrand);
+    Scheduler.CancelStrand(m_CompletionStrand);
+}
+
 D3DDevice &Device::InitD3D(ID3D12Device *pDevice, ID3D12CommandQueue *pQueue)
 {
     std::lock_guard Lock(m_InitLock);
@@ -449,6 +488,13 @@ DXCoreHardwareID const& Device::GetHardwareIds() const noexcept
     return m_HWIDs;
 }
 
+uint64_t Device::GetDriverVersion() const noexcept
+{
+    uint64_t driverVersion = 0;
+    (void)m_spAdapter->GetProperty(DXCoreAdapterProperty::DriverVersion, sizeof(driverVersion), &driverVersion);
+    return driverVersion;
+}
+
 cl_device_type Device::GetType() const noexcept
 {
     cl_device_type Default = m_DefaultDevice ? CL_DEVICE_TYPE_DEFAULT : 0;
@@ -520,7 +566,7 @@ void D3DDevice::SubmitTask(Task* task, TaskPoolLock const& lock)
     // User commands are treated as 'submitted' when they're created
     task->Submit();
 
-    if (task->m_TasksToWaitOn.empty())
+    if (!task->HasUnmetDependencies())
     {
         ReadyTask(task, lock);
     }
@@ -546,10 +592,10 @@ void D3DDevice::SubmitTask(Task* task, TaskPoolLock const& lock)
 
 void D3DDevice::ReadyTask(Task* task, TaskPoolLock const& lock)
 {
-    assert(task->m_TasksToWaitOn.empty());
+    assert(!task->HasUnmetDependencies());
 
     task->MigrateResources();
-    if (!task->m_TasksToWaitOn.empty() ||
+    if (task->HasUnmetDependencies() ||
         task->GetState() != Task::State::Submitted)
     {
         // Need to wait for resources to migrate.
@@ -557,48 +603,39 @@ void D3DDevice::ReadyTask(Task* task, TaskPoolLock const& lock)
         return;
     }
 
-    m_RecordingSubmission->push_back(task);
+    {
+        std::lock_guard SubmissionLock(m_SubmissionLock);
+        m_RecordingSubmission->push_back(task);
+    }
     task->Ready(lock);
 }
 
 void D3DDevice::Flush(TaskPoolLock const&)
 {
-    if (m_RecordingSubmission->empty())
+    std::lock_guard SubmissionLock(m_SubmissionLock);
+    QueueRecordingSubmission(SubmissionLock);
+}
+
+void D3DDevice::QueueRecordingSubmission(std::lock_guard<std::mutex> const&)
+{
+    if (m_RecordingSubmission->empty() ||
+        (m_MaxSubmissionsInFlight && m_SubmissionsInFlight >= m_MaxSubmissionsInFlight))
     {
         return;
     }
 
-    struct ExecutionHandler
-    {
-        D3DDevice& m_Device;
-        std::unique_ptr<Submission> m_Tasks;
-    };
-    std::unique_ptr<ExecutionHandler> spHandler(new ExecutionHandler{ *this, std::move(m_RecordingSubmission) });
-
-    m_ExecutionScheduler.QueueTask({
-        [](void* pContext)
-        {
-            std::unique_ptr<ExecutionHandler> spHandler(static_cast<ExecutionHandler*>(pContext));
-            spHandler->m_Device.ExecuteTasks(std::move(spHandler->m_Tasks));
-        },
-        [](void* pContext)
+    auto spNewSubmission = std::make_unique<Submission>();
+    g_Platform->GetDeviceScheduler().QueueTask({
+        [this, spTasks = std::move(m_RecordingSubmission)]() mutable
         {
-            std::unique_ptr<ExecutionHandler> spHandler(static_cast<ExecutionHandler*>(pContext));
+            ExecuteTasks(std::move(spTasks));
         },
-        spHandler.get()
+        BackgroundTaskScheduler::TaskPriority::Normal,
+        m_ExecutionStrand
     });
-    spHandler.release();
 
-    m_RecordingSubmission.reset(new Submission);
-}
-
-void Device::FlushAllDevices(TaskPoolLock const& Lock)
-{
-    std::lock_guard InitLock(m_InitLock);
-    for (auto &d3dDevice : m_D3DDevices)
-    {
-        d3dDevice->Flush(Lock);
-    }
+    m_RecordingSubmission = std::move(spNewSubmission);
+    ++m_SubmissionsInFlight;
 }
 
 void D3DDevice::ExecuteTasks(std::unique_ptr<Submission> spTasks)
@@ -610,55 +647,66 @@ void D3DDevice::ExecuteTasks(std::unique_ptr<Submission> spTasks)
         {
             auto& task = tasks[i];
             task->Record();
-            auto Lock = g_Platform->GetTaskPoolLock();
+            auto Lock = task->m_Parent->GetTaskPoolLock();
             task->Started(Lock);
         }
         catch (...)
         {
-            auto Lock = g_Platform->GetTaskPoolLock();
-            if ((cl_int)tasks[i]->GetState() > 0)
             {
-                tasks[i]->Complete(CL_OUT_OF_RESOURCES, Lock);
+                auto Lock = tasks[i]->m_Parent->GetTaskPoolLock();
+                if ((cl_int)tasks[i]->GetState() > 0)
+                {
+                    tasks[i]->Complete(CL_OUT_OF_RESOURCES, Lock);
+                }
             }
             for (size_t j = i + 1; j < tasks.size(); ++j)
             {
                 auto& task = tasks[j];
+                auto Lock = task->m_Parent->GetTaskPoolLock();
                 task->Complete(CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST, Lock);
             }
             tasks.erase(tasks.begin() + i, tasks.end());
         }
     }
 
-    struct CompletionHandler
-    {
-        XPlatHelpers::unique_event m_Event;
-        std::unique_ptr<Submission> m_Tasks;
-    };
-    std::unique_ptr<CompletionHandler> spHandler(new CompletionHandler);
-    spHandler->m_Event.create();
-    spHandler->m_Tasks = std::move(spTasks);
-    ImmCtx().EnqueueSetEvent(spHandler->m_Event.get());
-    m_CompletionScheduler.QueueTask({
-        [](void* pContext)
+    XPlatHelpers::unique_event Event;
+    Event.create();
+    ImmCtx().EnqueueSetEvent(Event.get());
+    g_Platform->GetDeviceScheduler().QueueTask({
+        [this, Event = std::move(Event), spTasks = std::move(spTasks)]()
         {
-            std::unique_ptr<CompletionHandler> spHandler(static_cast<CompletionHandler*>(pContext));
-            spHandler->m_Event.wait();
+            Event.wait();
 
-            auto Lock = g_Platform->GetTaskPoolLock();
-            for (auto& task : *spHandler->m_Tasks)
+            // Get whatever became ready while this ran to the GPU before doing the CPU side of completion
             {
-                task->Complete(CL_SUCCESS, Lock);
+                std::lock_guard SubmissionLock(m_SubmissionLock);
+                --m_SubmissionsInFlight;
+                QueueRecordingSubmission(SubmissionLock);
             }
 
-            // Enqueue another execution task if there's new items ready to go
-            g_Platform->FlushAllDevices(Lock);
-        },
-        [](void* pContext)
-        {
-            std::unique_ptr<CompletionHandler> spHandler(static_cast<CompletionHandler*>(pContext));
+            auto& tasks = *spTasks;
+            for (auto& task : tasks)
+            {
+                task->OnGPUWorkComplete();
+            }
+
+            // A submission can contain tasks from several contexts. Each run of tasks from the same
+            // context is completed under that context's lock, so other contexts can keep enqueueing.
+            for (size_t i = 0; i < tasks.size();)
+            {
+                Context& context = tasks[i]->m_Parent.get();
+                auto Lock = context.GetTaskPoolLock();
+                for (; i < tasks.size() && &tasks[i]->m_Parent.get() == &context; ++i)
+                {
+                    tasks[i]->Complete(CL_SUCCESS, Lock);
+                }
+
+                // Enqueue another execution task if there's new items ready to go
+                context.FlushAllDevices(Lock);
+            }
         },
-        spHandler.get()});
-    spHandler.release();
+        BackgroundTaskScheduler::TaskPriority::Normal,
+        m_CompletionStrand });
 }
 
 void Device::CacheCaps(std::lock_guard<std::mutex> const&, ComPtr<ID3D12Device> spDevice)
@@ -690,6 +738,19 @@ void Device::CacheCaps(std::lock_guard<std::mutex> const&, ComPtr<ID3D12Device>
         }
     }
 
+    // The shader model is part of the cache keys, so precompiling for machines with an older one has to
+    // pretend to be one of them, e.g. CLON12_MAX_SHADER_MODEL=6.2
+    char *maxShaderModelStr = nullptr;
+    unsigned major = 0, minor = 0;
+    if (_dupenv_s(&maxShaderModelStr, nullptr, "CLON12_MAX_SHADER_MODEL") == 0 &&
+        maxShaderModelStr &&
+        sscanf_s(maxShaderModelStr, "%u.%u", &major, &minor) == 2 &&
+        major == 6 && minor <= 0xf)
+    {
+        m_ShaderModel = std::min(m_ShaderModel, (D3D_SHADER_MODEL)((major << 4) | minor));
+    }
+    free(maxShaderModelStr);
+
     m_CapsValid = true;
 }
 
@@ -36,10 +36,11 @@ public:
 protected:
     D3DDevice(Device &parent, ID3D12Device *pDevice, ID3D12CommandQueue *pQueue,
               D3D12_FEATURE_DATA_D3D12_OPTIONS &options, bool IsImportedDevice);
-    ~D3DDevice() = default;
+    ~D3DDevice();
 
     friend class Device;
 
+    void QueueRecordingSubmission(std::lock_guard<std::mutex> const&);
     void ExecuteTasks(std::unique_ptr<Submission> spTasks);
     unsigned m_ContextCount = 1;
     const bool m_IsImportedDevice;
@@ -48,10 +49,20 @@ protected:
     const ComPtr<ID3D12Device> m_spDevice;
     ::ImmCtx m_ImmCtx;
 
+    // Tasks from every context on this device are recorded together, so the submission
+    // being built has its own lock rather than relying on a context's task pool lock.
+    std::mutex m_SubmissionLock;
     std::unique_ptr<Submission> m_RecordingSubmission;
 
-    BackgroundTaskScheduler::Scheduler m_ExecutionScheduler;
-    BackgroundTaskScheduler::Scheduler m_CompletionScheduler;
+    // Submissions handed to the GPU are pipelined: the next one is recorded and submitted while the
+    // previous one runs. Once the limit is reached, newly ready tasks are batched into the recording
+    // submission, which goes out as soon as one completes. Guarded by m_SubmissionLock. 0 is unlimited.
+    const uint32_t m_MaxSubmissionsInFlight;
+    uint32_t m_SubmissionsInFlight = 0;
+
+    // Recording and completion each run in order, on the platform's shared device scheduler.
+    const BackgroundTaskScheduler::StrandKey m_ExecutionStrand;
+    const BackgroundTaskScheduler::StrandKey m_CompletionStrand;
     mutable ShaderCache m_ShaderCache;
     mutable ShaderCache m_DriverShaderCache;
 
@@ -68,6 +79,7 @@ public:
     cl_bool IsAvailable() const noexcept;
     cl_ulong GetGlobalMemSize();
     DXCoreHardwareID const& GetHardwareIds() const noexcept;
+    uint64_t GetDriverVersion() const noexcept;
     cl_device_type GetType() const noexcept;
     bool IsMCDM() const noexcept;
     bool IsUMA();
@@ -92,7 +104,6 @@ public:
 
     bool HasD3DDevice() const noexcept { return !m_D3DDevices.empty(); }
     void CloseCaches();
-    void FlushAllDevices(TaskPoolLock const& Lock);
 
 protected:
     void CacheCaps(std::lock_guard<std::mutex> const&, ComPtr<ID3D12Device> spDevice = {});
@@ -0,0 +1,386 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+#include "filecache.hpp"
+#include "spookyv2.h"
+
+#include <wil/result_macros.h>
+
+#include <algorithm>
+#include <cstring>
+
+struct FileCache::FileHeader
+{
+    char Magic[8];
+    uint32_t FormatVersion;
+    uint32_t HeaderSize;
+    uint64_t Version;
+    // Bumped each time the file is emptied, so other processes know to drop their index
+    uint64_t Generation;
+    // The end of the last complete record. Anything past this is ignored and overwritten.
+    uint64_t CommittedSize;
+};
+
+namespace
+{
+    constexpr char FileMagic[8] = { 'C', 'L', 'O', 'N', '1', '2', 'S', 'C' };
+    constexpr uint32_t FormatVersion = 1;
+    constexpr uint32_t RecordMagic = 0x52434c43; // "CLCR"
+    constexpr uint64_t HashSeed = 0x636c6f6e31326663;
+
+    // Followed by the key and the value, and padded so the next record is 8-byte aligned.
+    struct RecordHeader
+    {
+        uint32_t Magic;
+        uint32_t KeySize;
+        uint32_t ValueSize;
+        uint32_t Reserved;
+        uint64_t KeyHash;
+        // Of the key followed by the value
+        uint64_t Checksum;
+    };
+
+    uint64_t RecordSize(uint64_t KeySize, uint64_t ValueSize)
+    {
+        return (sizeof(RecordHeader) + KeySize + ValueSize + 7) & ~7ull;
+    }
+
+    // The whole file is guarded by a lock on a byte far past the end of any real data, so that
+    // locking doesn't interfere with reads and writes of the file's contents.
+    class FileLock
+    {
+    public:
+        FileLock(HANDLE File, bool Exclusive) noexcept : m_File(File)
+        {
+            OVERLAPPED Overlapped = GetOverlapped();
+            m_Locked = LockFileEx(m_File, Exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, 1, 0, &Overlapped);
+        }
+        ~FileLock()
+        {
+            if (m_Locked)
+            {
+                OVERLAPPED Overlapped = GetOverlapped();
+                UnlockFileEx(m_File, 0, 1, 0, &Overlapped);
+            }
+        }
+        explicit operator bool() const noexcept { return m_Locked; }
+
+    private:
+        static OVERLAPPED GetOverlapped() noexcept
+        {
+            OVERLAPPED Overlapped = {};
+            Overlapped.OffsetHigh = 0x7fffffff;
+            return Overlapped;
+        }
+        HANDLE const m_File;
+        bool m_Locked;
+    };
+
+    bool ReadAt(HANDLE File, uint64_t Offset, void* Data, DWORD Size) noexcept
+    {
+        OVERLAPPED Overlapped = {};
+        Overlapped.Offset = (DWORD)Offset;
+        Overlapped.OffsetHigh = (DWORD)(Offset >> 32);
+        DWORD BytesRead = 0;
+        return ReadFile(File, Data, Size, &BytesRead, &Overlapped) && BytesRead == Size;
+    }
+
+    bool WriteAt(HANDLE File, uint64_t Offset, void const* Data, DWORD Size) noexcept
+    {
+        OVERLAPPED Overlapped = {};
+        Overlapped.Offset = (DWORD)Offset;
+        Overlapped.OffsetHigh = (DWORD)(Offset >> 32);
+        DWORD BytesWritten = 0;
+        return WriteFile(File, Data, Size, &BytesWritten, &Overlapped) && BytesWritten == Size;
+    }
+
+    // Hashes the key parts as if they were concatenated. Returns the total key size.
+    size_t HashKey(SpookyHash& Hasher, const void* const* Keys, const size_t* KeySizes, unsigned KeyParts, uint64_t& KeyHash)
+    {
+        Hasher.Init(HashSeed, HashSeed);
+        size_t KeySize = 0;
+        for (unsigned i = 0; i < KeyParts; ++i)
+        {
+            Hasher.Update(Keys[i], KeySizes[i]);
+            KeySize += KeySizes[i];
+        }
+        uint64_t Unused;
+        Hasher.Final(&KeyHash, &Unused);
+        return KeySize;
+    }
+}
+
+FileCache::FileCache(std::filesystem::path const& Path, uint64_t Version, uint64_t MaxSize, Access AccessMode)
+    : m_Version(Version)
+    , m_MaxSize(std::max<uint64_t>(MaxSize, sizeof(FileHeader)))
+    , m_ReadOnly(AccessMode == Access::ReadOnly)
+{
+    m_File.reset(CreateFileW(Path.c_str(), m_ReadOnly ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE,
+                             FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                             nullptr, m_ReadOnly ? OPEN_EXISTING : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+    THROW_LAST_ERROR_IF(!m_File);
+
+    FileLock Lock(m_File.get(), !m_ReadOnly);
+    THROW_LAST_ERROR_IF(!Lock);
+    FileHeader Header = {};
+    if (!ReadHeader(Header))
+    {
+        THROW_HR_IF(HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT), m_ReadOnly);
+        THROW_LAST_ERROR_IF(!Reset(Header));
+    }
+}
+
+FileCache::~FileCache()
+{
+    UnmapFile();
+}
+
+bool FileCache::ReadHeader(FileHeader& Header)
+{
+    return ReadAt(m_File.get(), 0, &Header, sizeof(Header)) &&
+        memcmp(Header.Magic, FileMagic, sizeof(FileMagic)) == 0 &&
+        Header.FormatVersion == FormatVersion &&
+        Header.HeaderSize == sizeof(FileHeader) &&
+        Header.Version == m_Version &&
+        Header.CommittedSize >= sizeof(FileHeader);
+}
+
+bool FileCache::WriteHeader(FileHeader const& Header)
+{
+    return WriteAt(m_File.get(), 0, &Header, sizeof(Header));
+}
+
+bool FileCache::Reset(FileHeader& Header)
+{
+    // The file is never truncated, since other processes may have it mapped.
+    // The space is reused by the records written after this.
+    uint64_t Generation = Header.Generation + 1;
+    Header = {};
+    memcpy(Header.Magic, FileMagic, sizeof(FileMagic));
+    Header.FormatVersion = FormatVersion;
+    Header.HeaderSize = sizeof(FileHeader);
+    Header.Version = m_Version;
+    Header.Generation = Generation;
+    Header.CommittedSize = sizeof(FileHeader);
+    return WriteHeader(Header);
+}
+
+bool FileCache::MapFile(uint64_t MinSize)
+{
+    if (m_ViewSize >= MinSize)
+    {
+        return true;
+    }
+
+    UnmapFile();
+    LARGE_INTEGER FileSize = {};
+    if (!GetFileSizeEx(m_File.get(), &FileSize) || (uint64_t)FileSize.QuadPart < MinSize ||
+        (uint64_t)FileSize.QuadPart > SIZE_MAX)
+    {
+        return false;
+    }
+    m_Mapping.reset(CreateFileMappingW(m_File.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+    if (!m_Mapping)
+    {
+        return false;
+    }
+    m_View = static_cast<unsigned char const*>(MapViewOfFile(m_Mapping.get(), FILE_MAP_READ, 0, 0, 0));
+    if (!m_View)
+    {
+        m_Mapping.reset();
+        return false;
+    }
+    m_ViewSize = FileSize.QuadPart;
+    return true;
+}
+
+void FileCache::UnmapFile() noexcept
+{
+    if (m_View)
+    {
+        UnmapViewOfFile(m_View);
+    }
+    m_View = nullptr;
+    m_ViewSize = 0;
+    m_Mapping.reset();
+}
+
+bool FileCache::Refresh()
+{
+    FileHeader Header = {};
+    if (!ReadHeader(Header))
+    {
+        // Another process is using this file with a different version
+        return false;
+    }
+
+    if (Header.Generation != m_IndexedGeneration || Header.CommittedSize < m_IndexedSize)
+    {
+        m_Index.clear();
+        m_IndexedSize = sizeof(FileHeader);
+        m_IndexedGeneration = Header.Generation;
+    }
+    if (Header.CommittedSize == m_IndexedSize)
+    {
+        return true;
+    }
+    if (!MapFile(Header.CommittedSize))
+    {
+        return false;
+    }
+
+    uint64_t Offset = m_IndexedSize;
+    while (Offset + sizeof(RecordHeader) <= Header.CommittedSize)
+    {
+        RecordHeader Record;
+        memcpy(&Record, m_View + Offset, sizeof(Record));
+        uint64_t Size = RecordSize(Record.KeySize, Record.ValueSize);
+        if (Record.Magic != RecordMagic || Size > Header.CommittedSize - Offset)
+        {
+            // Torn by a lost write. Nothing after this can be found until the file is emptied.
+            break;
+        }
+        m_Index.emplace(Record.KeyHash, Offset);
+        Offset += Size;
+    }
+    m_IndexedSize = Header.CommittedSize;
+    return true;
+}
+
+bool FileCache::Store(const void* const* Keys, const size_t* KeySizes, unsigned KeyParts, const void* Value, size_t ValueSize)
+{
+    if (m_ReadOnly)
+    {
+        return false;
+    }
+
+    SpookyHash Hasher;
+    uint64_t KeyHash;
+    size_t KeySize = HashKey(Hasher, Keys, KeySizes, KeyParts, KeyHash);
+    if (KeySize > UINT32_MAX || ValueSize > UINT32_MAX ||
+        RecordSize(KeySize, ValueSize) > m_MaxSize - sizeof(FileHeader))
+    {
+        return false;
+    }
+    Hasher.Update(Value, ValueSize);
+    uint64_t Checksum, Unused;
+    Hasher.Final(&Checksum, &Unused);
+
+    std::lock_guard Lock(m_Lock);
+    FileLock Exclusive(m_File.get(), true);
+    if (!Exclusive)
+    {
+        return false;
+    }
+
+    FileHeader Header = {};
+    uint64_t Size = RecordSize(KeySize, ValueSize);
+    if (!ReadHeader(Header) || Header.CommittedSize + Size > m_MaxSize)
+    {
+        if (!Reset(Header))
+        {
+            return false;
+        }
+    }
+
+    // Write the whole record before committing it, so no reader ever sees part of it
+    uint64_t Offset = Header.CommittedSize;
+    RecordHeader Record = { RecordMagic, (uint32_t)KeySize, (uint32_t)ValueSize, 0, KeyHash, Checksum };
+    if (!WriteAt(m_File.get(), Offset, &Record, sizeof(Record)))
+    {
+        return false;
+    }
+    uint64_t WriteOffset = Offset + sizeof(Record);
+    for (unsigned i = 0; i < KeyParts; ++i)
+    {
+        if (KeySizes[i] && !WriteAt(m_File.get(), WriteOffset, Keys[i], (DWORD)KeySizes[i]))
+        {
+            return false;
+        }
+        WriteOffset += KeySizes[i];
+    }
+    if (ValueSize && !WriteAt(m_File.get(), WriteOffset, Value, (DWORD)ValueSize))
+    {
+        return false;
+    }
+    WriteOffset += ValueSize;
+    constexpr unsigned char Padding[8] = {};
+    if (Offset + Size > WriteOffset && !WriteAt(m_File.get(), WriteOffset, Padding, (DWORD)(Offset + Size - WriteOffset)))
+    {
+        return false;
+    }
+
+    Header.CommittedSize = Offset + Size;
+    return WriteHeader(Header);
+}
+
+auto FileCache::Find(const void* const* Keys, const size_t* KeySizes, unsigned KeyParts) -> FoundValue
+{
+    SpookyHash Hasher;
+    uint64_t KeyHash;
+    size_t KeySize = HashKey(Hasher, Keys, KeySizes, KeyParts, KeyHash);
+
+    std::lock_guard Lock(m_Lock);
+    FileLock Shared(m_File.get(), false);
+    if (!Shared || !Refresh())
+    {
+        return {};
+    }
+
+    // If a key was stored more than once, the last one wins
+    RecordHeader const* Found = nullptr;
+    auto [Begin, End] = m_Index.equal_range(KeyHash);
+    for (auto Iter = Begin; Iter != End; ++Iter)
+    {
+        auto Record = reinterpret_cast<RecordHeader const*>(m_View + Iter->second);
+        if (Record->KeySize != KeySize || (Found && (void const*)Record < (void const*)Found))
+        {
+            continue;
+        }
+
+        auto RecordKey = reinterpret_cast<unsigned char const*>(Record + 1);
+        bool Matches = true;
+        for (unsigned i = 0; i < KeyParts && Matches; RecordKey += KeySizes[i++])
+        {
+            Matches = memcmp(RecordKey, Keys[i], KeySizes[i]) == 0;
+        }
+        if (!Matches)
+        {
+            continue;
+        }
+
+        SpookyHash Checksummer;
+        Checksummer.Init(HashSeed, HashSeed);
+        Checksummer.Update(Record + 1, (size_t)Record->KeySize + Record->ValueSize);
+        uint64_t Checksum, Unused;
+        Checksummer.Final(&Checksum, &Unused);
+        if (Checksum == Record->Checksum)
+        {
+            Found = Record;
+        }
+    }
+
+    if (!Found)
+    {
+        return {};
+    }
+    FoundValue Value(new unsigned char[Found->ValueSize], Found->ValueSize);
+    memcpy(Value.first.get(), reinterpret_cast<unsigned char const*>(Found + 1) + Found->KeySize, Found->ValueSize);
+    return Value;
+}
+
+void FileCache::Clear()
+{
+    if (m_ReadOnly)
+    {
+        return;
+    }
+
+    std::lock_guard Lock(m_Lock);
+    FileLock Exclusive(m_File.get(), true);
+    if (Exclusive)
+    {
+        FileHeader Header = {};
+        (void)ReadHeader(Header);
+        (void)Reset(Header);
+    }
+}
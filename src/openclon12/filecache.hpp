@@ -0,0 +1,75 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+#pragma once
+
+#include <windows.h>
+#include <wil/resource.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+// A key/value store in a single file, for when D3D's shader cache sessions aren't available.
+// Records are only ever appended, and a record only counts once the header's committed size has been
+// moved past it, so a writer that dies partway through leaves nothing visible behind. Each record
+// carries a checksum of its key and value, in case writes hit the disk out of order.
+// Any number of processes can share a file: lookups take a shared lock on it and read through a
+// read-only mapping, while writers take an exclusive lock.
+// When the file would grow past its size limit it's emptied, rather than compacted.
+// The same files serve as bundles of precompiled programs, which are opened read-only.
+class FileCache
+{
+public:
+    static constexpr uint64_t DefaultMaxSize = 1024ull * 1024 * 1024;
+
+    enum class Access { ReadWrite, ReadOnly };
+
+    // Opens or creates the file. If it was written with a different version, or isn't a cache file,
+    // it's emptied. Throws if the file can't be opened.
+    // Read-only files are never created or emptied, it's an error for them to not match instead.
+    FileCache(std::filesystem::path const& Path, uint64_t Version, uint64_t MaxSize = DefaultMaxSize,
+              Access AccessMode = Access::ReadWrite);
+    ~FileCache();
+    FileCache(FileCache const&) = delete;
+    FileCache& operator=(FileCache const&) = delete;
+
+    // Keys can be split into several parts, which are treated as if they were concatenated.
+    // Returns false if the value couldn't be written, which isn't an error for a cache.
+    bool Store(const void* const* Keys, const size_t* KeySizes, unsigned KeyParts, const void* Value, size_t ValueSize);
+
+    using FoundValue = std::pair<std::unique_ptr<unsigned char[]>, size_t>;
+    FoundValue Find(const void* const* Keys, const size_t* KeySizes, unsigned KeyParts);
+
+    void Clear();
+
+private:
+    struct FileHeader;
+
+    // All called with m_Lock held and the file locked.
+    bool ReadHeader(FileHeader& Header);
+    bool WriteHeader(FileHeader const& Header);
+    bool Reset(FileHeader& Header);
+    // Brings the index up to date with everything committed to the file.
+    bool Refresh();
+    bool MapFile(uint64_t MinSize);
+    void UnmapFile() noexcept;
+
+    std::mutex m_Lock;
+    wil::unique_hfile m_File;
+    const uint64_t m_Version;
+    const uint64_t m_MaxSize;
+    const bool m_ReadOnly;
+
+    wil::unique_handle m_Mapping;
+    unsigned char const* m_View = nullptr;
+    uint64_t m_ViewSize = 0;
+
+    // Record offsets by key hash, for everything up to m_IndexedSize. Thrown away whenever some process
+    // empties the file, which bumps its generation.
+    std::unordered_multimap<uint64_t, uint64_t> m_Index;
+    uint64_t m_IndexedSize = 0;
+    uint64_t m_IndexedGeneration = 0;
+};
@@ -24,7 +24,7 @@ public:
             std::thread([ref_this = AcquireFromGLTask::ref_ptr_int(this)]()
                        {
                            ref_this->Record();
-                           auto TaskPoolLock = g_Platform->GetTaskPoolLock();
+                           auto TaskPoolLock = ref_this->m_Parent->GetTaskPoolLock();
                            static_cast<AcquireFromGLTask*>(ref_this.Get())->Complete(CL_SUCCESS, TaskPoolLock);
                        }).detach();
         }
@@ -107,9 +107,9 @@ clEnqueueAcquireGLObjects(cl_command_queue      command_queue,
         GLsync sync = {};
         context.GetGLManager()->AcquireResources(glResources, &sync);
 
-        std::unique_ptr<Task> task(new AcquireFromGLTask(context, CL_COMMAND_ACQUIRE_GL_OBJECTS, command_queue, std::move(resources), sync));
+        std::unique_ptr<Task> task(new (context) AcquireFromGLTask(context, CL_COMMAND_ACQUIRE_GL_OBJECTS, command_queue, std::move(resources), sync));
 
-        auto Lock = g_Platform->GetTaskPoolLock();
+        auto Lock = context.GetTaskPoolLock();
         if (num_events_in_wait_list)
         {
             task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
@@ -155,7 +155,7 @@ clCreateEventFromGLsyncKHR(cl_context context_,
 
     try
     {
-        return new AcquireFromGLTask(context, CL_COMMAND_GL_FENCE_SYNC_OBJECT_KHR, nullptr, {}, sync);
+        return new (context) AcquireFromGLTask(context, CL_COMMAND_GL_FENCE_SYNC_OBJECT_KHR, nullptr, {}, sync);
     }
     catch (std::bad_alloc &) { return ReportError(nullptr, CL_OUT_OF_HOST_MEMORY); }
     catch (std::exception &e) { return ReportError(e.what(), CL_OUT_OF_RESOURCES); }
@@ -258,9 +258,9 @@ clEnqueueReleaseGLObjects(cl_command_queue      command_queue,
             resources.emplace_back(&res);
         }
 
-        std::unique_ptr<Task> task(new ReleaseToGLTask(context, command_queue, std::move(resources)));
+        std::unique_ptr<Task> task(new (context) ReleaseToGLTask(context, command_queue, std::move(resources)));
 
-        auto Lock = g_Platform->GetTaskPoolLock();
+        auto Lock = context.GetTaskPoolLock();
         if (num_events_in_wait_list)
         {
             task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
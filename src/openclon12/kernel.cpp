@@ -212,23 +212,47 @@ static cl_mem_object_type MemObjectTypeFromName(const char* name)
     return 0;
 }
 
-static ComPtr<ID3DBlob> SerializeRootSignature(CompiledDxil::Metadata const& metadata)
+static UINT GetNumKernelInputRootConstants(CompiledDxil::Metadata const& metadata)
+{
+    UINT NumConstants = D3D12TranslationLayer::Align<UINT>(metadata.kernel_inputs_buf_size, 16) / sizeof(UINT);
+    // The view table can't be left empty
+    if (NumConstants > Kernel::MaxKernelInputRootConstants || metadata.num_uavs + metadata.num_srvs == 0)
+    {
+        return 0;
+    }
+    return NumConstants;
+}
+
+static ComPtr<ID3DBlob> SerializeRootSignature(CompiledDxil::Metadata const& metadata, UINT NumKernelInputRootConstants)
 {
     CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC RSDesc;
-    CD3DX12_ROOT_PARAMETER1 Params[2];
+    CD3DX12_ROOT_PARAMETER1 Params[4];
     CD3DX12_DESCRIPTOR_RANGE1 ViewRanges[3], SamplerRange;
-    cl_uint NumRanges = 0;
-    ViewRanges[NumRanges++].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 2, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE, 0);
-    ViewRanges[NumRanges++].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, (UINT)metadata.num_uavs, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE, 2);
+    cl_uint NumRanges = 0, NumParams = 0;
+    if (!NumKernelInputRootConstants)
+    {
+        ViewRanges[NumRanges++].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, metadata.kernel_inputs_cbv_id, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE);
+    }
+    ViewRanges[NumRanges++].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, (UINT)metadata.num_uavs, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE);
     if (metadata.num_srvs)
     {
         ViewRanges[NumRanges++].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, (UINT)metadata.num_srvs, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE);
     }
-    SamplerRange.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, (UINT)metadata.num_samplers, 0);
-    Params[0].InitAsDescriptorTable(NumRanges, ViewRanges);
-    // TODO: Static samplers
-    Params[1].InitAsDescriptorTable(1, &SamplerRange);
-    RSDesc.Init_1_1(metadata.num_samplers ? 2 : 1, Params);
+    Params[NumParams++].InitAsDescriptorTable(NumRanges, ViewRanges);
+    // Dispatches too large for a single D3D12 dispatch are split up, and each piece gets its own
+    // work properties. They're root constants so the table above can be shared by all of the pieces.
+    Params[NumParams++].InitAsConstants(Kernel::WorkPropertiesRootConstants, metadata.work_properties_cbv_id);
+    if (NumKernelInputRootConstants)
+    {
+        Params[NumParams++].InitAsConstants(NumKernelInputRootConstants, metadata.kernel_inputs_cbv_id);
+    }
+    if (metadata.num_samplers)
+    {
+        // TODO: Static samplers
+        SamplerRange.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, (UINT)metadata.num_samplers, 0);
+        Params[NumParams++].InitAsDescriptorTable(1, &SamplerRange);
+    }
+    RSDesc.Init_1_1(NumParams, Params);
 
     ComPtr<ID3DBlob> ret;
     D3D12TranslationLayer::ThrowFailure(D3D12SerializeVersionedRootSignature(&RSDesc, &ret, nullptr));
@@ -255,13 +279,16 @@ Kernel::Kernel(Program& Parent, std::string const& name, CompiledDxil const& Dxi
     , m_Dxil(Dxil)
     , m_Name(name)
     , m_Meta(spirv_meta)
-    , m_SerializedRootSignature(SerializeRootSignature(Dxil.GetMetadata()))
+    , m_NumKernelInputRootConstants(GetNumKernelInputRootConstants(Dxil.GetMetadata()))
+    , m_SerializedRootSignature(SerializeRootSignature(Dxil.GetMetadata(), m_NumKernelInputRootConstants))
+    , m_KernelData(Parent.GetKernelData(name))
 {
     m_UAVs.resize(Dxil.GetMetadata().num_uavs);
     m_SRVs.resize(Dxil.GetMetadata().num_srvs);
     m_Samplers.resize(Dxil.GetMetadata().num_samplers);
     m_ArgMetadataToCompiler.resize(Dxil.GetMetadata().args.size());
     m_ArgsSet.resize(Dxil.GetMetadata().args.size());
+    m_UAVWritable.resize(Dxil.GetMetadata().num_uavs, true);
     for (cl_uint i = 0; i < Dxil.GetMetadata().args.size(); ++i)
     {
         auto& meta = Dxil.GetMetadata().args[i];
@@ -270,6 +297,13 @@ Kernel::Kernel(Program& Parent, std::string const& name, CompiledDxil const& Dxi
             config = CompiledDxil::Configuration::Arg::Local{ 0 };
         else if (std::holds_alternative<CompiledDxil::Metadata::Arg::Sampler>(meta.properties))
             config = CompiledDxil::Configuration::Arg::Sampler{};
+        else if (auto memMeta = std::get_if<CompiledDxil::Metadata::Arg::Memory>(&meta.properties); memMeta)
+        {
+            // Buffers can only be written through pointers to non-const global memory
+            auto& arg_info = Dxil.GetMetadata().program_kernel_info.args[i];
+            if (arg_info.is_const || arg_info.address_qualifier == ProgramBinary::Kernel::Arg::AddressSpace::Constant)
+                m_UAVWritable[memMeta->buffer_id] = false;
+        }
     }
     size_t KernelInputsCbSize = Dxil.GetMetadata().kernel_inputs_buf_size;
     m_KernelArgsCbData.resize(KernelInputsCbSize);
@@ -295,16 +329,20 @@ Kernel::Kernel(Program& Parent, std::string const& name, CompiledDxil const& Dxi
                                                               nullptr));
         m_InlineConsts.emplace_back(resource, adopt_ref{});
         m_UAVs[constMeta.uav_id] = resource;
+        m_UAVWritable[constMeta.uav_id] = false;
     }
 
     m_Parent->KernelCreated();
+    QueueSpeculativeSpecialization();
 }
 
 Kernel::Kernel(Kernel const& other)
     : CLChildBase(other.m_Parent.get())
     , m_Dxil(other.m_Dxil)
     , m_Name(other.m_Name)
+    , m_NumKernelInputRootConstants(other.m_NumKernelInputRootConstants)
     , m_SerializedRootSignature(other.m_SerializedRootSignature)
+    , m_KernelData(other.m_KernelData)
     , m_UAVs(other.m_UAVs)
     , m_SRVs(other.m_SRVs)
     , m_Samplers(other.m_Samplers)
@@ -314,6 +352,7 @@ Kernel::Kernel(Kernel const& other)
     , m_InlineConsts(other.m_InlineConsts)
     , m_Meta(other.m_Meta)
     , m_ArgsSet(other.m_ArgsSet)
+    , m_UAVWritable(other.m_UAVWritable)
 {
     m_Parent->KernelCreated();
 }
@@ -323,6 +362,23 @@ Kernel::~Kernel()
     m_Parent->KernelFreed();
 }
 
+// Whether two values for the same arg would produce the same specialization key
+static bool SameSpecializationArg(CompiledDxil::Configuration::Arg const& a, CompiledDxil::Configuration::Arg const& b)
+{
+    if (auto localA = std::get_if<CompiledDxil::Configuration::Arg::Local>(&a.config))
+    {
+        return localA->size == std::get<CompiledDxil::Configuration::Arg::Local>(b.config).size;
+    }
+    if (auto samplerA = std::get_if<CompiledDxil::Configuration::Arg::Sampler>(&a.config))
+    {
+        auto& samplerB = std::get<CompiledDxil::Configuration::Arg::Sampler>(b.config);
+        return samplerA->normalizedCoords == samplerB.normalizedCoords &&
+            samplerA->linearFiltering == samplerB.linearFiltering &&
+            samplerA->addressingMode == samplerB.addressingMode;
+    }
+    return true;
+}
+
 cl_int Kernel::SetArg(cl_uint arg_index, size_t arg_size, const void* arg_value)
 {
     auto ReportError = m_Parent->GetContext().GetErrorReporter();
@@ -331,6 +387,10 @@ cl_int Kernel::SetArg(cl_uint arg_index, size_t arg_size, const void* arg_value)
         return ReportError("Argument index out of bounds", CL_INVALID_ARG_INDEX);
     }
 
+    // Apps tend to set the same values before every enqueue, which mustn't trigger another speculative build
+    const auto PreviousConfig = m_ArgMetadataToCompiler[arg_index];
+    const bool WasSet = m_ArgsSet[arg_index];
+
     auto& arg_meta = m_Dxil.GetMetadata().args[arg_index];
     auto& arg_info = m_Dxil.GetMetadata().program_kernel_info.args[arg_index];
     switch (arg_info.address_qualifier)
@@ -464,6 +524,11 @@ cl_int Kernel::SetArg(cl_uint arg_index, size_t arg_size, const void* arg_value)
     }
 
     m_ArgsSet[arg_index] = true;
+    if (!std::holds_alternative<std::monostate>(m_ArgMetadataToCompiler[arg_index].config) &&
+        (!WasSet || !SameSpecializationArg(PreviousConfig, m_ArgMetadataToCompiler[arg_index])))
+    {
+        QueueSpeculativeSpecialization();
+    }
     return CL_SUCCESS;
 }
 
@@ -486,6 +551,13 @@ uint16_t const* Kernel::GetLocalDimsHint() const
     return nullptr;
 }
 
+Program::KernelData& Kernel::GetKernelData(D3DDevice& device) const
+{
+    auto iter = std::find_if(m_KernelData.begin(), m_KernelData.end(), [&](auto const& pair) { return pair.first == &device; });
+    assert(iter != m_KernelData.end());
+    return *iter->second;
+}
+
 std::unique_ptr<D3D12TranslationLayer::RootSignature> Kernel::GetRootSignature(ImmCtx &ImmCtx) const
 {
     auto pRS = std::make_unique<D3D12TranslationLayer::RootSignature>(&ImmCtx);
@@ -12,12 +12,21 @@ class Kernel : public CLChildBase<Kernel, Program, cl_kernel>
 private:
     CompiledDxil const& m_Dxil;
     std::string const m_Name;
+    // Zero if the kernel inputs don't fit in root constants, and are bound through a CBV in the view table instead
+    UINT const m_NumKernelInputRootConstants;
     ComPtr<ID3DBlob> m_SerializedRootSignature;
 
+    // Looked up once here, so dispatches don't need to find them by name under the program's lock
+    std::vector<std::pair<D3DDevice*, Program::KernelData*>> const m_KernelData;
+
     std::vector<std::byte> m_KernelArgsCbData;
     std::vector<CompiledDxil::Configuration::Arg> m_ArgMetadataToCompiler;
     std::vector<bool> m_ArgsSet;
 
+    // Indexed by UAV ID. False only when the metadata guarantees the kernel never writes
+    // through that UAV, which lets independent dispatches skip the barrier between them.
+    std::vector<bool> m_UAVWritable;
+
     // These are weak references for the API kernel object, however
     // these will be converted into strong references by an *execution*
     // of that kernel. Releasing an object *while a kernel is enqueued*
@@ -36,6 +45,12 @@ private:
     friend extern CL_API_ENTRY cl_int CL_API_CALL clGetKernelWorkGroupInfo(cl_kernel, cl_device_id, cl_kernel_work_group_info, size_t, void*, size_t*);
 
 public:
+    // The root signature has the view descriptor table, then the work properties as root constants, then the
+    // kernel inputs as root constants if they fit, then the sampler table if there are samplers. Root constants
+    // back a whole constant buffer, so they're counted in 16-byte rows.
+    static constexpr UINT WorkPropertiesRootConstants = ((sizeof(WorkProperties) + 15) & ~15) / sizeof(UINT);
+    static constexpr UINT MaxKernelInputRootConstants = 32;
+
     Kernel(Program& Parent, std::string const& name, CompiledDxil const& Dxil, ProgramBinary::Kernel const& meta);
     Kernel(Kernel const&);
     ~Kernel();
@@ -47,6 +62,12 @@ public:
     uint16_t const* GetLocalDimsHint() const;
     
     std::unique_ptr<D3D12TranslationLayer::RootSignature> GetRootSignature(ImmCtx &ImmCtx) const;
+    Program::KernelData& GetKernelData(D3DDevice& device) const;
+
+    // Starts building the specialization that the first enqueue is most likely to need at background
+    // priority, once every arg that's part of the specialization key has been set. Does nothing if
+    // that specialization is already built or being built.
+    void QueueSpeculativeSpecialization();
 
     const ProgramBinary::Kernel m_Meta;
 };
@@ -7,10 +7,14 @@
 #include "sampler.hpp"
 #include "program.hpp"
 #include "compiler.hpp"
+#include "autotuner.hpp"
 
 #include <wil/resource.h>
 #include <sstream>
 #include <numeric>
+#include <optional>
+#include <chrono>
+#include <algorithm>
 
 #include "ImmediateContext.inl"
 
@@ -18,7 +22,11 @@
 
 extern void SignBlob(void* pBlob, size_t size);
 constexpr uint32_t PrintfBufferSize = 1024 * 1024;
-constexpr uint32_t PrintfBufferInitialData[PrintfBufferSize / sizeof(uint32_t)] = { sizeof(uint32_t) * 2, PrintfBufferSize };
+// The first uint is the offset where the next write goes, right past this header, and the second is the buffer size.
+constexpr uint32_t PrintfBufferHeader[2] = { sizeof(uint32_t) * 2, PrintfBufferSize };
+// Buffers kept around for reuse on each device. More than this are only needed with many printf launches in flight.
+constexpr size_t MaxPooledPrintfBuffers = 8;
+constexpr static D3D12_RANGE EmptyRange = {};
 
 size_t Program::SpecializationKey::AllocatedByteSize(uint32_t NumArgs)
 {
@@ -46,7 +54,9 @@ Program::SpecializationKey::SpecializationKey(D3DDevice const* Device, CompiledD
     ConfigData.Bits.SupportGlobalOffsets = conf.support_global_work_id_offsets;
     ConfigData.Bits.SupportLocalOffsets = conf.support_work_group_id_offsets;
     ConfigData.Bits.LowerInt64 = conf.lower_int64;
-    ConfigData.Bits.LowerInt16 = conf.lower_int64;
+    ConfigData.Bits.LowerInt16 = conf.lower_int16;
+    assert(conf.shader_model <= 0xff);
+    ConfigData.Bits.ShaderModel = conf.shader_model;
     ConfigData.Bits.Padding = 0;
 
     NumArgs = (uint32_t)conf.args.size();
@@ -71,7 +81,7 @@ Program::SpecializationKey::SpecializationKey(D3DDevice const* Device, CompiledD
     }
 }
 
-size_t Program::SpecializationKeyHash::operator()(std::unique_ptr<const SpecializationKey> const& ptr) const
+size_t Program::SpecializationKeyHash::operator()(const SpecializationKey* ptr) const
 {
     size_t val = std::hash<uint64_t>()(ptr->ConfigData.Value);
     D3D12TranslationLayer::hash_combine(val, std::hash<const void *>()(ptr->Device));
@@ -82,29 +92,267 @@ size_t Program::SpecializationKeyHash::operator()(std::unique_ptr<const Speciali
     return val;
 }
 
-bool Program::SpecializationKeyEqual::operator()(std::unique_ptr<const SpecializationKey> const& a,
-                                                 std::unique_ptr<const SpecializationKey> const& b) const
+bool Program::SpecializationKeyEqual::operator()(const SpecializationKey* a, const SpecializationKey* b) const
 {
     assert(a->NumArgs == b->NumArgs);
     size_t size = SpecializationKey::HashByteSize(a->NumArgs);
-    return memcmp(a.get(), b.get(), size) == 0;
+    return memcmp(a, b, size) == 0;
+}
+
+bool Program::SpecializationValue::TryPin() noexcept
+{
+    uint32_t pins = m_Pins.load(std::memory_order_relaxed);
+    do
+    {
+        if (pins & EvictedPin)
+        {
+            return false;
+        }
+    } while (!m_Pins.compare_exchange_weak(pins, pins + 1));
+    m_LastUsed.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    return true;
+}
+
+auto Program::GetKernelData(std::string const& kernelName) const -> std::vector<std::pair<D3DDevice*, KernelData*>>
+{
+    std::lock_guard programLock(m_Lock);
+    std::vector<std::pair<D3DDevice*, KernelData*>> kernels;
+    for (auto& [device, d3dDevice] : m_AssociatedDevices)
+    {
+        auto buildDataIter = m_BuildData.find(device.Get());
+        if (buildDataIter == m_BuildData.end() ||
+            !buildDataIter->second ||
+            buildDataIter->second->m_BuildStatus != CL_BUILD_SUCCESS ||
+            buildDataIter->second->m_BinaryType != CL_PROGRAM_BINARY_TYPE_EXECUTABLE)
+        {
+            continue;
+        }
+        auto kernelIter = buildDataIter->second->m_Kernels.find(kernelName);
+        if (kernelIter != buildDataIter->second->m_Kernels.end())
+        {
+            kernels.emplace_back(d3dDevice, &kernelIter->second);
+        }
+    }
+    return kernels;
 }
 
 auto Program::GetSpecializationData(
-    Device* device, std::string const& kernelName, std::unique_ptr<const SpecializationKey> key) ->
+    KernelData& kernel, std::unique_ptr<const SpecializationKey> key, bool speculative) ->
     SpecializationData
+{
+    auto& buildData = *kernel.m_Owner;
+    auto found = [&](SpecializationValue& value) -> SpecializationData
+    {
+        if (!speculative)
+        {
+            buildData.m_SpecializationHits.fetch_add(1, std::memory_order_relaxed);
+        }
+        return { value.m_Key.get(), &value, false, { buildData.m_Hash[0], buildData.m_Hash[1] } };
+    };
+
+    {
+        auto specializations = std::atomic_load(&kernel.m_Specializations);
+        auto iter = specializations->find(key.get());
+        // Pinning fails if the entry was just evicted, in which case it needs to be recreated
+        if (iter != specializations->end() && iter->second->TryPin())
+        {
+            return found(*iter->second);
+        }
+    }
+
+    std::lock_guard specializationCacheLock(buildData.m_SpecializationCacheLock);
+    auto specializations = std::atomic_load(&kernel.m_Specializations);
+    auto iter = specializations->find(key.get());
+    if (iter != specializations->end() && iter->second->TryPin())
+    {
+        // Someone else added it since the first lookup
+        return found(*iter->second);
+    }
+
+    auto value = std::make_shared<SpecializationValue>();
+    value->m_Key = std::move(key);
+    value->m_Speculative = speculative;
+    value->m_Pins = 1;
+    value->m_LastUsed = std::chrono::steady_clock::now().time_since_epoch().count();
+
+    auto newSpecializations = std::make_shared<SpecializationMap>(*specializations);
+    // Evicted entries are removed from the map with the lock held, so there's nothing to replace
+    bool inserted = newSpecializations->emplace(value->m_Key.get(), value).second;
+    assert(inserted); (void)inserted;
+    std::atomic_store(&kernel.m_Specializations, std::shared_ptr<const SpecializationMap>(std::move(newSpecializations)));
+
+    ++buildData.m_SpecializationEntries;
+    if (!speculative)
+    {
+        ++buildData.m_SpecializationMisses;
+    }
+    return { value->m_Key.get(), value.get(), true, { buildData.m_Hash[0], buildData.m_Hash[1] } };
+}
+
+bool Program::HasSpecialization(KernelData const& kernel, SpecializationKey const& key)
+{
+    auto specializations = std::atomic_load(&kernel.m_Specializations);
+    return specializations->find(&key) != specializations->end();
+}
+
+void Program::PinSpecialization(SpecializationValue* value) noexcept
+{
+    // Only called by someone who already holds a pin, so it can't have been evicted
+    assert(value->m_Pins > 0 && !(value->m_Pins & SpecializationValue::EvictedPin));
+    ++value->m_Pins;
+}
+
+void Program::ReleaseSpecialization(KernelData& kernel, SpecializationValue* value)
+{
+    assert(value->m_Pins > 0);
+    if (--value->m_Pins == 0 &&
+        kernel.m_Owner->m_SpecializationBytes > m_SpecializationCacheBudget)
+    {
+        std::lock_guard specializationCacheLock(kernel.m_Owner->m_SpecializationCacheLock);
+        kernel.m_Owner->TrimSpecializationCache(m_SpecializationCacheBudget);
+    }
+}
+
+void Program::SpecializationBuilt(KernelData& kernel, SpecializationValue* value, size_t byteSize)
+{
+    std::lock_guard specializationCacheLock(kernel.m_Owner->m_SpecializationCacheLock);
+    assert(value->m_Pins > 0 && !value->m_Built);
+    value->m_Built = true;
+    value->m_ByteSize = byteSize;
+    kernel.m_Owner->m_SpecializationBytes += byteSize;
+}
+
+void Program::PerDeviceData::TrimSpecializationCache(size_t budget)
+{
+    if (m_SpecializationBytes <= budget)
+    {
+        return;
+    }
+
+    struct Candidate
+    {
+        int64_t LastUsed;
+        KernelData* Kernel;
+        SpecializationValue* Value;
+    };
+    std::vector<Candidate> candidates;
+    for (auto& [name, kernel] : m_Kernels)
+    {
+        for (auto& [key, value] : *kernel.m_Specializations)
+        {
+            if (value->m_Built && value->m_Pins == 0)
+            {
+                candidates.push_back({ value->m_LastUsed, &kernel, value.get() });
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](Candidate const& a, Candidate const& b) { return a.LastUsed < b.LastUsed; });
+
+    // Each kernel's map is copied at most once, and all of the evictions from it are published together
+    std::unordered_map<KernelData*, std::shared_ptr<SpecializationMap>> newSpecializations;
+    for (auto& candidate : candidates)
+    {
+        if (m_SpecializationBytes <= budget)
+        {
+            break;
+        }
+        // A lookup that doesn't take the lock may have pinned it since it was gathered
+        uint32_t expected = 0;
+        if (!candidate.Value->m_Pins.compare_exchange_strong(expected, SpecializationValue::EvictedPin))
+        {
+            continue;
+        }
+        m_SpecializationBytes -= candidate.Value->m_ByteSize;
+        ++m_SpecializationEvictions;
+        --m_SpecializationEntries;
+
+        auto& specializations = newSpecializations[candidate.Kernel];
+        if (!specializations)
+        {
+            specializations = std::make_shared<SpecializationMap>(*candidate.Kernel->m_Specializations);
+        }
+        specializations->erase(candidate.Value->m_Key.get());
+    }
+    for (auto& [kernel, specializations] : newSpecializations)
+    {
+        std::atomic_store(&kernel->m_Specializations, std::shared_ptr<const SpecializationMap>(std::move(specializations)));
+    }
+}
+
+auto Program::GetSpecializationCacheStats() const -> SpecializationCacheStats
 {
     std::lock_guard programLock(m_Lock);
-    auto buildDataIter = m_BuildData.find(device);
-    assert(buildDataIter != m_BuildData.end());
-    auto& buildData = buildDataIter->second;
-    auto kernelsIter = buildData->m_Kernels.find(kernelName);
-    assert(kernelsIter != buildData->m_Kernels.end());
-    auto& kernel = kernelsIter->second;
-
-    std::lock_guard specializationCacheLock(buildData->m_SpecializationCacheLock);
-    auto [iter, success] = kernel.m_SpecializationCache.try_emplace(std::move(key));
-    return { iter->first.get(), &iter->second, success, { buildData->m_Hash[0], buildData->m_Hash[1] }};
+    SpecializationCacheStats total;
+    for (auto& [device, buildData] : m_BuildData)
+    {
+        if (!buildData)
+            continue;
+        total.Hits += buildData->m_SpecializationHits;
+        total.Misses += buildData->m_SpecializationMisses;
+        total.Evictions += buildData->m_SpecializationEvictions;
+        total.Entries += buildData->m_SpecializationEntries;
+        total.Bytes += buildData->m_SpecializationBytes;
+    }
+    return total;
+}
+
+::ref_ptr<Resource> Program::AcquirePrintfBuffer(KernelData& kernel)
+{
+    auto& owner = *kernel.m_Owner;
+    {
+        std::lock_guard lock(owner.m_PrintfBufferLock);
+        if (!owner.m_PrintfBuffers.empty())
+        {
+            auto buffer = std::move(owner.m_PrintfBuffers.back());
+            owner.m_PrintfBuffers.pop_back();
+            return buffer;
+        }
+    }
+    // No initial data, the header is written on the GPU each time the buffer is used.
+    ::ref_ptr<Resource> buffer;
+    buffer.Attach(static_cast<Resource*>(clCreateBuffer(&GetContext(), CL_MEM_ALLOC_HOST_PTR, PrintfBufferSize, nullptr, nullptr)));
+    if (!buffer.Get())
+    {
+        throw std::bad_alloc();
+    }
+    return buffer;
+}
+
+void Program::ReturnPrintfBuffer(KernelData& kernel, ::ref_ptr<Resource> buffer) noexcept
+{
+    auto& owner = *kernel.m_Owner;
+    std::lock_guard lock(owner.m_PrintfBufferLock);
+    if (owner.m_PrintfBuffers.size() < MaxPooledPrintfBuffers)
+    {
+        try
+        {
+            owner.m_PrintfBuffers.push_back(std::move(buffer));
+        }
+        catch (...) {}
+    }
+}
+
+static_assert(LocalSizeAutotuner::MaxDims[0] == D3D12_CS_THREAD_GROUP_MAX_X &&
+              LocalSizeAutotuner::MaxDims[1] == D3D12_CS_THREAD_GROUP_MAX_Y &&
+              LocalSizeAutotuner::MaxDims[2] == D3D12_CS_THREAD_GROUP_MAX_Z &&
+              LocalSizeAutotuner::MaxThreadsPerGroup == D3D12_CS_THREAD_GROUP_MAX_THREADS_PER_GROUP);
+
+// A launch that's measuring one of the autotuner's candidate local sizes
+struct AutotuneTrial
+{
+    LocalSizeAutotuner::Key Key;
+    uint32_t Candidate;
+};
+
+static LocalSizeAutotuner::Key GetAutotuneKey(Kernel& kernel, D3DDevice& device, std::array<uint32_t, 3> const& globalSize)
+{
+    // Keys are persisted, so identify the device by its hardware rather than anything per-process,
+    // and the kernel by the contents of the program it came from
+    auto& HWIDs = device.GetParent().GetHardwareIds();
+    char Adapter[64];
+    sprintf_s(Adapter, "%04x:%04x:%08x:%02x", HWIDs.vendorID, HWIDs.deviceID, HWIDs.subSysID, HWIDs.revision);
+    return { Adapter, kernel.GetKernelData(device).m_AutotuneName, globalSize };
 }
 
 class ExecuteKernel : public Task
@@ -113,17 +361,24 @@ public:
     Kernel::ref_ptr_int m_Kernel;
     const std::array<uint32_t, 3> m_DispatchDims;
 
-    Resource::UnderlyingResourcePtr m_KernelArgsCb;
     std::vector<std::byte> m_KernelArgsCbData;
     cl_uint m_WorkPropertiesOffset;
     Resource::ref_ptr m_PrintfUAV;
+    // Mapped while recording, and read through on the completion strand, which can't use the immediate context
+    ID3D12Resource* m_PrintfResource12 = nullptr;
+    std::byte* m_PrintfData = nullptr;
 
     std::vector<Resource::ref_ptr_int> m_KernelArgUAVs;
     std::vector<Resource::ref_ptr_int> m_KernelArgSRVs;
     std::vector<Sampler::ref_ptr_int> m_KernelArgSamplers;
     
+    Program::KernelData *m_KernelData = nullptr;
     Program::SpecializationValue *m_Specialized = nullptr;
 
+    std::optional<AutotuneTrial> m_AutotuneTrial;
+    std::unique_ptr<D3D12TranslationLayer::TimestampQuery> m_TrialStart;
+    std::unique_ptr<D3D12TranslationLayer::TimestampQuery> m_TrialStop;
+
     void MigrateResources() final
     {
         for (auto& res : m_KernelArgUAVs)
@@ -138,15 +393,41 @@ public:
         }
     }
     void RecordImpl() final;
+    void OnGPUWorkComplete() final;
     void OnComplete() final;
 
-    ExecuteKernel(Kernel& kernel, cl_command_queue queue, std::array<uint32_t, 3> const& dims, std::array<uint32_t, 3> const& offset, std::array<uint16_t, 3> const& localSize, cl_uint workDims)
+    void ReleaseSpecialization()
+    {
+        if (m_Specialized)
+        {
+            m_Kernel->m_Parent->ReleaseSpecialization(*m_KernelData, m_Specialized);
+            m_Specialized = nullptr;
+        }
+    }
+    void UnmapPrintfBuffer() noexcept
+    {
+        if (m_PrintfResource12)
+        {
+            m_PrintfResource12->Unmap(0, &EmptyRange);
+            m_PrintfResource12 = nullptr;
+            m_PrintfData = nullptr;
+        }
+    }
+    ~ExecuteKernel()
+    {
+        UnmapPrintfBuffer();
+        ReleaseSpecialization();
+    }
+
+    ExecuteKernel(Kernel& kernel, cl_command_queue queue, std::array<uint32_t, 3> const& dims, std::array<uint32_t, 3> const& offset, std::array<uint16_t, 3> const& localSize, cl_uint workDims,
+                  std::optional<AutotuneTrial> autotuneTrial)
         : Task(kernel.m_Parent->GetContext(), CL_COMMAND_NDRANGE_KERNEL, queue)
         , m_Kernel(&kernel)
         , m_DispatchDims(dims)
         , m_KernelArgUAVs(kernel.m_UAVs.begin(), kernel.m_UAVs.end())
         , m_KernelArgSRVs(kernel.m_SRVs.begin(), kernel.m_SRVs.end())
         , m_KernelArgSamplers(kernel.m_Samplers.begin(), kernel.m_Samplers.end())
+        , m_AutotuneTrial(std::move(autotuneTrial))
     {
         cl_uint KernelArgCBIndex = kernel.m_Dxil.GetMetadata().kernel_inputs_cbv_id;
         cl_uint WorkPropertiesCBIndex = kernel.m_Dxil.GetMetadata().work_properties_cbv_id;
@@ -192,177 +473,407 @@ public:
             }
         }
 
+        assert(m_KernelArgsCbData.size() % D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT == 0);
         auto& Device = m_CommandQueue->GetD3DDevice();
 
-        D3D12TranslationLayer::ResourceCreationArgs Args = {};
-        Args.m_appDesc.m_Subresources = 1;
-        Args.m_appDesc.m_SubresourcesPerPlane = 1;
-        Args.m_appDesc.m_NonOpaquePlaneCount = 1;
-        Args.m_appDesc.m_MipLevels = 1;
-        Args.m_appDesc.m_ArraySize = 1;
-        Args.m_appDesc.m_Depth = 1;
-        Args.m_appDesc.m_Width = (UINT)m_KernelArgsCbData.size();
-        Args.m_appDesc.m_Height = 1;
-        Args.m_appDesc.m_Format = DXGI_FORMAT_UNKNOWN;
-        Args.m_appDesc.m_Samples = 1;
-        Args.m_appDesc.m_Quality = 0;
-        Args.m_appDesc.m_resourceDimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-        Args.m_appDesc.m_usage = D3D12TranslationLayer::RESOURCE_USAGE_DYNAMIC;
-        Args.m_appDesc.m_bindFlags = D3D12TranslationLayer::RESOURCE_BIND_CONSTANT_BUFFER;
-        Args.m_appDesc.m_cpuAcess = D3D12TranslationLayer::RESOURCE_CPU_ACCESS_WRITE;
-        Args.m_desc12 = CD3DX12_RESOURCE_DESC::Buffer(Args.m_appDesc.m_Width);
-        Args.m_heapDesc = CD3DX12_HEAP_DESC(Args.m_appDesc.m_Width, D3D12_HEAP_TYPE_UPLOAD);
-        Args.m_heapType = D3D12TranslationLayer::AllocatorHeapType::Upload;
-        assert(Args.m_appDesc.m_Width % D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT == 0);
-
-        m_KernelArgsCb =
-            D3D12TranslationLayer::Resource::CreateResource(
-                &Device.ImmCtx(),
-                Args,
-                D3D12TranslationLayer::ResourceAllocationContext::FreeThread);
-
+        m_KernelData = &kernel.GetKernelData(Device);
         if (kernel.m_Dxil.GetMetadata().printf_uav_id >= 0)
         {
-            m_PrintfUAV.Attach(static_cast<Resource*>(clCreateBuffer(&m_Parent.get(), CL_MEM_ALLOC_HOST_PTR | CL_MEM_COPY_HOST_PTR, PrintfBufferSize, (void*)PrintfBufferInitialData, nullptr)));
-            m_PrintfUAV->EnqueueMigrateResource(&m_CommandQueue->GetD3DDevice(), this, 0);
+            m_PrintfUAV = kernel.m_Parent->AcquirePrintfBuffer(*m_KernelData);
+            // Nothing needs to be uploaded, the header gets reset when this is recorded
+            m_PrintfUAV->EnqueueMigrateResource(&Device, this, CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED);
         }
 
-        CompiledDxil::Configuration config = {};
-        config.lower_int64 = true;
-        config.lower_int16 = !m_Device->SupportsInt16();
-        config.shader_model = Device.GetParent().GetShaderModel();
-        config.support_global_work_id_offsets = std::any_of(std::begin(offset), std::end(offset), [](cl_uint v) { return v != 0; });
-        config.support_work_group_id_offsets = numIterations != 1;
-        std::copy(std::begin(localSize), std::end(localSize), config.local_size);
-        config.args = kernel.m_ArgMetadataToCompiler;
-        auto SpecKey = Program::SpecializationKey::Allocate(m_D3DDevice, config);
-        
-        auto SpecializationData = kernel.m_Parent->GetSpecializationData(m_Device.Get(), kernel.m_Name, std::move(SpecKey));
-        m_Specialized = SpecializationData.Value;
+        auto config = GetSpecializationConfig(kernel, Device, localSize,
+            std::any_of(std::begin(offset), std::end(offset), [](cl_uint v) { return v != 0; }),
+            numIterations != 1);
+        // Recording this command waits for it
+        m_Specialized = RequestSpecialization(kernel, Device, std::move(config), BackgroundTaskScheduler::TaskPriority::Critical);
+    }
+
+    static CompiledDxil::Configuration GetSpecializationConfig(Kernel& kernel, D3DDevice& device, std::array<uint16_t, 3> const& localSize,
+                                                               bool globalWorkIdOffsets, bool workGroupIdOffsets);
+    // Finds or creates the cache entry for this specialization, queueing its creation if it's new.
+    // A critical request for an entry whose speculative creation hasn't started yet queues it again
+    // at critical priority, so it doesn't wait behind other background work.
+    static Program::SpecializationValue* RequestSpecialization(Kernel& kernel, D3DDevice& device, CompiledDxil::Configuration config,
+                                                               BackgroundTaskScheduler::TaskPriority priority, bool speculative = false);
+
+private:
+    static void CreateSpecialization(Kernel::ref_ptr_int kernel, Program::KernelData& kernelData, D3DDevice& Device,
+                                     CompiledDxil::Configuration const& config, Program::SpecializationData SpecializationData);
+};
+
+CompiledDxil::Configuration ExecuteKernel::GetSpecializationConfig(Kernel& kernel, D3DDevice& device, std::array<uint16_t, 3> const& localSize,
+                                                                   bool globalWorkIdOffsets, bool workGroupIdOffsets)
+{
+    CompiledDxil::Configuration config = {};
+    config.lower_int64 = true;
+    config.lower_int16 = !device.GetParent().SupportsInt16();
+    config.shader_model = device.GetParent().GetShaderModel();
+    config.support_global_work_id_offsets = globalWorkIdOffsets;
+    config.support_work_group_id_offsets = workGroupIdOffsets;
+    std::copy(std::begin(localSize), std::end(localSize), config.local_size);
+    config.args = kernel.m_ArgMetadataToCompiler;
+    return config;
+}
+
+Program::SpecializationValue* ExecuteKernel::RequestSpecialization(Kernel& kernel, D3DDevice& device, CompiledDxil::Configuration config,
+                                                                   BackgroundTaskScheduler::TaskPriority priority, bool speculative)
+{
+    auto& kernelData = kernel.GetKernelData(device);
+    auto SpecKey = Program::SpecializationKey::Allocate(&device, config);
+    auto SpecializationData = kernel.m_Parent->GetSpecializationData(kernelData, std::move(SpecKey), speculative);
 
-        if (SpecializationData.NeedToCreate)
+    bool Queue = SpecializationData.NeedToCreate;
+    if (!Queue && priority == BackgroundTaskScheduler::TaskPriority::Critical &&
+        !SpecializationData.Value->m_Ready.load(std::memory_order_acquire))
+    {
+        auto lock = kernel.m_Parent->GetSpecializationUpdateLock();
+        auto& Value = *SpecializationData.Value;
+        if (Value.m_Speculative && !Value.m_Started && !Value.m_PSO && !Value.m_Error)
         {
-            g_Platform->QueueProgramOp([this, &Device,
-                                              config = std::move(config),
-                                              kernel = this->m_Kernel,
-                                              refThis = Task::ref_int(*this),
-                                              SpecializationData]() mutable
+            Value.m_Speculative = false;
+            Queue = true;
+        }
+    }
+
+    if (Queue)
+    {
+        // The job holds its own pin, released once it's done
+        Program::PinSpecialization(SpecializationData.Value);
+        g_Platform->QueueProgramOp([&device,
+                                    &kernelData,
+                                    config = std::move(config),
+                                    kernel = Kernel::ref_ptr_int(&kernel),
+                                    SpecializationData]() mutable
+        {
+            CreateSpecialization(std::move(kernel), kernelData, device, config, SpecializationData);
+        }, priority);
+    }
+    return SpecializationData.Value;
+}
+
+void ExecuteKernel::CreateSpecialization(Kernel::ref_ptr_int kernel, Program::KernelData& kernelData, D3DDevice& Device,
+                                         CompiledDxil::Configuration const& config, Program::SpecializationData SpecializationData)
+{
+    auto pSpecialized = SpecializationData.Value;
+    auto Unpin = wil::scope_exit([&]()
+    {
+        kernel->m_Parent->ReleaseSpecialization(kernelData, pSpecialized);
+    });
+    {
+        // Another job for the same entry may have already picked it up
+        auto lock = kernel->m_Parent->GetSpecializationUpdateLock();
+        if (pSpecialized->m_Started || pSpecialized->m_PSO || pSpecialized->m_Error)
+        {
+            return;
+        }
+        pSpecialized->m_Started = true;
+    }
+
+    try
+    {
+        auto pCompiler = g_Platform->GetCompiler();
+        unique_dxil specialized;
+        auto spirv = kernel->m_Parent->GetSpirV(&Device.GetParent());
+
+        auto &Cache = Device.GetShaderCache();
+        
+        SpookyHash hasher;
+        hasher.Init(SpecializationData.ProgramHash[0], SpecializationData.ProgramHash[1]);
+        hasher.Update(kernel->m_Name.c_str(), kernel->m_Name.size());
+        hasher.Update(&SpecializationData.KeyInMap->ConfigData,
+                      SpecializationData.KeyInMap->HashByteSize(SpecializationData.KeyInMap->NumArgs) -
+                        offsetof(Program::SpecializationKey, ConfigData));
+        uint64_t finalHash[2];
+        hasher.Final(&finalHash[0], &finalHash[1]);
+
+        auto found = Cache.Find(finalHash, sizeof(finalHash));
+        if (found.first)
+        {
+            // Adjust the metadata to match this specialization. Everything matches except the offsets
+            // to use for local args. The CL compiler treats unspecialized args as consuming 4 bytes.
+            // We don't have the metadata for how much local memory is embedded in the kernel definition,
+            // so the first local arg's offset tells us that.
+            auto metadata = kernel->m_Dxil.GetMetadata(); // copy
+            uint32_t offset = 0;
+            uint32_t last_size = 0;
+            for (uint32_t i = 0; i < metadata.args.size(); ++i)
             {
-                try
+                if (auto local = std::get_if<CompiledDxil::Metadata::Arg::Local>(&metadata.args[i].properties))
                 {
-                    auto pCompiler = g_Platform->GetCompiler();
-                    unique_dxil specialized;
-                    auto spirv = kernel->m_Parent->GetSpirV(&m_CommandQueue->GetDevice());
-
-                    auto &Cache = m_D3DDevice->GetShaderCache();
-                    
-                    SpookyHash hasher;
-                    hasher.Init(SpecializationData.ProgramHash[0], SpecializationData.ProgramHash[1]);
-                    hasher.Update(kernel->m_Name.c_str(), kernel->m_Name.size());
-                    hasher.Update(&SpecializationData.KeyInMap->ConfigData,
-                                  SpecializationData.KeyInMap->HashByteSize(SpecializationData.KeyInMap->NumArgs) -
-                                    offsetof(Program::SpecializationKey, ConfigData));
-                    uint64_t finalHash[2];
-                    hasher.Final(&finalHash[0], &finalHash[1]);
-
-                    auto found = Cache.Find(finalHash, sizeof(finalHash));
-                    if (found.first)
-                    {
-                        // Adjust the metadata to match this specialization. Everything matches except the offsets
-                        // to use for local args. The CL compiler treats unspecialized args as consuming 4 bytes.
-                        // We don't have the metadata for how much local memory is embedded in the kernel definition,
-                        // so the first local arg's offset tells us that.
-                        auto metadata = kernel->m_Dxil.GetMetadata(); // copy
-                        uint32_t offset = 0;
-                        uint32_t last_size = 0;
-                        for (uint32_t i = 0; i < metadata.args.size(); ++i)
+                    if (last_size)
+                        local->sharedmem_offset = offset + last_size;
+                    offset = local->sharedmem_offset;
+                    last_size = std::get<CompiledDxil::Configuration::Arg::Local>(config.args[i].config).size;
+                    // Match the logic in the compiler, which aligns these sizes based on the types it could contain,
+                    // up to long16 which has a 128 byte alignment.
+                    auto findFirstSet = [](uint32_t i)
                         {
-                            if (auto local = std::get_if<CompiledDxil::Metadata::Arg::Local>(&metadata.args[i].properties))
-                            {
-                                if (last_size)
-                                    local->sharedmem_offset = offset + last_size;
-                                offset = local->sharedmem_offset;
-                                last_size = std::get<CompiledDxil::Configuration::Arg::Local>(config.args[i].config).size;
-                                // Match the logic in the compiler, which aligns these sizes based on the types it could contain,
-                                // up to long16 which has a 128 byte alignment.
-                                auto findFirstSet = [](uint32_t i)
-                                    {
-                                        unsigned long index;
-                                        if (_BitScanForward(&index, i))
-                                            return index + 1;
-                                        else
-                                            return 0ul;
-                                    };
-                                uint32_t align = last_size < 128 ? (1 << (findFirstSet(last_size) - 1)) : 128;
-                                last_size = D3D12TranslationLayer::Align(last_size, align);
-                            }
-                        }
-                        specialized = pCompiler->LoadKernel(*spirv, found.first.get(), found.second, metadata);
-                    }
-                    else
-                    {
-                        auto name = kernel->m_Dxil.GetMetadata().program_kernel_info.name;
-                        specialized = pCompiler->GetKernel(name, *spirv, &config, nullptr);
-                        specialized->Sign();
+                            unsigned long index;
+                            if (_BitScanForward(&index, i))
+                                return index + 1;
+                            else
+                                return 0ul;
+                        };
+                    uint32_t align = last_size < 128 ? (1 << (findFirstSet(last_size) - 1)) : 128;
+                    last_size = D3D12TranslationLayer::Align(last_size, align);
+                }
+            }
+            specialized = pCompiler->LoadKernel(*spirv, found.first.get(), found.second, metadata);
+        }
+        else
+        {
+            auto name = kernel->m_Dxil.GetMetadata().program_kernel_info.name;
+            specialized = pCompiler->GetKernel(name, *spirv, &config, nullptr);
+            specialized->Sign();
 
-                        Cache.Store(finalHash, sizeof(finalHash), specialized->GetBinary(), specialized->GetBinarySize());
-                    }
+            Cache.Store(finalHash, sizeof(finalHash), specialized->GetBinary(), specialized->GetBinarySize());
+        }
 
-                    auto RS = kernel->GetRootSignature(Device.ImmCtx());
+        auto RS = kernel->GetRootSignature(Device.ImmCtx());
 
-                    auto &DriverCache = m_D3DDevice->GetDriverShaderCache();
-                    auto CachedBlob = DriverCache.Find(finalHash, sizeof(finalHash));
-                    D3D12_CACHED_PIPELINE_STATE CachedDesc = {};
-                    if (CachedBlob.first)
-                    {
-                        CachedDesc = { CachedBlob.first.get(), CachedBlob.second };
-                    }
+        // Cached PSOs are only valid with the root signature they were created with
+        uint64_t psoHash[2] = { finalHash[0], finalHash[1] };
+        SpookyHash::Hash128(kernel->m_SerializedRootSignature->GetBufferPointer(),
+                            kernel->m_SerializedRootSignature->GetBufferSize(), &psoHash[0], &psoHash[1]);
 
-                    std::unique_ptr< D3D12TranslationLayer::PipelineState> PSO;
-                    try
-                    {
-                        PSO = std::make_unique<D3D12TranslationLayer::PipelineState>(
-                            &Device.ImmCtx(), D3D12_SHADER_BYTECODE{ specialized->GetBinary(), specialized->GetBinarySize() }, RS.get(), CachedDesc);
-                    }
-                    catch (_com_error &hrEx)
-                    {
-                        if (hrEx.Error() != D3D12_ERROR_DRIVER_VERSION_MISMATCH && hrEx.Error() != D3D12_ERROR_ADAPTER_NOT_FOUND)
-                        {
-                            throw;
-                        }
-                        m_D3DDevice->GetDriverShaderCache().Clear();
-                        CachedDesc = {};
-                        PSO = std::make_unique<D3D12TranslationLayer::PipelineState>(
-                            &Device.ImmCtx(), D3D12_SHADER_BYTECODE{ specialized->GetBinary(), specialized->GetBinarySize() }, RS.get(), CachedDesc);
-                    }
+        auto &DriverCache = Device.GetDriverShaderCache();
+        auto CachedBlob = DriverCache.Find(psoHash, sizeof(psoHash));
+        D3D12_CACHED_PIPELINE_STATE CachedDesc = {};
+        if (CachedBlob.first)
+        {
+            CachedDesc = { CachedBlob.first.get(), CachedBlob.second };
+        }
 
-                    if (!CachedBlob.first)
-                    {
-                        D3D12TranslationLayer::unique_comptr<ID3DBlob> blob;
-                        if (SUCCEEDED(PSO->GetForImmediateUse()->GetCachedBlob(&blob)))
-                        {
-                            DriverCache.Store(finalHash, sizeof(finalHash), blob->GetBufferPointer(), blob->GetBufferSize());
-                        }
-                    }
+        std::unique_ptr< D3D12TranslationLayer::PipelineState> PSO;
+        try
+        {
+            PSO = std::make_unique<D3D12TranslationLayer::PipelineState>(
+                &Device.ImmCtx(), D3D12_SHADER_BYTECODE{ specialized->GetBinary(), specialized->GetBinarySize() }, RS.get(), CachedDesc);
+        }
+        catch (_com_error &hrEx)
+        {
+            if (hrEx.Error() != D3D12_ERROR_DRIVER_VERSION_MISMATCH && hrEx.Error() != D3D12_ERROR_ADAPTER_NOT_FOUND)
+            {
+                throw;
+            }
+            // Bundles aren't searched for PSOs, so the blob came from this machine's own cache,
+            // which was written by a different driver or adapter
+            Device.GetDriverShaderCache().Clear();
+            CachedDesc = {};
+            PSO = std::make_unique<D3D12TranslationLayer::PipelineState>(
+                &Device.ImmCtx(), D3D12_SHADER_BYTECODE{ specialized->GetBinary(), specialized->GetBinarySize() }, RS.get(), CachedDesc);
+        }
 
-                    {
-                        auto lock = kernel->m_Parent->GetSpecializationUpdateLock();
-                        *m_Specialized = Program::SpecializationValue(std::move(specialized), std::move(RS), std::move(PSO));
-                    }
-                    kernel->m_Parent->SpecializationComplete();
+        if (!CachedBlob.first)
+        {
+            D3D12TranslationLayer::unique_comptr<ID3DBlob> blob;
+            if (SUCCEEDED(PSO->GetForImmediateUse()->GetCachedBlob(&blob)))
+            {
+                DriverCache.Store(psoHash, sizeof(psoHash), blob->GetBufferPointer(), blob->GetBufferSize());
+            }
+        }
+
+        {
+            auto lock = kernel->m_Parent->GetSpecializationUpdateLock();
+            pSpecialized->m_Dxil = std::move(specialized);
+            pSpecialized->m_RS = std::move(RS);
+            pSpecialized->m_PSO = std::move(PSO);
+            pSpecialized->m_Ready.store(true, std::memory_order_release);
+        }
+        // The PSO's size isn't known, so estimate it as the same as the DXIL it was built from
+        kernel->m_Parent->SpecializationBuilt(kernelData, pSpecialized,
+            Program::SpecializationKey::AllocatedByteSize(SpecializationData.KeyInMap->NumArgs) + 2 * pSpecialized->m_Dxil->GetBinarySize());
+        kernel->m_Parent->SpecializationComplete();
+    }
+    catch (...)
+    {
+        {
+            auto lock = kernel->m_Parent->GetSpecializationUpdateLock();
+            pSpecialized->m_Error = true;
+            pSpecialized->m_Ready.store(true, std::memory_order_release);
+        }
+        kernel->m_Parent->SpecializationBuilt(kernelData, pSpecialized,
+            Program::SpecializationKey::AllocatedByteSize(SpecializationData.KeyInMap->NumArgs));
+        kernel->m_Parent->SpecializationComplete();
+    }
+}
+
+// Picks a local size for a dispatch that leaves it up to the implementation. DispatchDimensions
+// starts out as the global size and LocalSizes as all 1s, and on return the two multiply to it.
+static void ChooseLocalSize(std::array<uint32_t, 3>& DispatchDimensions, std::array<uint16_t, 3>& LocalSizes,
+                            cl_uint work_dim, std::pair<cl_uint, cl_uint> WaveSizes)
+{
+    const std::array<uint16_t, 3> MaxDims =
+    {
+        D3D12_CS_THREAD_GROUP_MAX_X,
+        D3D12_CS_THREAD_GROUP_MAX_Y,
+        D3D12_CS_THREAD_GROUP_MAX_Z
+    };
+
+    // Try to partition this thread count into groups that fall between the min and max wave size.
+    // Don't overshoot the max wave size, since threads in a group need to be scheduled together,
+    // which can limit how many groups can run in parallel.
+    cl_uint ThreadsInGroup = 1;
+    // No device has a wave size > 128
+    static constexpr uint16_t Primes[] =
+    { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43,
+      47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97, 101,
+      107, 109, 113, 127 };
+    const uint16_t *FactorizationProgress[3] = { Primes, Primes, Primes };
+
+    bool Progress;
+    do
+    {
+        Progress = false;
+        for (cl_uint dimension = 0; dimension < work_dim; ++dimension)
+        {
+            // Find the next factor that divides the dispatch size, for this dimension
+            while (FactorizationProgress[dimension] != std::end(Primes))
+            {
+                uint16_t Factor = *FactorizationProgress[dimension];
+                if (DispatchDimensions[dimension] < Factor ||
+                    // Allow thread group size to increase past the max only if we're already at the minimum 
+                    // and it will help to decrease how many dispatches we need to loop
+                    (ThreadsInGroup * Factor > WaveSizes.second &&
+                     ThreadsInGroup < WaveSizes.first &&
+                     DispatchDimensions[dimension] <= D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION) ||
+                    // Unless it would cause us to exceed the max thread group size
+                    ThreadsInGroup * Factor > D3D12_CS_THREAD_GROUP_MAX_THREADS_PER_GROUP ||
+                    LocalSizes[dimension] * Factor > MaxDims[dimension])
+                {
+                    // No more factors in the list will ever match, this dimension is done
+                    FactorizationProgress[dimension] = std::end(Primes);
+                    break;
                 }
-                catch (...)
+                if (DispatchDimensions[dimension] % Factor == 0)
                 {
-                    {
-                        auto lock = kernel->m_Parent->GetSpecializationUpdateLock();
-                        m_Specialized->m_Error = true;
-                    }
-                    kernel->m_Parent->SpecializationComplete();
+                    // Match
+                    break;
                 }
-            });
+                ++FactorizationProgress[dimension];
+            }
+            // This dimension is done
+            if (FactorizationProgress[dimension] == std::end(Primes))
+            {
+                continue;
+            }
+
+            // Expand the local size
+            uint16_t Factor = *FactorizationProgress[dimension];
+            LocalSizes[dimension] *= Factor;
+            ThreadsInGroup *= Factor;
+            DispatchDimensions[dimension] /= Factor;
+            Progress = true;
+
+            // Stop if we hit the minimum wave size exactly, or once we exceed the min/max size
+            if ((ThreadsInGroup == WaveSizes.first || ThreadsInGroup > WaveSizes.second) &&
+                DispatchDimensions[dimension] <= D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION)
+            {
+                Progress = false;
+                break;
+            }
+        }
+    } while (Progress);
+
+    // If we're not going to launch even a single full wave, and the dispatch size for a dimension
+    // can be used as a group size, then do so.
+    // This means remaining dispatch dimensions are a prime number > 128 in all dimensions.
+    for (cl_uint dimension = 0; dimension < work_dim && ThreadsInGroup < WaveSizes.first; ++dimension)
+    {
+        if (DispatchDimensions[dimension] > 1 &&
+            DispatchDimensions[dimension] <= D3D12_CS_THREAD_GROUP_MAX_THREADS_PER_GROUP &&
+            (cl_uint)DispatchDimensions[dimension] * ThreadsInGroup <= D3D12_CS_THREAD_GROUP_MAX_THREADS_PER_GROUP)
+        {
+            LocalSizes[dimension] *= (uint16_t)DispatchDimensions[dimension];
+            ThreadsInGroup *= DispatchDimensions[dimension];
+            DispatchDimensions[dimension] = 1;
         }
     }
-};
+}
+
+static bool IsSpeculativeSpecializationEnabled()
+{
+    char *disableStr = nullptr;
+    bool disable = _dupenv_s(&disableStr, nullptr, "CLON12_DISABLE_SPECULATIVE_SPECIALIZATION") == 0 &&
+        disableStr &&
+        strcmp(disableStr, "1") == 0;
+    free(disableStr);
+    return !disable;
+}
+
+// Used when precompiling, so that once a kernel has been created its likely specialization is in the caches
+static bool IsSpeculativeSpecializationSynchronous()
+{
+    char *syncStr = nullptr;
+    bool sync = _dupenv_s(&syncStr, nullptr, "CLON12_SYNCHRONOUS_SPECULATIVE_SPECIALIZATION") == 0 &&
+        syncStr &&
+        strcmp(syncStr, "1") == 0;
+    free(syncStr);
+    return sync;
+}
+
+void Kernel::QueueSpeculativeSpecialization()
+{
+    static const bool s_Enabled = IsSpeculativeSpecializationEnabled();
+    static const bool s_Synchronous = IsSpeculativeSpecializationSynchronous();
+    if (!s_Enabled)
+    {
+        return;
+    }
+
+    // Local and sampler args are part of the specialization key, so wait until they're known
+    for (cl_uint i = 0; i < m_ArgMetadataToCompiler.size(); ++i)
+    {
+        if (!m_ArgsSet[i] && !std::holds_alternative<std::monostate>(m_ArgMetadataToCompiler[i].config))
+        {
+            return;
+        }
+    }
+
+    // This is only a guess, so it must never fail the API call that triggered it
+    try
+    {
+        for (auto& [d3dDevice, kernelData] : m_KernelData)
+        {
+            // Predict the most common enqueue: the required size if there is one, or else what the
+            // heuristic picks for a large power-of-two 1D global size, without any offsets
+            std::array<uint16_t, 3> LocalSizes = { 1, 1, 1 };
+            if (auto RequiredDims = GetRequiredLocalDims())
+            {
+                std::copy(RequiredDims, RequiredDims + 3, LocalSizes.begin());
+            }
+            else
+            {
+                std::array<uint32_t, 3> DispatchDimensions = { 1u << 20, 1, 1 };
+                ChooseLocalSize(DispatchDimensions, LocalSizes, 1, d3dDevice->GetParent().GetWaveSizes());
+            }
+            auto config = ExecuteKernel::GetSpecializationConfig(*this, *d3dDevice, LocalSizes, false, false);
+            // Whoever created an existing entry is building it, or has already, so leave it alone
+            // rather than pinning it, which would also make it look recently used
+            if (Program::HasSpecialization(*kernelData, *Program::SpecializationKey::Allocate(d3dDevice, config)))
+            {
+                continue;
+            }
+            auto Value = ExecuteKernel::RequestSpecialization(*this, *d3dDevice, std::move(config),
+                                                              s_Synchronous ? BackgroundTaskScheduler::TaskPriority::Critical :
+                                                                              BackgroundTaskScheduler::TaskPriority::Background,
+                                                              !s_Synchronous);
+            if (s_Synchronous)
+            {
+                auto lock = m_Parent->GetSpecializationUpdateLock();
+                while (!Value->m_PSO && !Value->m_Error)
+                {
+                    m_Parent->WaitForSpecialization(lock);
+                }
+            }
+            m_Parent->ReleaseSpecialization(*kernelData, Value);
+        }
+    }
+    catch (...) {}
+}
 
 extern CL_API_ENTRY cl_int CL_API_CALL
 clEnqueueNDRangeKernel(cl_command_queue command_queue,
@@ -464,6 +975,7 @@ clEnqueueNDRangeKernel(cl_command_queue command_queue,
         DispatchDimensions[i] = (uint32_t)(global_work_size[i] / LocalSizes[i]);
     }
 
+    std::optional<AutotuneTrial> AutotuneTrialForTask;
     if (RequiredDims || local_work_size)
     {
         if ((uint64_t)LocalSizes[0] * (uint64_t)LocalSizes[1] * (uint64_t)LocalSizes[2] > D3D12_CS_THREAD_GROUP_MAX_THREADS_PER_GROUP)
@@ -473,85 +985,33 @@ clEnqueueNDRangeKernel(cl_command_queue command_queue,
     }
     else
     {
-        // Try to partition this thread count into groups that fall between the min and max wave size.
-        // Don't overshoot the max wave size, since threads in a group need to be scheduled together,
-        // which can limit how many groups can run in parallel.
-        std::pair<cl_uint, cl_uint> WaveSizes = queue.GetDevice().GetWaveSizes();
-        cl_uint ThreadsInGroup = 1;
-        // No device has a wave size > 128
-        static constexpr uint16_t Primes[] =
-        { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43,
-          47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97, 101,
-          107, 109, 113, 127 };
-        const uint16_t *FactorizationProgress[3] = { Primes, Primes, Primes };
-
-        bool Progress;
-        do
+        ChooseLocalSize(DispatchDimensions, LocalSizes, work_dim, queue.GetDevice().GetWaveSizes());
+
+        auto pAutotuner = g_Platform->GetLocalSizeAutotuner();
+        bool CanAutotune = pAutotuner != nullptr;
+        std::array<uint32_t, 3> GlobalSize = { 1, 1, 1 };
+        for (cl_uint i = 0; i < work_dim; ++i)
+        {
+            CanAutotune = CanAutotune && global_work_size[i] != 0 && global_work_size[i] <= std::numeric_limits<uint32_t>::max();
+            GlobalSize[i] = (uint32_t)global_work_size[i];
+        }
+        if (CanAutotune)
         {
-            Progress = false;
-            for (cl_uint dimension = 0; dimension < work_dim; ++dimension)
+            try
             {
-                // Find the next factor that divides the dispatch size, for this dimension
-                while (FactorizationProgress[dimension] != std::end(Primes))
+                auto Key = GetAutotuneKey(kernel, queue.GetD3DDevice(), GlobalSize);
+                auto Selection = pAutotuner->Select(Key, LocalSizes, work_dim);
+                LocalSizes = Selection.Size;
+                for (cl_uint i = 0; i < work_dim; ++i)
                 {
-                    uint16_t Factor = *FactorizationProgress[dimension];
-                    if (DispatchDimensions[dimension] < Factor ||
-                        // Allow thread group size to increase past the max only if we're already at the minimum 
-                        // and it will help to decrease how many dispatches we need to loop
-                        (ThreadsInGroup * Factor > WaveSizes.second &&
-                         ThreadsInGroup < WaveSizes.first &&
-                         DispatchDimensions[dimension] <= D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION) ||
-                        // Unless it would cause us to exceed the max thread group size
-                        ThreadsInGroup * Factor > D3D12_CS_THREAD_GROUP_MAX_THREADS_PER_GROUP ||
-                        LocalSizes[dimension] * Factor > MaxDims[dimension])
-                    {
-                        // No more factors in the list will ever match, this dimension is done
-                        FactorizationProgress[dimension] = std::end(Primes);
-                        break;
-                    }
-                    if (DispatchDimensions[dimension] % Factor == 0)
-                    {
-                        // Match
-                        break;
-                    }
-                    ++FactorizationProgress[dimension];
-                }
-                // This dimension is done
-                if (FactorizationProgress[dimension] == std::end(Primes))
-                {
-                    continue;
+                    DispatchDimensions[i] = GlobalSize[i] / LocalSizes[i];
                 }
-
-                // Expand the local size
-                uint16_t Factor = *FactorizationProgress[dimension];
-                LocalSizes[dimension] *= Factor;
-                ThreadsInGroup *= Factor;
-                DispatchDimensions[dimension] /= Factor;
-                Progress = true;
-
-                // Stop if we hit the minimum wave size exactly, or once we exceed the min/max size
-                if ((ThreadsInGroup == WaveSizes.first || ThreadsInGroup > WaveSizes.second) &&
-                    DispatchDimensions[dimension] <= D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION)
+                if (Selection.Candidate)
                 {
-                    Progress = false;
-                    break;
+                    AutotuneTrialForTask.emplace(AutotuneTrial{ std::move(Key), *Selection.Candidate });
                 }
             }
-        } while (Progress);
-
-        // If we're not going to launch even a single full wave, and the dispatch size for a dimension
-        // can be used as a group size, then do so.
-        // This means remaining dispatch dimensions are a prime number > 128 in all dimensions.
-        for (cl_uint dimension = 0; dimension < work_dim && ThreadsInGroup < WaveSizes.first; ++dimension)
-        {
-            if (DispatchDimensions[dimension] > 1 &&
-                DispatchDimensions[dimension] <= D3D12_CS_THREAD_GROUP_MAX_THREADS_PER_GROUP &&
-                (cl_uint)DispatchDimensions[dimension] * ThreadsInGroup <= D3D12_CS_THREAD_GROUP_MAX_THREADS_PER_GROUP)
-            {
-                LocalSizes[dimension] *= (uint16_t)DispatchDimensions[dimension];
-                ThreadsInGroup *= DispatchDimensions[dimension];
-                DispatchDimensions[dimension] = 1;
-            }
+            catch (std::bad_alloc&) { return ReportError(nullptr, CL_OUT_OF_HOST_MEMORY); }
         }
     }
 
@@ -560,10 +1020,10 @@ clEnqueueNDRangeKernel(cl_command_queue command_queue,
     try
     {
         std::unique_ptr<Task> task(IsEmptyDispatch ?
-            (Task*)(new DummyTask(context, CL_COMMAND_NDRANGE_KERNEL, command_queue)) :
-            (Task*)(new ExecuteKernel(kernel, command_queue, DispatchDimensions, GlobalWorkItemOffsets, LocalSizes, work_dim)));
+            (Task*)(new (context) DummyTask(context, CL_COMMAND_NDRANGE_KERNEL, command_queue)) :
+            (Task*)(new (context) ExecuteKernel(kernel, command_queue, DispatchDimensions, GlobalWorkItemOffsets, LocalSizes, work_dim, std::move(AutotuneTrialForTask))));
 
-        auto Lock = g_Platform->GetTaskPoolLock();
+        auto Lock = context.GetTaskPoolLock();
         task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
         queue.QueueTask(task.get(), Lock);
 
@@ -623,6 +1083,10 @@ constexpr UINT c_NumConstants[D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT]
 
 void ExecuteKernel::RecordImpl()
 {
+    // Nothing needs the specialization after recording. If it gets evicted while the GPU is still
+    // using it, its PSO and root signature go through the deferred deletion queue.
+    auto Unpin = wil::scope_exit([this]() { ReleaseSpecialization(); });
+    if (!m_Specialized->m_Ready.load(std::memory_order_acquire))
     {
         auto lock = m_Kernel->m_Parent->GetSpecializationUpdateLock();
         while (!m_Specialized->m_PSO && !m_Specialized->m_Error)
@@ -633,7 +1097,7 @@ void ExecuteKernel::RecordImpl()
 
     if (m_Specialized->m_Error)
     {
-        auto Lock = g_Platform->GetTaskPoolLock();
+        auto Lock = m_Parent->GetTaskPoolLock();
         Complete(CL_BUILD_PROGRAM_FAILURE, Lock);
         throw std::exception("Failed to specialize");
     }
@@ -652,36 +1116,31 @@ void ExecuteKernel::RecordImpl()
     auto &Device = m_CommandQueue->GetD3DDevice();
     auto &ImmCtx = Device.ImmCtx();
 
-    D3D11_SUBRESOURCE_DATA Data = { m_KernelArgsCbData.data() };
-    ImmCtx.UpdateSubresources(
-        m_KernelArgsCb.get(),
-        m_KernelArgsCb->GetFullSubresourceSubset(),
-        &Data,
-        nullptr,
-        D3D12TranslationLayer::ImmediateContext::UpdateSubresourcesFlags::ScenarioInitialData);
-
-    ImmCtx.GetResourceStateManager().TransitionResource(m_KernelArgsCb.get(), D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+    // Kernel inputs small enough to be root constants are set along with the work properties. Otherwise they go
+    // straight into the device's upload ring, which is recycled as command lists complete. Kernel args that match
+    // the previous launch's reuse its upload, so its descriptor table can be reused too.
+    UINT NumKernelInputRootConstants = m_Kernel->m_NumKernelInputRootConstants;
+    D3D12TranslationLayer::ImmediateContext::ConstantUploadAllocation KernelArgsCb = {};
+    if (!NumKernelInputRootConstants && m_WorkPropertiesOffset)
+    {
+        KernelArgsCb = ImmCtx.UploadConstants(m_KernelArgsCbData.data(), m_WorkPropertiesOffset);
+    }
 
-    std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> SrcDescriptors;
-    UINT NumViewDescriptors = 2 + (UINT)m_KernelArgUAVs.size() + (UINT)m_KernelArgSRVs.size();
+    std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> SrcDescriptors, SamplerDescriptors;
+    UINT NumCBVs = NumKernelInputRootConstants ? 0 : 1;
+    UINT NumViewDescriptors = NumCBVs + (UINT)m_KernelArgUAVs.size() + (UINT)m_KernelArgSRVs.size();
     UINT NumSamplerDescriptors = (UINT)m_KernelArgSamplers.size();
-    SrcDescriptors.reserve(std::max(NumViewDescriptors - 2, NumSamplerDescriptors));
+    UINT SamplerRootParameter = NumKernelInputRootConstants ? 3 : 2;
+    SrcDescriptors.reserve(NumViewDescriptors - NumCBVs);
+    SamplerDescriptors.reserve(NumSamplerDescriptors);
 
+    ImmCtx.SetComputeRootSignature(m_Specialized->m_RS->GetForUse());
+    ImmCtx.SetComputePipelineState(m_Specialized->m_PSO->GetForUse());
     ID3D12GraphicsCommandList *pCmdList = ImmCtx.GetGraphicsCommandList();
-    pCmdList->SetComputeRootSignature(m_Specialized->m_RS->GetForUse());
-    pCmdList->SetPipelineState(m_Specialized->m_PSO->GetForUse());
 
-    if (NumSamplerDescriptors)
+    for (auto &samp : m_KernelArgSamplers)
     {
-        UINT SamplerSlot = ImmCtx.ReserveSlots(ImmCtx.m_SamplerHeap, NumSamplerDescriptors);
-        for (auto &samp : m_KernelArgSamplers)
-        {
-            SrcDescriptors.push_back(samp->GetUnderlying(&Device).m_Descriptor);
-        }
-        ImmCtx.m_pDevice12->CopyDescriptors(1, &ImmCtx.m_SamplerHeap.CPUHandle(SamplerSlot), &NumSamplerDescriptors,
-                                            NumSamplerDescriptors, SrcDescriptors.data(), nullptr, D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER);
-        SrcDescriptors.clear();
-        pCmdList->SetComputeRootDescriptorTable(1, ImmCtx.m_SamplerHeap.GPUHandle(SamplerSlot));
+        SamplerDescriptors.push_back(samp->GetUnderlying(&Device).m_Descriptor);
     }
 
     for (auto &UavRes : m_KernelArgUAVs)
@@ -717,6 +1176,20 @@ void ExecuteKernel::RecordImpl()
     }
     if (m_PrintfUAV.Get())
     {
+        // Buffers are reused, so start each launch's output over. The decoder never reads past the
+        // write offset in the header, so whatever a previous launch left in the rest doesn't matter.
+        auto PrintfResource = m_PrintfUAV->GetUnderlyingResource(&Device);
+        ImmCtx.GetResourceStateManager().TransitionResource(PrintfResource, D3D12_RESOURCE_STATE_COPY_DEST);
+        ImmCtx.GetResourceStateManager().ApplyAllResourceTransitions();
+        ImmCtx.CopyDataToBuffer(PrintfResource->GetUnderlyingResource(),
+                                (UINT)PrintfResource->GetSubresourcePlacement(0).Offset,
+                                PrintfBufferHeader, sizeof(PrintfBufferHeader));
+
+        void* pData = nullptr;
+        D3D12TranslationLayer::ThrowFailure(PrintfResource->GetUnderlyingResource()->Map(0, &EmptyRange, &pData));
+        m_PrintfResource12 = PrintfResource->GetUnderlyingResource();
+        m_PrintfData = reinterpret_cast<std::byte*>(pData) + PrintfResource->GetSubresourcePlacement(0).Offset;
+
         auto &UAV = m_PrintfUAV->GetUAV(&Device);
         Device.ImmCtx().GetResourceStateManager().TransitionSubresources(m_PrintfUAV->GetUnderlyingResource(&Device),
                                                                          UAV.m_subresources,
@@ -727,36 +1200,81 @@ void ExecuteKernel::RecordImpl()
     auto pCompiler = g_Platform->GetCompiler();
     cl_uint WorkPropertiesChunkSize = (cl_uint)pCompiler->GetWorkPropertiesChunkSize();
 
-    auto CopyAndSetViewDescriptors = [&](size_t WorkPropertiesOffset)
+    // The view table holds the kernel args CBV if there is one, then UAVs, then SRVs. It's shared by every piece
+    // of a large dispatch. Reserving slots can roll over a heap, which unbinds every table, so when either table
+    // has to be filled, both are filled before either is set.
+    UINT64 ViewTableTag = KernelArgsCb.m_GPUAddress;
+    bool TablesBound =
+        ImmCtx.IsComputeDescriptorTableBound(0, SrcDescriptors.data(), NumViewDescriptors - NumCBVs, ViewTableTag) &&
+        (!NumSamplerDescriptors ||
+         ImmCtx.IsComputeDescriptorTableBound(SamplerRootParameter, SamplerDescriptors.data(), NumSamplerDescriptors, 0));
+    if (!TablesBound)
     {
-        // The root signature indicates CBVs, then UAVs, then SRVs
         UINT ViewSlot = ImmCtx.ReserveSlots(ImmCtx.m_ViewHeap, NumViewDescriptors);
-        UINT KernelArgsSlot = ViewSlot + m_Specialized->m_Dxil->GetMetadata().kernel_inputs_cbv_id;
-        UINT WorkPropertiesSlot = ViewSlot + m_Specialized->m_Dxil->GetMetadata().work_properties_cbv_id;
-
-        D3D12_CONSTANT_BUFFER_VIEW_DESC CBVDesc;
-        D3D12TranslationLayer::GetBufferViewDesc(m_KernelArgsCb.get(), CBVDesc, 0, m_WorkPropertiesOffset);
-        ImmCtx.m_pDevice12->CreateConstantBufferView(&CBVDesc, ImmCtx.m_ViewHeap.CPUHandle(KernelArgsSlot));
-        CBVDesc.BufferLocation += WorkPropertiesOffset;
-        CBVDesc.SizeInBytes = WorkPropertiesChunkSize;
-        ImmCtx.m_pDevice12->CreateConstantBufferView(&CBVDesc, ImmCtx.m_ViewHeap.CPUHandle(WorkPropertiesSlot));
-
-        UINT CopyStartSlot = ViewSlot + 2;
-        UINT CopySize = NumViewDescriptors - 2;
+        UINT SamplerSlot = NumSamplerDescriptors ? ImmCtx.ReserveSlots(ImmCtx.m_SamplerHeap, NumSamplerDescriptors) : 0;
+
+        if (NumCBVs)
+        {
+            D3D12_CONSTANT_BUFFER_VIEW_DESC CBVDesc;
+            CBVDesc.SizeInBytes = m_WorkPropertiesOffset;
+            CBVDesc.BufferLocation = KernelArgsCb.m_GPUAddress;
+            ImmCtx.m_pDevice12->CreateConstantBufferView(&CBVDesc, ImmCtx.m_ViewHeap.CPUHandle(ViewSlot));
+        }
+
+        UINT CopyStartSlot = ViewSlot + NumCBVs;
+        UINT CopySize = NumViewDescriptors - NumCBVs;
         ImmCtx.m_pDevice12->CopyDescriptors(1, &ImmCtx.m_ViewHeap.CPUHandle(CopyStartSlot), &CopySize,
                                             CopySize, SrcDescriptors.data(), nullptr, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-        pCmdList->SetComputeRootDescriptorTable(0, ImmCtx.m_ViewHeap.GPUHandle(ViewSlot));
-    };
+        ImmCtx.SetComputeDescriptorTable(0, ImmCtx.m_ViewHeap.GPUHandle(ViewSlot), SrcDescriptors.data(), CopySize, ViewTableTag);
+
+        if (NumSamplerDescriptors)
+        {
+            ImmCtx.m_pDevice12->CopyDescriptors(1, &ImmCtx.m_SamplerHeap.CPUHandle(SamplerSlot), &NumSamplerDescriptors,
+                                                NumSamplerDescriptors, SamplerDescriptors.data(), nullptr, D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER);
+            ImmCtx.SetComputeDescriptorTable(SamplerRootParameter, ImmCtx.m_SamplerHeap.GPUHandle(SamplerSlot),
+                                             SamplerDescriptors.data(), NumSamplerDescriptors, 0);
+        }
+    }
+    if (NumKernelInputRootConstants)
+    {
+        pCmdList->SetComputeRoot32BitConstants(2, NumKernelInputRootConstants, m_KernelArgsCbData.data(), 0);
+    }
 
     ImmCtx.GetResourceStateManager().ApplyAllResourceTransitions();
 
-    // TODO: Optimize this out
-    ImmCtx.UAVBarrier();
+    // Transitions already order accesses through other views, so a UAV barrier is only needed when this
+    // kernel's UAV accesses conflict with those of an earlier dispatch in this command list.
+    auto &UAVWritable = m_Kernel->m_UAVWritable;
+    bool UAVHazard = m_PrintfUAV.Get() && ImmCtx.HasUAVHazard(m_PrintfUAV->GetUnderlyingResource(&Device), true);
+    for (size_t i = 0; i < m_KernelArgUAVs.size() && !UAVHazard; ++i)
+    {
+        UAVHazard = m_KernelArgUAVs[i].Get() &&
+            ImmCtx.HasUAVHazard(m_KernelArgUAVs[i]->GetUnderlyingResource(&Device), UAVWritable[i]);
+    }
+    if (m_AutotuneTrial)
+    {
+        try
+        {
+            m_TrialStart.reset(new D3D12TranslationLayer::TimestampQuery(&ImmCtx));
+            m_TrialStop.reset(new D3D12TranslationLayer::TimestampQuery(&ImmCtx));
+        }
+        catch (...) { m_TrialStart.reset(); /* Just don't report this trial */ }
+    }
+
+    // Keep trials from overlapping with other work, so the timing is for this kernel alone
+    if (UAVHazard || m_TrialStart)
+    {
+        ImmCtx.UAVBarrier();
+    }
+    if (m_TrialStart)
+    {
+        m_TrialStart->End();
+    }
 
     cl_uint numXIterations = ((m_DispatchDims[0] - 1) / D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION) + 1;
     cl_uint numYIterations = ((m_DispatchDims[1] - 1) / D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION) + 1;
     cl_uint numZIterations = ((m_DispatchDims[2] - 1) / D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION) + 1;
-    size_t WorkPropertiesOffset = m_WorkPropertiesOffset;
+    std::byte const* WorkProperties = m_KernelArgsCbData.data() + m_WorkPropertiesOffset;
     for (cl_uint x = 0; x < numXIterations; ++x)
     {
         for (cl_uint y = 0; y < numYIterations; ++y)
@@ -767,43 +1285,83 @@ void ExecuteKernel::RecordImpl()
                 UINT DimsY = (y == numYIterations - 1) ? (m_DispatchDims[1] - D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION * (numYIterations - 1)) : D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION;
                 UINT DimsZ = (z == numZIterations - 1) ? (m_DispatchDims[2] - D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION * (numZIterations - 1)) : D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION;
 
-                CopyAndSetViewDescriptors(WorkPropertiesOffset);
+                pCmdList->SetComputeRoot32BitConstants(1, Kernel::WorkPropertiesRootConstants, WorkProperties, 0);
                 ImmCtx.Dispatch(DimsX, DimsY, DimsZ);
 
-                WorkPropertiesOffset += WorkPropertiesChunkSize;
+                WorkProperties += WorkPropertiesChunkSize;
             }
         }
     }
+
+    // Recorded after dispatching, so that a submission triggered by the dispatches can't drop them
+    for (size_t i = 0; i < m_KernelArgUAVs.size(); ++i)
+    {
+        if (m_KernelArgUAVs[i].Get())
+        {
+            ImmCtx.AddPendingUAVAccess(m_KernelArgUAVs[i]->GetUnderlyingResource(&Device), UAVWritable[i]);
+        }
+    }
+    if (m_PrintfUAV.Get())
+    {
+        ImmCtx.AddPendingUAVAccess(m_PrintfUAV->GetUnderlyingResource(&Device), true);
+    }
+
+    if (m_TrialStart)
+    {
+        ImmCtx.UAVBarrier();
+        m_TrialStop->End();
+    }
 }
 
 void ExecuteKernel::OnComplete()
 {
-    auto Cleanup = wil::scope_exit([this]()
+    m_Kernel.Release();
+}
+
+void ExecuteKernel::OnGPUWorkComplete()
+{
+    // Trials and printf output are both handled here rather than in OnComplete, since that's done with the
+    // context's task lock held, which blocks the app from enqueueing anything else in the meantime.
+    if (m_TrialStart)
     {
-        m_Kernel.Release();
-    });
+        UINT64 Ticks = m_TrialStop->GetData() - m_TrialStart->GetData();
+        UINT64 Nanoseconds = (UINT64)((double)Ticks * (1000000000.0 / m_D3DDevice->GetTimestampFrequency()));
+        auto pAutotuner = g_Platform->GetLocalSizeAutotuner();
+        if (pAutotuner->ReportTiming(m_AutotuneTrial->Key, m_AutotuneTrial->Candidate, Nanoseconds))
+        {
+            try
+            {
+                g_Platform->QueueProgramOp([pAutotuner]() { pAutotuner->Persist(); },
+                                           BackgroundTaskScheduler::TaskPriority::Background);
+            }
+            catch (...) { /* It'll be written along with the next tuple */ }
+        }
+    }
 
-    if (m_PrintfUAV.Get())
+    if (!m_PrintfData)
     {
-        auto& Device = m_CommandQueue->GetD3DDevice();
-        auto& ImmCtx = Device.ImmCtx();
-        auto TranslationResource = m_PrintfUAV->GetUnderlyingResource(&Device);
-        D3D12TranslationLayer::MappedSubresource MapRet = {};
-        ImmCtx.Map(TranslationResource, 0, D3D12TranslationLayer::MAP_TYPE_READ, false, nullptr, &MapRet);
+        return;
+    }
 
-        auto Unmap = wil::scope_exit([&]()
-        {
-            ImmCtx.Unmap(TranslationResource, 0, D3D12TranslationLayer::MAP_TYPE_READ, nullptr);
-        });
+    // The output has been read back by the time the buffer is returned, so the next launch can have it.
+    auto Return = wil::scope_exit([this]()
+    {
+        UnmapPrintfBuffer();
+        m_Kernel->m_Parent->ReturnPrintfBuffer(*m_KernelData, std::move(m_PrintfUAV));
+    });
 
+    try
+    {
+        // The GPU is done with the buffer, and recording may be using the immediate context on another
+        // thread, so this only reads through the pointer mapped when the launch was recorded.
         // The buffer has a two-uint header.
         constexpr uint32_t InitialBufferOffset = sizeof(uint32_t) * 2;
         // The first uint is the offset where the next chunk of data would be written. Alternatively,
         // it's the size of the buffer that's *been* written, including the size of the header.
-        uint32_t NumBytesWritten = *reinterpret_cast<uint32_t*>(MapRet.pData);
+        uint32_t NumBytesWritten = *reinterpret_cast<uint32_t*>(m_PrintfData);
         uint32_t CurOffset = InitialBufferOffset;
 
-        std::byte* ByteStream = reinterpret_cast<std::byte*>(MapRet.pData);
+        std::byte* ByteStream = m_PrintfData;
         while (CurOffset < NumBytesWritten && CurOffset < PrintfBufferSize)
         {
             uint32_t FormatStringId = *reinterpret_cast<uint32_t*>(ByteStream + CurOffset);
@@ -1066,4 +1624,8 @@ void ExecuteKernel::OnComplete()
             CurOffset += TotalArgSize;
         }
     }
+    catch (...)
+    {
+        // Losing the output isn't a reason to fail the kernel, which has already run
+    }
 }
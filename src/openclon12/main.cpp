@@ -1,6 +1,9 @@
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT License.
 #include "platform.hpp"
+#ifdef CLON12_TEST_HOOKS
+#include "testhooks.hpp"
+#endif
 
 #include <windows.h>
 #include <cstring>
@@ -50,6 +53,11 @@ static struct ExtensionTableEntry clExtensions[] =
 
     // cl_khr_il_program
     EXT_FUNC(clCreateProgramWithILKHR),
+
+#ifdef CLON12_TEST_HOOKS
+    // Only in builds with ENABLE_TEST_HOOKS, and not advertised in the extension string
+    EXT_FUNC(clGetProgramSpecializationCacheStatsCLON12),
+#endif
 };
 
 static const int clExtensionCount = sizeof(clExtensions) / sizeof(clExtensions[0]);
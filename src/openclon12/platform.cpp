@@ -3,6 +3,7 @@
 #include "platform.hpp"
 #include "cache.hpp"
 #include "compiler.hpp"
+#include "autotuner.hpp"
 
 CL_API_ENTRY cl_int CL_API_CALL
 clGetPlatformInfo(cl_platform_id   platform,
@@ -171,6 +172,14 @@ Platform::Platform(cl_icd_dispatch* dispatch)
         m_Devices.resize(1);
     }
     m_Devices[0]->SetDefaultDevice();
+
+    char *autotuneFileStr = nullptr;
+    if (_dupenv_s(&autotuneFileStr, nullptr, "CLON12_LOCAL_SIZE_AUTOTUNE_FILE") == 0 &&
+        autotuneFileStr && *autotuneFileStr)
+    {
+        m_LocalSizeAutotuner = std::make_unique<LocalSizeAutotuner>(autotuneFileStr);
+    }
+    free(autotuneFileStr);
 }
 
 Platform::~Platform() = default;
@@ -204,24 +213,18 @@ Device *Platform::GetDevice(cl_uint i) const noexcept
     return m_Devices[i].get();
 }
 
-TaskPoolLock Platform::GetTaskPoolLock()
-{
-    TaskPoolLock lock;
-    lock.m_Lock = std::unique_lock<std::recursive_mutex>{ m_TaskLock };
-    return lock;
-}
-
-void Platform::FlushAllDevices(TaskPoolLock const& Lock)
+// Each D3D device has one strand recording and one waiting for the GPU. The waiting one blocks its
+// thread until the GPU is done, so the pool isn't capped by the core count: with fewer threads than
+// strands, completion waits could take every thread and keep other devices from recording.
+static BackgroundTaskScheduler::SchedulingMode GetDeviceSchedulingMode(unsigned ActiveDeviceCount)
 {
-    for (auto &device : m_Devices)
-    {
-        device->FlushAllDevices(Lock);
-    }
+    return { ActiveDeviceCount * 2, BackgroundTaskScheduler::Priority::Normal };
 }
 
 void Platform::DeviceInit()
 {
     std::lock_guard Lock(m_ModuleLock);
+    m_DeviceScheduler.SetSchedulingMode(GetDeviceSchedulingMode(m_ActiveDeviceCount + 1));
     if (m_ActiveDeviceCount++ > 0)
     {
         return;
@@ -230,13 +233,17 @@ void Platform::DeviceInit()
     BackgroundTaskScheduler::SchedulingMode mode{ 1u, BackgroundTaskScheduler::Priority::Normal };
     m_CallbackScheduler.SetSchedulingMode(mode);
 
-    mode.NumThreads = std::thread::hardware_concurrency();
+    // Start with one compiler thread and add more as builds back up. Threads that outlast a burst of
+    // builds go away again once they've been idle for a while.
+    constexpr std::chrono::milliseconds CompilerThreadIdleTimeout{ 5000 };
+    m_CompileAndLinkScheduler.EnableAutoScaling(std::max(std::thread::hardware_concurrency(), 1u), CompilerThreadIdleTimeout);
     m_CompileAndLinkScheduler.SetSchedulingMode(mode);
 }
 
 void Platform::DeviceUninit()
 {
     std::lock_guard Lock(m_ModuleLock);
+    m_DeviceScheduler.SetSchedulingMode(GetDeviceSchedulingMode(m_ActiveDeviceCount - 1));
     if (--m_ActiveDeviceCount > 0)
     {
         return;
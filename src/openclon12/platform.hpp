@@ -86,7 +86,14 @@ public:
 
 struct adopt_ref {};
 class Compiler;
-
+class LocalSizeAutotuner;
+
+// Guards the task graph of one context: task states, dependency lists, and the contents of the
+// context's command queues. Tasks can only depend on tasks from the same context, so this covers
+// dependencies between devices too, and contexts never need each other's locks. Lock order:
+// 1. A context's task pool lock (recursive, and at most one context's at a time)
+// 2. D3DDevice::m_SubmissionLock (at most one device's at a time)
+// 3. Scheduler locks
 struct TaskPoolLock
 {
     std::unique_lock<std::recursive_mutex> m_Lock;
@@ -129,9 +136,6 @@ public:
     XPlatHelpers::unique_module const& GetDXIL();
     void UnloadCompiler();
 
-    TaskPoolLock GetTaskPoolLock();
-    void FlushAllDevices(TaskPoolLock const& Lock);
-
     bool AnyD3DDevicesExist() const noexcept;
     void CloseCaches();
 
@@ -147,34 +151,21 @@ public:
 
     template <typename Fn> void QueueCallback(Fn&& fn)
     {
-        struct Context { Fn m_fn; };
-        std::unique_ptr<Context> context(new Context{ std::forward<Fn>(fn) });
-        m_CallbackScheduler.QueueTask({
-            [](void* pContext)
-            {
-                std::unique_ptr<Context> context(static_cast<Context*>(pContext));
-                context->m_fn();
-            },
-            [](void* pContext) { delete static_cast<Context*>(pContext); },
-            context.get() });
-        context.release();
+        m_CallbackScheduler.QueueTask({ std::forward<Fn>(fn) });
     }
 
-    template <typename Fn> void QueueProgramOp(Fn&& fn)
+    // Program builds run at Normal priority. Work that a queued command is blocked on should use Critical.
+    template <typename Fn> void QueueProgramOp(Fn&& fn,
+        BackgroundTaskScheduler::TaskPriority priority = BackgroundTaskScheduler::TaskPriority::Normal)
     {
-        struct Context { Fn m_fn; };
-        std::unique_ptr<Context> context(new Context{ std::forward<Fn>(fn) });
-        m_CompileAndLinkScheduler.QueueTask({
-            [](void* pContext)
-            {
-                std::unique_ptr<Context> context(static_cast<Context*>(pContext));
-                context->m_fn();
-            },
-            [](void* pContext) { delete static_cast<Context*>(pContext); },
-            context.get() });
-        context.release();
+        m_CompileAndLinkScheduler.QueueTask({ std::forward<Fn>(fn), priority });
     }
 
+    BackgroundTaskScheduler::Scheduler& GetDeviceScheduler() noexcept { return m_DeviceScheduler; }
+
+    // Null unless autotuning was enabled by setting CLON12_LOCAL_SIZE_AUTOTUNE_FILE to where results are kept
+    LocalSizeAutotuner* GetLocalSizeAutotuner() const noexcept { return m_LocalSizeAutotuner.get(); }
+
     void DeviceInit();
     void DeviceUninit();
 
@@ -189,10 +180,13 @@ protected:
     XPlatHelpers::unique_module m_DXIL;
     unsigned m_ActiveDeviceCount = 0;
 
-    std::recursive_mutex m_TaskLock;
+    std::unique_ptr<LocalSizeAutotuner> m_LocalSizeAutotuner;
 
     BackgroundTaskScheduler::Scheduler m_CallbackScheduler;
-    BackgroundTaskScheduler::Scheduler m_CompileAndLinkScheduler;
+    // Shared by all D3D devices, which use strands to keep recording and completion in order
+    BackgroundTaskScheduler::Scheduler m_DeviceScheduler;
+    // Program ops are many small independent tasks, so let the workers steal from each other
+    BackgroundTaskScheduler::Scheduler m_CompileAndLinkScheduler{ BackgroundTaskScheduler::DispatchMode::WorkStealing };
 };
 extern Platform* g_Platform;
 
@@ -3,8 +3,14 @@
 #include "program.hpp"
 #include "compiler.hpp"
 #include "kernel.hpp"
+#ifdef CLON12_TEST_HOOKS
+#include "testhooks.hpp"
+#endif
 
 #include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <thread>
 
 #include "spookyv2.h"
 
@@ -627,9 +633,41 @@ clSetProgramSpecializationConstant(cl_program  program_,
     return CL_SUCCESS;
 }
 
+#ifdef CLON12_TEST_HOOKS
+extern CL_API_ENTRY cl_int CL_API_CALL
+clGetProgramSpecializationCacheStatsCLON12(cl_program program_, clon12_specialization_cache_stats* stats)
+{
+    if (!program_)
+    {
+        return CL_INVALID_PROGRAM;
+    }
+    if (!stats)
+    {
+        return CL_INVALID_VALUE;
+    }
+    auto Stats = static_cast<Program*>(program_)->GetSpecializationCacheStats();
+    *stats = { Stats.Hits, Stats.Misses, Stats.Evictions, Stats.Entries, Stats.Bytes };
+    return CL_SUCCESS;
+}
+#endif
+
+static size_t GetSpecializationCacheBudget()
+{
+    char *budgetStr = nullptr;
+    size_t budgetMB = 64;
+    if (_dupenv_s(&budgetStr, nullptr, "CLON12_SPECIALIZATION_CACHE_SIZE_MB") == 0 &&
+        budgetStr && *budgetStr)
+    {
+        budgetMB = (size_t)strtoul(budgetStr, nullptr, 10);
+    }
+    free(budgetStr);
+    return budgetMB * 1024 * 1024;
+}
+
 Program::Program(Context& Parent, std::string Source)
     : CLChildBase(Parent)
     , m_Source(std::move(Source))
+    , m_SpecializationCacheBudget(GetSpecializationCacheBudget())
     , m_AssociatedDevices(Parent.GetDevices())
 {
 }
@@ -637,16 +675,30 @@ Program::Program(Context& Parent, std::string Source)
 Program::Program(Context& Parent, std::shared_ptr<ProgramBinary> ParsedIL)
     : CLChildBase(Parent)
     , m_ParsedIL(std::move(ParsedIL))
+    , m_SpecializationCacheBudget(GetSpecializationCacheBudget())
     , m_AssociatedDevices(Parent.GetDevices())
 {
 }
 
 Program::Program(Context& Parent, std::vector<D3DDeviceAndRef> Devices)
     : CLChildBase(Parent)
+    , m_SpecializationCacheBudget(GetSpecializationCacheBudget())
     , m_AssociatedDevices(std::move(Devices))
 {
 }
 
+Program::~Program()
+{
+    auto Stats = GetSpecializationCacheStats();
+    TraceLoggingWrite(g_hOpenCLOn12Provider,
+                      "SpecializationCacheStats",
+                      TraceLoggingUInt64(Stats.Hits, "Hits"),
+                      TraceLoggingUInt64(Stats.Misses, "Misses"),
+                      TraceLoggingUInt64(Stats.Evictions, "Evictions"),
+                      TraceLoggingUInt64(Stats.Entries, "Entries"),
+                      TraceLoggingUInt64(Stats.Bytes, "Bytes"));
+}
+
 cl_int Program::Build(std::vector<D3DDeviceAndRef> Devices, const char* options, Callback pfn_notify, void* user_data)
 {
     auto ReportError = GetContext().GetErrorReporter();
@@ -1141,18 +1193,19 @@ cl_int Program::BuildImpl(BuildArgs const& Args)
 
         if (!m_Source.empty())
         {
-            if (Cache.HasCache())
+            // The hash also identifies the program to the local size autotuner, so it's needed even without a cache
+            SpookyHash hasher;
+            hasher.Init(BuildData->m_Hash[0], BuildData->m_Hash[1]);
+            hasher.Update(m_Source.c_str(), m_Source.size());
+            hasher.Update(&Args.Common.Features, sizeof(Args.Common.Features));
+            for (auto &def : Args.Common.Args)
             {
-                SpookyHash hasher;
-                hasher.Init(BuildData->m_Hash[0], BuildData->m_Hash[1]);
-                hasher.Update(m_Source.c_str(), m_Source.size());
-                hasher.Update(&Args.Common.Features, sizeof(Args.Common.Features));
-                for (auto &def : Args.Common.Args)
-                {
-                    hasher.Update(def.c_str(), def.size());
-                }
-                hasher.Final(&BuildData->m_Hash[0], &BuildData->m_Hash[1]);
+                hasher.Update(def.c_str(), def.size());
+            }
+            hasher.Final(&BuildData->m_Hash[0], &BuildData->m_Hash[1]);
 
+            if (Cache.HasCache())
+            {
                 auto Precompiled = Cache.Find(BuildData->m_Hash, sizeof(BuildData->m_Hash));
                 if (Precompiled.first)
                 {
@@ -1186,10 +1239,7 @@ cl_int Program::BuildImpl(BuildArgs const& Args)
             {
                 compiledObject = m_ParsedIL;
             }
-            if (Cache.HasCache())
-            {
-                SpookyHash::Hash128(compiledObject->GetBinary(), compiledObject->GetBinarySize(), &BuildData->m_Hash[0], &BuildData->m_Hash[1]);
-            }
+            SpookyHash::Hash128(compiledObject->GetBinary(), compiledObject->GetBinarySize(), &BuildData->m_Hash[0], &BuildData->m_Hash[1]);
         }
 
         if (compiledObject)
@@ -1205,8 +1255,8 @@ cl_int Program::BuildImpl(BuildArgs const& Args)
         if (BuildData->m_OwnedBinary)
         {
             BuildData->m_BinaryType = CL_PROGRAM_BINARY_TYPE_EXECUTABLE;
-            BuildData->m_BuildStatus = CL_BUILD_SUCCESS;
             BuildData->CreateKernels(*this);
+            BuildData->m_BuildStatus = CL_BUILD_SUCCESS;
         }
         else
         {
@@ -1224,11 +1274,8 @@ cl_int Program::BuildImpl(BuildArgs const& Args)
             auto& BuildData = m_BuildData[device.Get()];
             Logger loggers(m_Lock, BuildData->m_BuildLog);
 
-            if (d3dDevice->GetShaderCache().HasCache())
-            {
-                SpookyHash::Hash128(BuildData->m_OwnedBinary->GetBinary(), BuildData->m_OwnedBinary->GetBinarySize(),
-                                    &BuildData->m_Hash[0], &BuildData->m_Hash[1]);
-            }
+            SpookyHash::Hash128(BuildData->m_OwnedBinary->GetBinary(), BuildData->m_OwnedBinary->GetBinarySize(),
+                                &BuildData->m_Hash[0], &BuildData->m_Hash[1]);
 
             Compiler::LinkerArgs link_args = {};
             link_args.create_library = Args.Common.CreateLibrary;
@@ -1239,8 +1286,8 @@ cl_int Program::BuildImpl(BuildArgs const& Args)
             if (BuildData->m_OwnedBinary)
             {
                 BuildData->m_BinaryType = CL_PROGRAM_BINARY_TYPE_EXECUTABLE;
-                BuildData->m_BuildStatus = CL_BUILD_SUCCESS;
                 BuildData->CreateKernels(*this);
+                BuildData->m_BuildStatus = CL_BUILD_SUCCESS;
             }
             else
             {
@@ -1271,23 +1318,23 @@ cl_int Program::CompileImpl(CompileArgs const& Args)
 
     if (!m_Source.empty())
     {
-        if (Cache.HasCache())
+        SpookyHash hasher;
+        hasher.Init(BuildData->m_Hash[0], BuildData->m_Hash[1]);
+        hasher.Update(m_Source.c_str(), m_Source.size());
+        hasher.Update(&Args.Common.Features, sizeof(Args.Common.Features));
+        for (auto &def : Args.Common.Args)
         {
-            SpookyHash hasher;
-            hasher.Init(BuildData->m_Hash[0], BuildData->m_Hash[1]);
-            hasher.Update(m_Source.c_str(), m_Source.size());
-            hasher.Update(&Args.Common.Features, sizeof(Args.Common.Features));
-            for (auto &def : Args.Common.Args)
-            {
-                hasher.Update(def.c_str(), def.size());
-            }
-            for (auto &header : Args.Headers)
-            {
-                hasher.Update(header.first.c_str(), header.first.size());
-                hasher.Update(header.second->m_Source.c_str(), header.second->m_Source.size());
-            }
-            hasher.Final(&BuildData->m_Hash[0], &BuildData->m_Hash[1]);
+            hasher.Update(def.c_str(), def.size());
+        }
+        for (auto &header : Args.Headers)
+        {
+            hasher.Update(header.first.c_str(), header.first.size());
+            hasher.Update(header.second->m_Source.c_str(), header.second->m_Source.size());
+        }
+        hasher.Final(&BuildData->m_Hash[0], &BuildData->m_Hash[1]);
 
+        if (Cache.HasCache())
+        {
             auto Precompiled = Cache.Find(BuildData->m_Hash, sizeof(BuildData->m_Hash));
             if (Precompiled.first)
             {
@@ -1326,10 +1373,7 @@ cl_int Program::CompileImpl(CompileArgs const& Args)
         {
             object = m_ParsedIL;
         }
-        if (BuildData->m_D3DDevice->GetShaderCache().HasCache())
-        {
-            SpookyHash::Hash128(object->GetBinary(), object->GetBinarySize(), &BuildData->m_Hash[0], &BuildData->m_Hash[1]);
-        }
+        SpookyHash::Hash128(object->GetBinary(), object->GetBinarySize(), &BuildData->m_Hash[0], &BuildData->m_Hash[1]);
     }
 
     {
@@ -1371,7 +1415,7 @@ cl_int Program::LinkImpl(LinkArgs const& Args)
         pCompiler->Initialize(Cache);
         SpookyHash hasher;
         uint64_t singleHash[2] = {};
-        if (Cache.HasCache() && Args.LinkPrograms.size() > 1)
+        if (Args.LinkPrograms.size() > 1)
         {
             hasher.Init(0, 0);
         }
@@ -1384,11 +1428,8 @@ cl_int Program::LinkImpl(LinkArgs const& Args)
             if (BuildData)
             {
                 link_args.objs.push_back(BuildData->m_OwnedBinary.get());
-                if (Cache.HasCache())
-                {
-                    memcpy(singleHash, BuildData->m_Hash, sizeof(singleHash));
-                    hasher.Update(singleHash, sizeof(singleHash));
-                }
+                memcpy(singleHash, BuildData->m_Hash, sizeof(singleHash));
+                hasher.Update(singleHash, sizeof(singleHash));
             }
         }
 
@@ -1403,15 +1444,15 @@ cl_int Program::LinkImpl(LinkArgs const& Args)
                 if (linkedObject)
                 {
                     memcpy(BuildData->m_Hash, singleHash, sizeof(singleHash));
-                    if (Cache.HasCache() && Args.LinkPrograms.size() > 1)
+                    if (Args.LinkPrograms.size() > 1)
                     {
                         hasher.Final(&BuildData->m_Hash[0], &BuildData->m_Hash[1]);
                     }
                     BuildData->m_OwnedBinary = std::move(linkedObject);
                     BuildData->m_BinaryType = Args.Common.CreateLibrary ?
                         CL_PROGRAM_BINARY_TYPE_LIBRARY : CL_PROGRAM_BINARY_TYPE_EXECUTABLE;
-                    BuildData->m_BuildStatus = CL_BUILD_SUCCESS;
                     BuildData->CreateKernels(*this);
+                    BuildData->m_BuildStatus = CL_BUILD_SUCCESS;
                 }
                 else
                 {
@@ -1436,6 +1477,71 @@ cl_int Program::LinkImpl(LinkArgs const& Args)
     return ret;
 }
 
+// Runs Fn(i) for each i in [0, Count) on the compile threads, and returns once they've all finished.
+// The calling thread takes items too, so this still makes progress when it is itself a compile thread
+// and all of the others are busy. The first exception thrown is rethrown here.
+template <typename Fn> static void ParallelForOnCompileThreads(size_t Count, Fn const& fn)
+{
+    struct State
+    {
+        Fn const& fn;
+        const size_t Count;
+        std::atomic<size_t> Next{ 0 };
+        std::mutex Lock;
+        std::condition_variable Done;
+        size_t Remaining;
+        std::exception_ptr Error;
+
+        State(Fn const& f, size_t c) : fn(f), Count(c), Remaining(c) {}
+
+        // fn is only touched after claiming an item, and the caller can't return while any are unfinished
+        void Run() noexcept
+        {
+            for (size_t i; (i = Next.fetch_add(1, std::memory_order_relaxed)) < Count;)
+            {
+                std::exception_ptr error;
+                try
+                {
+                    fn(i);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+                std::lock_guard lock(Lock);
+                if (error && !Error)
+                    Error = std::move(error);
+                if (--Remaining == 0)
+                    Done.notify_all();
+            }
+        }
+    };
+
+    if (Count == 0)
+        return;
+
+    auto state = std::make_shared<State>(fn, Count);
+    size_t NumHelpers = std::min<size_t>(Count, std::max(std::thread::hardware_concurrency(), 1u)) - 1;
+    for (size_t i = 0; i < NumHelpers; ++i)
+    {
+        try
+        {
+            // Something is blocked on these, so they go ahead of background work
+            g_Platform->QueueProgramOp([state]() { state->Run(); }, BackgroundTaskScheduler::TaskPriority::Critical);
+        }
+        catch (...)
+        {
+            break;
+        }
+    }
+
+    state->Run();
+    std::unique_lock lock(state->Lock);
+    state->Done.wait(lock, [&]() { return state->Remaining == 0; });
+    if (state->Error)
+        std::rethrow_exception(state->Error);
+}
+
 void Program::PerDeviceData::CreateKernels(Program& program)
 {
     if (m_BinaryType != CL_PROGRAM_BINARY_TYPE_EXECUTABLE)
@@ -1447,16 +1553,40 @@ void Program::PerDeviceData::CreateKernels(Program& program)
     pCompiler->Initialize(m_D3DDevice->GetShaderCache());
 
     auto& kernels = m_OwnedBinary->GetKernelInfo();
-    Logger loggers(program.m_Lock, m_BuildLog);
+    std::vector<KernelData*> kernelData;
+    kernelData.reserve(kernels.size());
     for (auto& kernelMeta : kernels)
     {
-        auto name = kernelMeta.name;
-        auto& kernel = m_Kernels.emplace(std::piecewise_construct,
-                                         std::forward_as_tuple(name),
-                                         std::forward_as_tuple(kernelMeta, unique_dxil{})).first->second;
-        kernel.m_GenericDxil = pCompiler->GetKernel(name, *m_OwnedBinary, nullptr /*configuration*/, &loggers);
+        kernelData.push_back(&m_Kernels.emplace(std::piecewise_construct,
+                                                std::forward_as_tuple(kernelMeta.name),
+                                                std::forward_as_tuple(kernelMeta, unique_dxil{}, this)).first->second);
+        char ProgramHash[40];
+        sprintf_s(ProgramHash, "%016llx%016llx", m_Hash[0], m_Hash[1]);
+        kernelData.back()->m_AutotuneName = std::string(ProgramHash) + ":" + kernelMeta.name;
+    }
+
+    // The caller holds the program lock, so each kernel logs to its own string rather than the build log,
+    // and they're appended in kernel order afterwards so the log doesn't depend on which finished first.
+    struct KernelLog
+    {
+        std::recursive_mutex Lock;
+        std::string Log;
+    };
+    std::vector<KernelLog> logs(kernels.size());
+    ParallelForOnCompileThreads(kernels.size(), [&](size_t i)
+    {
+        Logger loggers(logs[i].Lock, logs[i].Log);
+        auto& kernel = *kernelData[i];
+        kernel.m_GenericDxil = pCompiler->GetKernel(kernels[i].name, *m_OwnedBinary, nullptr /*configuration*/, &loggers);
         if (kernel.m_GenericDxil)
             kernel.m_GenericDxil->Sign();
+    });
+
+    Logger loggers(program.m_Lock, m_BuildLog);
+    for (auto& log : logs)
+    {
+        if (!log.Log.empty())
+            loggers.Log(log.Log.c_str());
     }
 }
 
@@ -4,6 +4,8 @@
 
 #include "context.hpp"
 #include "compiler.hpp"
+#include <array>
+#include <atomic>
 #include <variant>
 #undef GetBinaryType
 
@@ -13,6 +15,7 @@
 using unique_dxil = std::unique_ptr<CompiledDxil>;
 
 class Kernel;
+class Resource;
 class Program : public CLChildBase<Program, Context, cl_program>
 {
 public:
@@ -39,6 +42,10 @@ public:
     friend cl_int CL_API_CALL clGetProgramBuildInfo(cl_program, cl_device_id, cl_program_build_info, size_t, void*, size_t*);
     friend cl_kernel CL_API_CALL clCreateKernel(cl_program, const char*, cl_int*);
     friend cl_int CL_API_CALL clCreateKernelsInProgram(cl_program, cl_uint, cl_kernel*, cl_uint*);
+    friend class Kernel;
+    friend class ExecuteKernel;
+
+    ~Program();
 
     void KernelCreated();
     void KernelFreed();
@@ -55,7 +62,9 @@ public:
                 uint16_t LowerInt16 : 1;
                 uint16_t SupportGlobalOffsets : 1;
                 uint16_t SupportLocalOffsets : 1;
-                uint16_t Padding : 12;
+                // D3D_SHADER_MODEL values, like 0x65 for 6.5
+                uint16_t ShaderModel : 8;
+                uint16_t Padding : 4;
             } Bits;
             uint64_t Value;
         } ConfigData;
@@ -79,24 +88,45 @@ public:
     };
     struct SpecializationKeyHash
     {
-        size_t operator()(std::unique_ptr<const SpecializationKey> const&) const;
+        size_t operator()(const SpecializationKey*) const;
     };
     struct SpecializationKeyEqual
     {
-        bool operator()(std::unique_ptr<const SpecializationKey> const& a, std::unique_ptr<const SpecializationKey> const& b) const;
+        bool operator()(const SpecializationKey* a, const SpecializationKey* b) const;
     };
     struct SpecializationValue
     {
+        // Set once m_PSO or m_Error is, so dispatches of a built specialization don't need the update lock
+        std::atomic<bool> m_Ready{ false };
         bool m_Error = false;
         unique_dxil m_Dxil;
         std::unique_ptr<D3D12TranslationLayer::RootSignature> m_RS;
         std::unique_ptr<D3D12TranslationLayer::PipelineState> m_PSO;
-        SpecializationValue() = default;
-        SpecializationValue(decltype(m_Dxil) d, decltype(m_RS) rs, decltype(m_PSO) p)
-            : m_Dxil(std::move(d)), m_RS(std::move(rs)), m_PSO(std::move(p)) { }
-        SpecializationValue(SpecializationValue &&) = default;
-        SpecializationValue &operator=(SpecializationValue &&) = default;
+        // Creation can be queued twice, to move a speculative request up to critical priority once
+        // something is waiting on it, and only the first job to start does the work. Set on insertion,
+        // and then guarded by the specialization update lock.
+        bool m_Speculative = false;
+        bool m_Started = false;
+
+        // The key this value is stored under
+        std::unique_ptr<const SpecializationKey> m_Key;
+
+        // Entries can only be evicted once they're built and nothing holds a pin on them. Eviction sets
+        // the high bit, after which the entry can't be pinned again.
+        static constexpr uint32_t EvictedPin = 0x80000000u;
+        std::atomic<uint32_t> m_Pins{ 0 };
+        std::atomic<int64_t> m_LastUsed{ 0 };
+        bool TryPin() noexcept;
+
+        // Guarded by the per-device specialization cache lock
+        bool m_Built = false;
+        size_t m_ByteSize = 0;
     };
+    // Lookups read whichever copy of the map is current without taking any locks. Changes are made to a
+    // new copy which then replaces it, and the copies' references keep each value alive until no reader
+    // can still be looking at it.
+    using SpecializationMap = std::unordered_map<const SpecializationKey*, std::shared_ptr<SpecializationValue>,
+        SpecializationKeyHash, SpecializationKeyEqual>;
     
     struct SpecializationData
     {
@@ -106,8 +136,53 @@ public:
         uint64_t ProgramHash[2];
     };
 
+    struct SpecializationCacheStats
+    {
+        uint64_t Hits = 0;
+        uint64_t Misses = 0;
+        uint64_t Evictions = 0;
+        uint64_t Entries = 0;
+        uint64_t Bytes = 0;
+    };
+
+private:
+    struct PerDeviceData;
+    struct KernelData
+    {
+        KernelData(ProgramBinary::Kernel meta, unique_dxil d, PerDeviceData* owner)
+            : m_Meta(meta), m_GenericDxil(std::move(d)), m_Owner(owner) {}
+
+        ProgramBinary::Kernel m_Meta;
+        unique_dxil m_GenericDxil;
+        PerDeviceData* const m_Owner;
+        // Identifies the kernel to the local size autotuner by its name and the contents of its program
+        std::string m_AutotuneName;
+        // Read with std::atomic_load, and only replaced with the owner's specialization cache lock held
+        std::shared_ptr<const SpecializationMap> m_Specializations = std::make_shared<const SpecializationMap>();
+    };
+
+public:
+    // Kernel data for each device the kernel was built for. Valid for as long as any kernel from this
+    // program exists, since the program can't be rebuilt until they're all freed.
+    std::vector<std::pair<D3DDevice*, KernelData*>> GetKernelData(std::string const& kernelName) const;
+
+    // The returned value is pinned, and must be passed to ReleaseSpecialization once the caller is done with it.
+    // Speculative lookups don't count as hits or misses. Hits don't take any locks.
     SpecializationData GetSpecializationData(
-        Device* device, std::string const& kernelName, std::unique_ptr<const SpecializationKey> key);
+        KernelData& kernel, std::unique_ptr<const SpecializationKey> key, bool speculative = false);
+    static void PinSpecialization(SpecializationValue* value) noexcept;
+    // Whether an entry exists for the key, built or not. Doesn't pin it, take any locks, or count as a use.
+    static bool HasSpecialization(KernelData const& kernel, SpecializationKey const& key);
+    void ReleaseSpecialization(KernelData& kernel, SpecializationValue* value);
+    // Called by whoever built the value, with its pin still held, once it's complete or has failed.
+    void SpecializationBuilt(KernelData& kernel, SpecializationValue* value, size_t byteSize);
+    SpecializationCacheStats GetSpecializationCacheStats() const;
+
+    // Printf buffers are recycled across launches on the same device, instead of being created and
+    // uploaded for each one. A buffer must only be returned once its output has been read back.
+    ::ref_ptr<Resource> AcquirePrintfBuffer(KernelData& kernel);
+    void ReturnPrintfBuffer(KernelData& kernel, ::ref_ptr<Resource> buffer) noexcept;
+
     std::unique_lock<std::mutex> GetSpecializationUpdateLock() const { return std::unique_lock<std::mutex>(m_SpecializationUpdateLock); }
     void SpecializationComplete() const { m_SpecializationEvent.notify_all(); };
     void WaitForSpecialization(std::unique_lock<std::mutex> &lock) const { m_SpecializationEvent.wait(lock); }
@@ -118,15 +193,9 @@ private:
     mutable std::condition_variable m_SpecializationEvent;
     uint32_t m_NumLiveKernels = 0;
 
-    struct KernelData
-    {
-        KernelData(ProgramBinary::Kernel meta, unique_dxil d) : m_Meta(meta), m_GenericDxil(std::move(d)) {}
-
-        ProgramBinary::Kernel m_Meta;
-        unique_dxil m_GenericDxil;
-        std::unordered_map<std::unique_ptr<const SpecializationKey>, SpecializationValue,
-            SpecializationKeyHash, SpecializationKeyEqual> m_SpecializationCache;
-    };
+    // Memory allowed for built specializations that aren't in use, on each device. Past this,
+    // the least recently used ones are dropped, and will be rebuilt from the on-disk caches if needed again.
+    const size_t m_SpecializationCacheBudget;
 
     struct PerDeviceData
     {
@@ -144,7 +213,20 @@ private:
 
         void CreateKernels(Program& program);
 
+        // Guards changes to the kernels' specialization maps
         std::mutex m_SpecializationCacheLock;
+        std::atomic<size_t> m_SpecializationBytes{ 0 };
+        std::atomic<uint64_t> m_SpecializationHits{ 0 };
+        std::atomic<uint64_t> m_SpecializationMisses{ 0 };
+        std::atomic<uint64_t> m_SpecializationEvictions{ 0 };
+        std::atomic<uint64_t> m_SpecializationEntries{ 0 };
+
+        // Evicts the least recently used built, unpinned specializations across all kernels
+        // until they fit in the budget. Called with m_SpecializationCacheLock held.
+        void TrimSpecializationCache(size_t budget);
+
+        std::mutex m_PrintfBufferLock;
+        std::vector<::ref_ptr<Resource>> m_PrintfBuffers;
     };
     std::unordered_map<Device*, std::shared_ptr<PerDeviceData>> m_BuildData;
 
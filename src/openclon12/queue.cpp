@@ -202,7 +202,7 @@ clFlush(cl_command_queue command_queue) CL_API_SUFFIX__VERSION_1_0
     auto ReportError = queue.GetContext().GetErrorReporter();
     try
     {
-        queue.Flush(g_Platform->GetTaskPoolLock(), /* flushDevice */ true);
+        queue.Flush(queue.GetContext().GetTaskPoolLock(), /* flushDevice */ true);
         return CL_SUCCESS;
     }
     catch (std::bad_alloc&) { return ReportError(nullptr, CL_OUT_OF_HOST_MEMORY); }
@@ -243,15 +243,25 @@ CommandQueue::CommandQueue(D3DDevice& device, Context& context, const cl_queue_p
     , m_bProfile(IsProfile(properties))
     , m_bPropertiesSynthesized(synthesizedProperties)
 {
+    D3D12TranslationLayer::InitializeListHead(&m_QueuedTasks);
+    D3D12TranslationLayer::InitializeListHead(&m_OutstandingTasks);
+    if (m_bOutOfOrder)
+    {
+        m_CurrentEpoch = std::make_shared<QueueEpoch>();
+    }
 }
 
 void CommandQueue::Flush(TaskPoolLock const& lock, bool flushDevice)
 {
-    while (!m_QueuedTasks.empty())
+    while (!D3D12TranslationLayer::IsListEmpty(&m_QueuedTasks))
     {
-        m_OutstandingTasks.emplace_back(m_QueuedTasks.front().Get());
-        m_QueuedTasks.pop_front();
-        m_D3DDevice.SubmitTask(m_OutstandingTasks.back().Get(), lock);
+        Task* task = CONTAINING_RECORD(m_QueuedTasks.Flink, Task, m_QueueListEntry);
+        D3D12TranslationLayer::RemoveEntryList(&task->m_QueueListEntry);
+        D3D12TranslationLayer::InsertTailList(&m_OutstandingTasks, &task->m_QueueListEntry);
+        task->m_QueueList = Task::QueueList::Outstanding;
+        task->AddInternalRef();
+        task->Release();
+        m_D3DDevice.SubmitTask(task, lock);
     }
     if (flushDevice)
     {
@@ -261,6 +271,15 @@ void CommandQueue::Flush(TaskPoolLock const& lock, bool flushDevice)
 
 void CommandQueue::QueueTask(Task* p, TaskPoolLock const& lock)
 {
+    // Allocate the epoch that follows a marker or barrier up front, so nothing can fail
+    // once the current one has been handed off
+    std::shared_ptr<QueueEpoch> NextEpoch;
+    if (p->m_ClosedEpoch)
+    {
+        assert(p->m_ClosedEpoch == m_CurrentEpoch);
+        NextEpoch = std::make_shared<QueueEpoch>();
+    }
+
     if (m_LastQueuedTask)
     {
         cl_event TaskAsEvent = m_LastQueuedTask;
@@ -272,7 +291,21 @@ void CommandQueue::QueueTask(Task* p, TaskPoolLock const& lock)
         p->AddDependencies(&TaskAsEvent, 1, lock);
     }
 
-    m_QueuedTasks.emplace_back(p);
+    // No more exceptions
+    p->Retain();
+    D3D12TranslationLayer::InsertTailList(&m_QueuedTasks, &p->m_QueueListEntry);
+    p->m_QueueList = Task::QueueList::Queued;
+
+    if (NextEpoch)
+    {
+        m_CurrentEpoch->m_Waiter = p;
+        m_CurrentEpoch = std::move(NextEpoch);
+    }
+    if (m_bOutOfOrder)
+    {
+        p->m_QueueEpoch = m_CurrentEpoch;
+        ++m_CurrentEpoch->m_PendingTasks;
+    }
 
     if (!m_bOutOfOrder)
     {
@@ -286,16 +319,6 @@ void CommandQueue::QueueTask(Task* p, TaskPoolLock const& lock)
 
 void CommandQueue::NotifyTaskCompletion(Task* p, TaskPoolLock const&)
 {
-    {
-        auto newEnd = std::remove_if(m_OutstandingTasks.begin(), m_OutstandingTasks.end(),
-            [p](Task::ref_ptr_int const& e) { return e.Get() == p; });
-        m_OutstandingTasks.erase(newEnd, m_OutstandingTasks.end());
-    }
-    {
-        auto newEnd = std::remove_if(m_QueuedTasks.begin(), m_QueuedTasks.end(),
-            [p](Task::ref_ptr const& e) { return e.Get() == p; });
-        m_QueuedTasks.erase(newEnd, m_QueuedTasks.end());
-    }
     if (m_LastQueuedTask == p)
     {
         m_LastQueuedTask = nullptr;
@@ -304,22 +327,29 @@ void CommandQueue::NotifyTaskCompletion(Task* p, TaskPoolLock const&)
     {
         m_LastQueuedBarrier = nullptr;
     }
-}
 
-void CommandQueue::AddAllTasksAsDependencies(Task* p, TaskPoolLock const& lock)
-{
-    for (auto& task : m_OutstandingTasks)
+    auto List = p->m_QueueList;
+    if (List != Task::QueueList::None)
     {
-        if (task.Get() == m_LastQueuedTask || task.Get() == m_LastQueuedBarrier)
-            continue;
-        cl_event TaskAsEvent = task.Get();
-        p->AddDependencies(&TaskAsEvent, 1, lock);
+        D3D12TranslationLayer::RemoveEntryList(&p->m_QueueListEntry);
+        p->m_QueueList = Task::QueueList::None;
+        if (List == Task::QueueList::Queued)
+        {
+            p->Release();
+        }
+        else
+        {
+            p->ReleaseInternalRef();
+        }
     }
-    for (auto& task : m_QueuedTasks)
+}
+
+void CommandQueue::AddAllTasksAsDependencies(Task* p, TaskPoolLock const&)
+{
+    // In-order queues already chain each task to the one before it, see QueueTask.
+    // For out-of-order queues, the marker or barrier closes the current epoch when it's queued.
+    if (m_bOutOfOrder && m_CurrentEpoch->m_PendingTasks != 0)
     {
-        if (task.Get() == m_LastQueuedTask || task.Get() == m_LastQueuedBarrier)
-            continue;
-        cl_event TaskAsEvent = task.Get();
-        p->AddDependencies(&TaskAsEvent, 1, lock);
+        p->m_ClosedEpoch = m_CurrentEpoch;
     }
 }
@@ -31,8 +31,13 @@ protected:
     Context::ref_int m_Context;
     D3DDevice &m_D3DDevice;
 
-    std::deque<Task::ref_ptr> m_QueuedTasks;
-    std::vector<Task::ref_ptr_int> m_OutstandingTasks;
+    // Tasks are linked in through Task::m_QueueListEntry so that retiring one doesn't need a search.
+    // Queued tasks hold an external reference, and flushed but incomplete ones an internal one.
+    LIST_ENTRY m_QueuedTasks;
+    LIST_ENTRY m_OutstandingTasks;
     Task* m_LastQueuedTask = nullptr;
     Task* m_LastQueuedBarrier = nullptr;
+
+    // Only used for out-of-order queues, see QueueEpoch
+    std::shared_ptr<QueueEpoch> m_CurrentEpoch;
 };
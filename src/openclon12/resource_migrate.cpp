@@ -116,7 +116,7 @@ void Resource::EnqueueMigrateResource(D3DDevice* newDevice, Task* triggeringTask
         D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&CrossAdapterResource)
     ));
 
-    std::unique_ptr<Task> CopyToCrossAdapter(new CopyCrossAdapter(
+    std::unique_ptr<Task> CopyToCrossAdapter(new (triggeringTask->m_Parent.get()) CopyCrossAdapter(
         triggeringTask->m_Parent.get(), *this, std::move(CrossAdapterResource), *m_CurrentActiveDevice, true));
 
     CrossAdapterHeap.reset();
@@ -125,10 +125,10 @@ void Resource::EnqueueMigrateResource(D3DDevice* newDevice, Task* triggeringTask
         CrossAdapterHeap.get(), 0, &ResDesc,
         D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&CrossAdapterResource)
     ));
-    std::unique_ptr<Task> CopyFromCrossAdapter(new CopyCrossAdapter(
+    std::unique_ptr<Task> CopyFromCrossAdapter(new (triggeringTask->m_Parent.get()) CopyCrossAdapter(
         triggeringTask->m_Parent.get(), *this, std::move(CrossAdapterResource), *newDevice, false));
 
-    auto Lock = g_Platform->GetTaskPoolLock();
+    auto Lock = triggeringTask->m_Parent->GetTaskPoolLock();
 
     cl_event e = CopyToCrossAdapter.get();
     CopyFromCrossAdapter->AddDependencies(&e, 1, Lock);
@@ -194,10 +194,10 @@ void Resource::UploadInitialData(Task* triggeringTask)
     if (!m_InitialData)
         return;
 
-    std::unique_ptr<Task> UploadTask(new ::UploadInitialData(
+    std::unique_ptr<Task> UploadTask(new (m_Parent.get()) ::UploadInitialData(
         m_Parent.get(), *this, *m_CurrentActiveDevice));
 
-    auto Lock = g_Platform->GetTaskPoolLock();
+    auto Lock = m_Parent->GetTaskPoolLock();
 
     cl_event e = UploadTask.get();
     triggeringTask->AddDependencies(&e, 1, Lock);
@@ -259,8 +259,8 @@ clEnqueueMigrateMemObjects(cl_command_queue       command_queue,
 
     try
     {
-        std::unique_ptr<Task> task(new MigrateMemObjects(context, command_queue, mem_objects, num_mem_objects, flags));
-        auto Lock = g_Platform->GetTaskPoolLock();
+        std::unique_ptr<Task> task(new (context) MigrateMemObjects(context, command_queue, mem_objects, num_mem_objects, flags));
+        auto Lock = context.GetTaskPoolLock();
         task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
         queue.QueueTask(task.get(), Lock);
 
@@ -402,8 +402,8 @@ cl_int clEnqueueWriteBufferRectImpl(cl_command_queue    command_queue,
 
     try
     {
-        std::unique_ptr<Task> task(new MemWriteFillTask(context, resource, command_type, command_queue, CmdArgs, blocking_write == CL_FALSE));
-        auto Lock = g_Platform->GetTaskPoolLock();
+        std::unique_ptr<Task> task(new (context) MemWriteFillTask(context, resource, command_type, command_queue, CmdArgs, blocking_write == CL_FALSE));
+        auto Lock = context.GetTaskPoolLock();
         task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
         queue.QueueTask(task.get(), Lock);
 
@@ -568,8 +568,8 @@ clEnqueueFillBuffer(cl_command_queue   command_queue,
 
     try
     {
-        std::unique_ptr<Task> task(new MemWriteFillTask(context, resource, CL_COMMAND_FILL_BUFFER, command_queue, CmdArgs, false));
-        auto Lock = g_Platform->GetTaskPoolLock();
+        std::unique_ptr<Task> task(new (context) MemWriteFillTask(context, resource, CL_COMMAND_FILL_BUFFER, command_queue, CmdArgs, false));
+        auto Lock = context.GetTaskPoolLock();
         task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
         queue.QueueTask(task.get(), Lock);
 
@@ -667,8 +667,8 @@ clEnqueueWriteImage(cl_command_queue    command_queue,
 
     try
     {
-        std::unique_ptr<Task> task(new MemWriteFillTask(context, resource, CL_COMMAND_WRITE_IMAGE, command_queue, CmdArgs, blocking_write == CL_FALSE));
-        auto Lock = g_Platform->GetTaskPoolLock();
+        std::unique_ptr<Task> task(new (context) MemWriteFillTask(context, resource, CL_COMMAND_WRITE_IMAGE, command_queue, CmdArgs, blocking_write == CL_FALSE));
+        auto Lock = context.GetTaskPoolLock();
         task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
         queue.QueueTask(task.get(), Lock);
 
@@ -856,8 +856,8 @@ clEnqueueFillImage(cl_command_queue   command_queue,
 
     try
     {
-        std::unique_ptr<Task> task(new FillImageTask(context, resource, command_queue, CmdArgs));
-        auto Lock = g_Platform->GetTaskPoolLock();
+        std::unique_ptr<Task> task(new (context) FillImageTask(context, resource, command_queue, CmdArgs));
+        auto Lock = context.GetTaskPoolLock();
         task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
         queue.QueueTask(task.get(), Lock);
 
@@ -1146,9 +1146,9 @@ cl_int clEnqueueReadBufferRectImpl(cl_command_queue    command_queue,
     cl_int ret = CL_SUCCESS;
     try
     {
-        std::unique_ptr<Task> task(new MemReadTask(context, resource, command_type, command_queue, CmdArgs));
+        std::unique_ptr<Task> task(new (context) MemReadTask(context, resource, command_type, command_queue, CmdArgs));
         {
-            auto Lock = g_Platform->GetTaskPoolLock();
+            auto Lock = context.GetTaskPoolLock();
             task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
             queue.QueueTask(task.get(), Lock);
             if (blocking_read)
@@ -1322,9 +1322,9 @@ clEnqueueReadImage(cl_command_queue     command_queue,
     cl_int ret = CL_SUCCESS;
     try
     {
-        std::unique_ptr<Task> task(new MemReadTask(context, resource, CL_COMMAND_READ_IMAGE, command_queue, CmdArgs));
+        std::unique_ptr<Task> task(new (context) MemReadTask(context, resource, CL_COMMAND_READ_IMAGE, command_queue, CmdArgs));
         {
-            auto Lock = g_Platform->GetTaskPoolLock();
+            auto Lock = context.GetTaskPoolLock();
             task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
             queue.QueueTask(task.get(), Lock);
             if (blocking_read)
@@ -1566,8 +1566,8 @@ clEnqueueCopyBuffer(cl_command_queue    command_queue,
 
     try
     {
-        std::unique_ptr<Task> task(new CopyResourceTask(context, source, dest, command_queue, CmdArgs, CL_COMMAND_COPY_BUFFER));
-        auto Lock = g_Platform->GetTaskPoolLock();
+        std::unique_ptr<Task> task(new (context) CopyResourceTask(context, source, dest, command_queue, CmdArgs, CL_COMMAND_COPY_BUFFER));
+        auto Lock = context.GetTaskPoolLock();
         task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
         queue.QueueTask(task.get(), Lock);
 
@@ -1670,8 +1670,8 @@ clEnqueueCopyImage(cl_command_queue     command_queue,
 
     try
     {
-        std::unique_ptr<Task> task(new CopyResourceTask(context, source, dest, command_queue, CmdArgs, CL_COMMAND_COPY_IMAGE));
-        auto Lock = g_Platform->GetTaskPoolLock();
+        std::unique_ptr<Task> task(new (context) CopyResourceTask(context, source, dest, command_queue, CmdArgs, CL_COMMAND_COPY_IMAGE));
+        auto Lock = context.GetTaskPoolLock();
         task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
         queue.QueueTask(task.get(), Lock);
 
@@ -1997,8 +1997,8 @@ clEnqueueCopyBufferRect(cl_command_queue    command_queue,
 
     try
     {
-        std::unique_ptr<Task> task(new CopyBufferRectTask(context, source, dest, command_queue, CmdArgs));
-        auto Lock = g_Platform->GetTaskPoolLock();
+        std::unique_ptr<Task> task(new (context) CopyBufferRectTask(context, source, dest, command_queue, CmdArgs));
+        auto Lock = context.GetTaskPoolLock();
         task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
         queue.QueueTask(task.get(), Lock);
 
@@ -2264,8 +2264,8 @@ clEnqueueCopyImageToBuffer(cl_command_queue command_queue,
 
     try
     {
-        std::unique_ptr<Task> task(new CopyBufferAndImageTask(context, image, buffer, command_queue, CmdArgs, CL_COMMAND_COPY_IMAGE_TO_BUFFER));
-        auto Lock = g_Platform->GetTaskPoolLock();
+        std::unique_ptr<Task> task(new (context) CopyBufferAndImageTask(context, image, buffer, command_queue, CmdArgs, CL_COMMAND_COPY_IMAGE_TO_BUFFER));
+        auto Lock = context.GetTaskPoolLock();
         task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
         queue.QueueTask(task.get(), Lock);
 
@@ -2353,8 +2353,8 @@ clEnqueueCopyBufferToImage(cl_command_queue command_queue,
 
     try
     {
-        std::unique_ptr<Task> task(new CopyBufferAndImageTask(context, buffer, image, command_queue, CmdArgs, CL_COMMAND_COPY_BUFFER_TO_IMAGE));
-        auto Lock = g_Platform->GetTaskPoolLock();
+        std::unique_ptr<Task> task(new (context) CopyBufferAndImageTask(context, buffer, image, command_queue, CmdArgs, CL_COMMAND_COPY_BUFFER_TO_IMAGE));
+        auto Lock = context.GetTaskPoolLock();
         task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
         queue.QueueTask(task.get(), Lock);
 
@@ -2579,7 +2579,7 @@ public:
         UnderlyingMapArgs.SrcZ = 0;
         UnderlyingMapArgs.FirstArraySlice = 0;
         UnderlyingMapArgs.FirstMipLevel = 0;
-        m_UnderlyingMapTask.reset(new MapSynchronizeTask(Parent, command_queue, flags, *m_MappableResource.Get(), UnderlyingMapArgs, command));
+        m_UnderlyingMapTask.reset(new (Parent) MapSynchronizeTask(Parent, command_queue, flags, *m_MappableResource.Get(), UnderlyingMapArgs, command));
         m_RowPitch = m_UnderlyingMapTask->GetRowPitch();
         m_SlicePitch = m_UnderlyingMapTask->GetSlicePitch();
         m_Pointer = m_UnderlyingMapTask->GetPointer();
@@ -2707,15 +2707,15 @@ clEnqueueMapBuffer(cl_command_queue command_queue,
         std::unique_ptr<MapTask> task;
         if (resource.m_Flags & CL_MEM_USE_HOST_PTR)
         {
-            task.reset(new MapUseHostPtrResourceTask(context, command_queue, map_flags, resource, CmdArgs, CL_COMMAND_MAP_BUFFER));
+            task.reset(new (context) MapUseHostPtrResourceTask(context, command_queue, map_flags, resource, CmdArgs, CL_COMMAND_MAP_BUFFER));
         }
         else if (resource.m_Flags & CL_MEM_ALLOC_HOST_PTR)
         {
-            task.reset(new MapSynchronizeTask(context, command_queue, map_flags, resource, CmdArgs, CL_COMMAND_MAP_BUFFER));
+            task.reset(new (context) MapSynchronizeTask(context, command_queue, map_flags, resource, CmdArgs, CL_COMMAND_MAP_BUFFER));
         }
         else
         {
-            task.reset(new MapCopyTask(context, command_queue, map_flags, resource, CmdArgs, CL_COMMAND_MAP_BUFFER));
+            task.reset(new (context) MapCopyTask(context, command_queue, map_flags, resource, CmdArgs, CL_COMMAND_MAP_BUFFER));
         }
 
         resource.AddMapTask(task.get());
@@ -2725,7 +2725,7 @@ clEnqueueMapBuffer(cl_command_queue command_queue,
         });
 
         {
-            auto Lock = g_Platform->GetTaskPoolLock();
+            auto Lock = context.GetTaskPoolLock();
             task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
             queue.QueueTask(task.get(), Lock);
             if (blocking_map)
@@ -2843,11 +2843,11 @@ clEnqueueMapImage(cl_command_queue  command_queue,
         std::unique_ptr<MapTask> task;
         if (resource.m_Flags & CL_MEM_USE_HOST_PTR)
         {
-            task.reset(new MapUseHostPtrResourceTask(context, command_queue, map_flags, resource, CmdArgs, CL_COMMAND_MAP_IMAGE));
+            task.reset(new (context) MapUseHostPtrResourceTask(context, command_queue, map_flags, resource, CmdArgs, CL_COMMAND_MAP_IMAGE));
         }
         else
         {
-            task.reset(new MapCopyTask(context, command_queue, map_flags, resource, CmdArgs, CL_COMMAND_MAP_IMAGE));
+            task.reset(new (context) MapCopyTask(context, command_queue, map_flags, resource, CmdArgs, CL_COMMAND_MAP_IMAGE));
         }
 
         resource.AddMapTask(task.get());
@@ -2857,7 +2857,7 @@ clEnqueueMapImage(cl_command_queue  command_queue,
         });
 
         {
-            auto Lock = g_Platform->GetTaskPoolLock();
+            auto Lock = context.GetTaskPoolLock();
             task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
             queue.QueueTask(task.get(), Lock);
             if (blocking_map)
@@ -2960,8 +2960,8 @@ clEnqueueUnmapMemObject(cl_command_queue command_queue,
 
     try
     {
-        std::unique_ptr<Task> task(new UnmapTask(context, command_queue, mapTask));
-        auto Lock = g_Platform->GetTaskPoolLock();
+        std::unique_ptr<Task> task(new (context) UnmapTask(context, command_queue, mapTask));
+        auto Lock = context.GetTaskPoolLock();
         task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
         queue.QueueTask(task.get(), Lock);
 
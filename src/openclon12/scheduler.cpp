@@ -14,8 +14,20 @@
 namespace BackgroundTaskScheduler
 {
 
+// Identifies the scheduler and worker that the current thread belongs to, so that tasks
+// submitted from a worker can stay on that worker's queue.
+struct CurrentWorker
+{
+    Scheduler const* pScheduler;
+    int ThreadID;
+};
+static thread_local CurrentWorker t_CurrentWorker = {};
+
 //-------------------------------------------------------------------------------------------------
-Scheduler::Scheduler()
+Scheduler::Scheduler(DispatchMode dispatchMode)
+    : m_DispatchMode(dispatchMode)
+    , m_NumWorkerQueues(dispatchMode == DispatchMode::WorkStealing ? std::max(std::thread::hardware_concurrency(), 1u) : 0u)
+    , m_WorkerQueues(m_NumWorkerQueues ? new WorkerQueue[m_NumWorkerQueues] : nullptr) // throw( bad_alloc )
 {
     m_QueuedEvents.emplace_back(); // throw( bad_alloc )
     m_QueuedEventsPseudoEnd = m_QueuedEvents.begin();
@@ -24,32 +36,213 @@ Scheduler::Scheduler()
 //-------------------------------------------------------------------------------------------------
 void Scheduler::QueueTask(Task task)
 {
+    LaneStats& stats = m_LaneStats[(uint32_t)task.m_Priority];
+    if (m_DispatchMode == DispatchMode::WorkStealing)
+    {
+        assert(task.m_Strand == NoStrand);
+        if (QueueWorkerTask(task))
+        {
+            ++stats.m_Submitted;
+        }
+        else
+        {
+            ++stats.m_Canceled;
+            task.m_Function.Cancel();
+        }
+        return;
+    }
+
     bool bCancelTask = false;
     {
-        std::lock_guard<std::mutex> lock(m_Lock);
+        std::unique_lock<std::mutex> lock(m_Lock);
         if (m_CurrentMode.NumThreads == 0 || m_bShutdown)
         {
             bCancelTask = true;
         }
         else
         {
-            m_Tasks.push_back(QueuedTask{ task, m_QueuedEventsPseudoEnd }); // throw( bad_alloc )
+            auto& Lane = m_LaneTasks[(uint32_t)task.m_Priority];
+            Lane.push_back(QueuedTask{ std::move(task), m_QueuedEventsPseudoEnd }); // throw( bad_alloc )
+            Lane.back().m_Sequence = m_NextSequence++;
+            if (m_AutoScaleMaxThreads != 0)
+            {
+                GrowForBacklog(GetNumQueuedTasks(lock) - m_Tasks.size(), lock); // May release lock
+            }
         }
     }
 
     if (bCancelTask)
     {
-        if (task.m_Cancel)
+        ++stats.m_Canceled;
+        task.m_Function.Cancel();
+    }
+    else
+    {
+        ++stats.m_Submitted;
+        m_CV.notify_one();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+uint32_t Scheduler::SelectLane(bool const (&HasWork)[NumTaskPriorities], bool& bPromoted) noexcept
+{
+    uint32_t Selected = NumTaskPriorities;
+    bPromoted = false;
+    for (uint32_t Lane = 0; Lane < NumTaskPriorities; ++Lane)
+    {
+        if (!HasWork[Lane])
+        {
+            continue;
+        }
+        if (Selected == NumTaskPriorities)
+        {
+            Selected = Lane;
+        }
+        else if (++m_LaneStats[Lane].m_PassedOver > StarvationLimit && !bPromoted)
         {
-            task.m_Cancel(task.m_pContext);
+            // This lane has waited long enough, let it go ahead of the higher priority work
+            Selected = Lane;
+            bPromoted = true;
         }
     }
-    else
+    if (Selected != NumTaskPriorities)
+    {
+        m_LaneStats[Selected].m_PassedOver = 0;
+    }
+    return Selected;
+}
+
+//-------------------------------------------------------------------------------------------------
+size_t Scheduler::GetNumQueuedTasks(std::unique_lock<std::mutex> const& lock) const noexcept
+{
+    assert(lock.owns_lock()); UNREFERENCED_PARAMETER(lock);
+    size_t NumTasks = m_Tasks.size();
+    for (auto& LaneTasks : m_LaneTasks)
     {
+        NumTasks += LaneTasks.size();
+    }
+    return NumTasks;
+}
+
+//-------------------------------------------------------------------------------------------------
+bool Scheduler::TryPopLaneTask(QueuedTask& task, std::unique_lock<std::mutex> const& lock) noexcept
+{
+    // Tasks queued after a pending mode change have to wait for it, so they run in the new mode
+    if (m_bApplyingModeChange)
+    {
+        return false;
+    }
+    uint64_t SequenceLimit = m_Tasks.empty() ? UINT64_MAX : m_Tasks.front().m_Sequence;
+
+    bool HasWork[NumTaskPriorities];
+    decltype(m_Tasks)::iterator FirstRunnable[NumTaskPriorities];
+    for (uint32_t Lane = 0; Lane < NumTaskPriorities; ++Lane)
+    {
+        // Skip over tasks whose strand is busy, they'll be picked up when it's released.
+        // Each lane is in submission order, so nothing past the limit can be started either.
+        auto& LaneTasks = m_LaneTasks[Lane];
+        FirstRunnable[Lane] = LaneTasks.end();
+        for (auto iter = LaneTasks.begin(); iter != LaneTasks.end() && iter->m_Sequence < SequenceLimit; ++iter)
+        {
+            if (!IsStrandRunning(iter->m_Strand, lock))
+            {
+                FirstRunnable[Lane] = iter;
+                break;
+            }
+        }
+        HasWork[Lane] = FirstRunnable[Lane] != LaneTasks.end();
+    }
+
+    bool bPromoted;
+    uint32_t Lane = SelectLane(HasWork, bPromoted);
+    if (Lane == NumTaskPriorities)
+    {
+        return false;
+    }
+
+    task = std::move(*FirstRunnable[Lane]);
+    m_LaneTasks[Lane].erase(FirstRunnable[Lane]);
+    if (task.m_Strand != NoStrand)
+    {
+        // Capacity is reserved for one running strand per thread
+        m_RunningStrands.push_back(task.m_Strand);
+    }
+    ++m_LaneStats[Lane].m_Started;
+    if (bPromoted)
+    {
+        ++m_LaneStats[Lane].m_Promoted;
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+bool Scheduler::IsModeChangeRunnable(std::unique_lock<std::mutex> const& lock) const noexcept
+{
+    assert(lock.owns_lock()); UNREFERENCED_PARAMETER(lock);
+    if (m_Tasks.empty() || m_bApplyingModeChange)
+    {
+        return false;
+    }
+    // Lanes are in submission order, so only their fronts can be older than the mode change
+    uint64_t Sequence = m_Tasks.front().m_Sequence;
+    return std::all_of(std::begin(m_LaneTasks), std::end(m_LaneTasks),
+        [Sequence](auto const& LaneTasks) { return LaneTasks.empty() || LaneTasks.front().m_Sequence > Sequence; });
+}
+
+//-------------------------------------------------------------------------------------------------
+bool Scheduler::IsStrandRunning(StrandKey key, std::unique_lock<std::mutex> const& lock) const noexcept
+{
+    assert(lock.owns_lock()); UNREFERENCED_PARAMETER(lock);
+    return key != NoStrand &&
+        std::find(m_RunningStrands.begin(), m_RunningStrands.end(), key) != m_RunningStrands.end();
+}
+
+//-------------------------------------------------------------------------------------------------
+void Scheduler::ReleaseStrand(StrandKey key, std::unique_lock<std::mutex> const& lock) noexcept
+{
+    assert(lock.owns_lock()); UNREFERENCED_PARAMETER(lock);
+    if (key == NoStrand)
+    {
+        return;
+    }
+
+    m_RunningStrands.erase(std::find(m_RunningStrands.begin(), m_RunningStrands.end(), key));
+    if (m_NumStrandWaiters > 0)
+    {
+        m_StrandCV.notify_all();
+    }
+    if (GetNumQueuedTasks(lock) != 0)
+    {
+        // Other threads may have gone to sleep while the next task in this strand was blocked
         m_CV.notify_one();
     }
 }
 
+//-------------------------------------------------------------------------------------------------
+StrandKey Scheduler::CreateStrandKey() noexcept
+{
+    static std::atomic<StrandKey> s_NextStrandKey = NoStrand + 1;
+    return s_NextStrandKey++;
+}
+
+//-------------------------------------------------------------------------------------------------
+uint32_t Scheduler::GetNumWorkerTasks() const noexcept
+{
+    uint32_t NumTasks = 0;
+    for (auto& Count : m_NumWorkerTasks)
+    {
+        NumTasks += Count;
+    }
+    return NumTasks;
+}
+
+//-------------------------------------------------------------------------------------------------
+LaneCounters Scheduler::GetLaneCounters(TaskPriority priority) const noexcept
+{
+    LaneStats const& stats = m_LaneStats[(uint32_t)priority];
+    return { stats.m_Submitted, stats.m_Started, stats.m_Completed, stats.m_Canceled, stats.m_Promoted };
+}
+
 inline auto PriorityToPlatformPriority(Priority p)
 {
     switch (p)
@@ -80,8 +273,17 @@ void Scheduler::SetSchedulingModeImpl(SchedulingMode mode, std::unique_lock<std:
     assert(lock.owns_lock());
     std::vector<std::thread> ThreadsToWaitOn;
 
+    // Threads that removed themselves have nothing left to do but exit, so reap them along with
+    // the ones being removed now, instead of letting them pile up while the pool grows and shrinks.
+    auto FirstReaped = std::partition(m_ExitingThreads.begin(), m_ExitingThreads.end(),
+        [](std::thread const& t) { return !t.joinable() || t.get_id() == std::this_thread::get_id(); });
+    ThreadsToWaitOn.reserve(std::distance(FirstReaped, m_ExitingThreads.end())); // throw( bad_alloc )
+    std::move(FirstReaped, m_ExitingThreads.end(), std::back_inserter(ThreadsToWaitOn));
+    m_ExitingThreads.erase(FirstReaped, m_ExitingThreads.end());
+
     SchedulingMode previousMode = m_EffectiveMode;
     m_EffectiveMode = mode;
+    m_EffectiveNumThreads = mode.NumThreads;
 
     size_t NewNumThreads = mode.NumThreads;
     size_t PreviousNumThreads = m_Threads.size();
@@ -89,6 +291,7 @@ void Scheduler::SetSchedulingModeImpl(SchedulingMode mode, std::unique_lock<std:
     // Adjust number of threads
     if (NewNumThreads > PreviousNumThreads)
     {
+        m_RunningStrands.reserve(NewNumThreads); // throw( bad_alloc )
         m_Threads.resize(NewNumThreads); // throw( bad_alloc )
         for (auto i = PreviousNumThreads; i < NewNumThreads; ++i)
         {
@@ -97,7 +300,7 @@ void Scheduler::SetSchedulingModeImpl(SchedulingMode mode, std::unique_lock<std:
     }
     else if (NewNumThreads < PreviousNumThreads)
     {
-        ThreadsToWaitOn.reserve(PreviousNumThreads - NewNumThreads); // throw( bad_alloc )
+        ThreadsToWaitOn.reserve(ThreadsToWaitOn.size() + PreviousNumThreads - NewNumThreads); // throw( bad_alloc )
         for (size_t i = NewNumThreads; i < PreviousNumThreads; ++i)
         {
             if (m_Threads[i].joinable())
@@ -157,6 +360,7 @@ void Scheduler::SetSchedulingMode(SchedulingMode mode)
         // If we're shut down, ignore requests to spin back up.
         return;
     }
+    m_RequestedNumThreads = mode.NumThreads;
     if (mode == m_CurrentMode)
     {
         return;
@@ -166,7 +370,7 @@ void Scheduler::SetSchedulingMode(SchedulingMode mode)
         (mode > m_EffectiveMode || IsSchedulerIdle(lock)))
     {
         // Increasing number or priority of threads OR there's nothing currently executing - do it immediately
-        m_CurrentMode = mode;
+        SetCurrentMode(mode, lock);
         SetSchedulingModeImpl(mode, lock); // Releases lock
     }
     else
@@ -188,29 +392,124 @@ void Scheduler::SetSchedulingMode(SchedulingMode mode)
     }
 }
 
+//-------------------------------------------------------------------------------------------------
+void Scheduler::EnableAutoScaling(uint32_t MaxThreads, std::chrono::milliseconds IdleTimeout)
+{
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_AutoScaleIdleTimeout = IdleTimeout;
+    m_AutoScaleMaxThreads = MaxThreads;
+}
+
+//-------------------------------------------------------------------------------------------------
+void Scheduler::GrowForBacklog(size_t Backlog, std::unique_lock<std::mutex>& lock) noexcept
+{
+    assert(lock.owns_lock());
+    // Only grow while the mode is settled, so a pending mode change doesn't get overridden
+    if (Backlog <= m_NumSleepingWorkers || m_bShutdown ||
+        m_CurrentMode != m_EffectiveMode || m_EffectiveMode.NumThreads == 0 ||
+        m_EffectiveMode.NumThreads >= m_AutoScaleMaxThreads)
+    {
+        return;
+    }
+
+    SchedulingMode mode = m_EffectiveMode;
+    ++mode.NumThreads;
+    try
+    {
+        SetCurrentMode(mode, lock);
+        SetSchedulingModeImpl(mode, lock); // Releases lock
+    }
+    catch (...)
+    {
+        // Growing is only an optimization, the existing threads will still get to the task
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+bool Scheduler::WaitForWork(int ThreadID, std::unique_lock<std::mutex>& lock) noexcept
+{
+    assert(lock.owns_lock());
+    if (m_AutoScaleMaxThreads == 0)
+    {
+        m_CV.wait(lock);
+        return false;
+    }
+    if (m_CV.wait_for(lock, m_AutoScaleIdleTimeout) == std::cv_status::no_timeout)
+    {
+        return false;
+    }
+
+    // Only the highest thread removes itself, so the remaining thread IDs stay contiguous
+    bool bNothingQueued = m_DispatchMode == DispatchMode::WorkStealing ?
+        GetNumWorkerTasks() == 0 : GetNumQueuedTasks(lock) == 0;
+    if (!bNothingQueued || ThreadID + 1 != (int)m_EffectiveMode.NumThreads ||
+        m_CurrentMode != m_EffectiveMode ||
+        m_EffectiveMode.NumThreads <= std::max(m_RequestedNumThreads, 1u))
+    {
+        return false;
+    }
+
+    SchedulingMode mode = m_EffectiveMode;
+    --mode.NumThreads;
+    try
+    {
+        SetCurrentMode(mode, lock);
+        SetSchedulingModeImpl(mode, lock); // Releases lock, and moves this thread to m_ExitingThreads
+    }
+    catch (...)
+    {
+        // The effective mode already excludes this thread, so it'll exit once the caller sees that
+        return false;
+    }
+    return true;
+}
+
 //-------------------------------------------------------------------------------------------------
 void Scheduler::SignalEventOnCompletionOfCurrentTasks(XPlatHelpers::Event hEvent, SchedulingMode modeAfterSignal)
 {
     {
         std::unique_lock<std::mutex> lock(m_Lock);
+        if (modeAfterSignal != m_CurrentMode)
+        {
+            // Staying in the current mode doesn't pin threads that autoscaling added
+            m_RequestedNumThreads = modeAfterSignal.NumThreads;
+        }
+
+        bool bSchedulerIdle = m_EffectiveMode.NumThreads == 0;
+        {
+            // Block work-stealing submissions and retirements so the set of outstanding tasks is stable
+            std::lock_guard<std::shared_mutex> eventLock(m_EventLock);
+            bSchedulerIdle = bSchedulerIdle || IsSchedulerIdle(lock);
+            if (!bSchedulerIdle)
+            {
+                if (m_DispatchMode == DispatchMode::WorkStealing)
+                {
+                    // Worker tasks don't erase entries when they signal them, so prune them now
+                    for (auto iter = m_QueuedEvents.begin(); iter != m_QueuedEventsPseudoEnd;)
+                    {
+                        iter = iter->m_RefCount == 0 ? m_QueuedEvents.erase(iter) : std::next(iter);
+                    }
+                }
+
+                // Update the entry that existing tasks will signal
+                QueuedEventSignal& signal = m_QueuedEvents.back();
+                signal.m_RefCount = (long)(GetNumQueuedTasks(lock) + m_TasksInProgress + m_NumOutstandingWorkerTasks);
+                signal.m_Event = XPlatHelpers::unique_event(hEvent, XPlatHelpers::unique_event::copy_tag{});
+                // Add a new entry that new tasks will reference
+                m_QueuedEvents.emplace_back();
+                ++m_QueuedEventsPseudoEnd;
+            }
+        }
 
         // Tasks won't execute - just set the event
-        if (m_EffectiveMode.NumThreads == 0 || IsSchedulerIdle(lock))
+        if (bSchedulerIdle)
         {
             XPlatHelpers::SetEvent(hEvent);
-            m_CurrentMode = modeAfterSignal;
+            SetCurrentMode(modeAfterSignal, lock);
             SetSchedulingModeImpl(modeAfterSignal, lock);
             return;
         }
 
-        // Update the entry that existing tasks will signal
-        QueuedEventSignal& signal = m_QueuedEvents.back();
-        signal.m_RefCount = (long)(m_Tasks.size() + m_TasksInProgress);
-        signal.m_Event = XPlatHelpers::unique_event(hEvent, XPlatHelpers::unique_event::copy_tag{});
-        // Add a new entry that new tasks will reference
-        m_QueuedEvents.emplace_back();
-        ++m_QueuedEventsPseudoEnd;
-
         // If we want to end up in a different mode, then queue a task to put us there
         if (modeAfterSignal != m_CurrentMode)
         {
@@ -234,10 +533,17 @@ void Scheduler::TaskThread(int ThreadID) noexcept
 #endif
     }
 
+    if (m_DispatchMode == DispatchMode::WorkStealing)
+    {
+        WorkStealingTaskThread(ThreadID);
+        return;
+    }
+
     std::unique_lock<std::mutex> lock(m_Lock);
     while (true)
     {
         QueuedTask task = {};
+        bool bLaneTask = false;
         while (true)
         {
             if (ThreadID >= (int)m_EffectiveMode.NumThreads)
@@ -245,26 +551,248 @@ void Scheduler::TaskThread(int ThreadID) noexcept
                 // This thread is done
                 return;
             }
-            if (!m_Tasks.empty())
+            if (IsModeChangeRunnable(lock))
             {
-                // Pop the front task and exit the loop, this thread will now do work
-                task = m_Tasks.front();
+                // Everything queued before the next scheduling mode change has been started, so apply it
+                task = std::move(m_Tasks.front());
                 m_Tasks.pop_front();
+                m_bApplyingModeChange = true;
                 ++m_TasksInProgress;
                 break;
             }
+            if (TryPopLaneTask(task, lock))
+            {
+                // Popped the front of the highest priority lane, this thread will now do work
+                bLaneTask = true;
+                ++m_TasksInProgress;
+                if (IsModeChangeRunnable(lock))
+                {
+                    // That was the last task ahead of a mode change, which another thread can apply
+                    m_CV.notify_one();
+                }
+                break;
+            }
 
             // Not supposed to exit yet, and nothing to do - wait for a notification
-            m_CV.wait(lock);
+            ++m_NumSleepingWorkers;
+            bool bExit = WaitForWork(ThreadID, lock);
+            --m_NumSleepingWorkers;
+            if (bExit)
+            {
+                return;
+            }
         }
 
         // Do the work
         lock.unlock();
-        task.m_Callback(task.m_pContext);
+        task.m_Function.Run();
+        if (bLaneTask)
+        {
+            ++m_LaneStats[(uint32_t)task.m_Priority].m_Completed;
+        }
         lock.lock();
 
         RetireTask(task, lock);
+        ReleaseStrand(task.m_Strand, lock);
         --m_TasksInProgress;
+        if (!bLaneTask)
+        {
+            // Lane tasks queued after the mode change were held back until now
+            m_bApplyingModeChange = false;
+            m_CV.notify_all();
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+void Scheduler::WorkStealingTaskThread(int ThreadID) noexcept
+{
+    t_CurrentWorker = { this, ThreadID };
+    while (true)
+    {
+        if (ThreadID < (int)m_EffectiveNumThreads)
+        {
+            QueuedTask task = {};
+            if (TryPopWorkerTask(ThreadID, task))
+            {
+                task.m_Function.Run();
+                ++m_LaneStats[(uint32_t)task.m_Priority].m_Completed;
+                RetireWorkerTask(task);
+                continue;
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(m_Lock);
+        if (ThreadID >= (int)m_EffectiveMode.NumThreads)
+        {
+            // This thread is done. Anything left in its queue will be stolen by the remaining workers.
+            return;
+        }
+        if (!m_Tasks.empty() && GetNumWorkerTasks() == 0)
+        {
+            // Scheduling mode changes are only picked up when there's no other work left to start.
+            // Worker tasks may have been queued since this thread last looked, so that's checked again.
+            QueuedTask task = std::move(m_Tasks.front());
+            m_Tasks.pop_front();
+            ++m_TasksInProgress;
+
+            lock.unlock();
+            task.m_Function.Run();
+            lock.lock();
+
+            RetireTask(task, lock);
+            --m_TasksInProgress;
+            continue;
+        }
+
+        // Pairs with the check of m_NumSleepingWorkers in QueueWorkerTask: either the submitter
+        // sees this worker as sleeping and notifies it, or this worker sees the new task.
+        ++m_NumSleepingWorkers;
+        bool bExit = GetNumWorkerTasks() == 0 && WaitForWork(ThreadID, lock);
+        --m_NumSleepingWorkers;
+        if (bExit)
+        {
+            return;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+bool Scheduler::QueueWorkerTask(Task& task)
+{
+    {
+        std::shared_lock<std::shared_mutex> eventLock(m_EventLock);
+        if (m_CurrentMode.NumThreads == 0 || m_bShutdown)
+        {
+            return false;
+        }
+
+        uint32_t QueueIndex;
+        if (t_CurrentWorker.pScheduler == this)
+        {
+            // Work submitted by a worker stays on that worker unless someone steals it
+            QueueIndex = t_CurrentWorker.ThreadID % m_NumWorkerQueues;
+        }
+        else
+        {
+            uint32_t NumActiveQueues = std::min(std::max(m_EffectiveNumThreads.load(), 1u), m_NumWorkerQueues);
+            QueueIndex = m_NextWorkerQueue++ % NumActiveQueues;
+        }
+
+        // Count the task before it's visible, so that a worker that pops it can't underflow the counts
+        uint32_t Lane = (uint32_t)task.m_Priority;
+        ++m_NumOutstandingWorkerTasks;
+        ++m_NumWorkerTasks[Lane];
+        try
+        {
+            WorkerQueue& queue = m_WorkerQueues[QueueIndex];
+            std::lock_guard<std::mutex> queueLock(queue.m_Lock);
+            queue.m_Tasks[Lane].push_back(QueuedTask{ std::move(task), m_QueuedEventsPseudoEnd }); // throw( bad_alloc )
+        }
+        catch (...)
+        {
+            --m_NumWorkerTasks[Lane];
+            --m_NumOutstandingWorkerTasks;
+            throw;
+        }
+    }
+
+    if (m_NumSleepingWorkers > 0)
+    {
+        // Acquiring the lock guarantees that a worker which decided to sleep is already waiting
+        { std::lock_guard<std::mutex> lock(m_Lock); }
+        m_CV.notify_one();
+    }
+    if (m_EffectiveNumThreads < m_AutoScaleMaxThreads && GetNumWorkerTasks() > m_NumSleepingWorkers)
+    {
+        std::unique_lock<std::mutex> lock(m_Lock);
+        GrowForBacklog(GetNumWorkerTasks(), lock); // May release lock
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+bool Scheduler::TryPopWorkerTask(int ThreadID, QueuedTask& task) noexcept
+{
+    bool HasWork[NumTaskPriorities];
+    for (uint32_t Lane = 0; Lane < NumTaskPriorities; ++Lane)
+    {
+        HasWork[Lane] = m_NumWorkerTasks[Lane] != 0;
+    }
+
+    bool bPromoted;
+    uint32_t PreferredLane = SelectLane(HasWork, bPromoted);
+    if (PreferredLane == NumTaskPriorities)
+    {
+        return false;
+    }
+    if (TryPopWorkerLaneTask(ThreadID, PreferredLane, task))
+    {
+        if (bPromoted)
+        {
+            ++m_LaneStats[PreferredLane].m_Promoted;
+        }
+        return true;
+    }
+
+    // Another worker drained the preferred lane first, take whatever else is available
+    for (uint32_t Lane = 0; Lane < NumTaskPriorities; ++Lane)
+    {
+        if (Lane != PreferredLane && TryPopWorkerLaneTask(ThreadID, Lane, task))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+//-------------------------------------------------------------------------------------------------
+bool Scheduler::TryPopWorkerLaneTask(int ThreadID, uint32_t Lane, QueuedTask& task) noexcept
+{
+    if (m_NumWorkerTasks[Lane] == 0)
+    {
+        return false;
+    }
+
+    // Start with this worker's own queue, and then try to steal from peers
+    uint32_t OwnQueue = ThreadID % m_NumWorkerQueues;
+    for (uint32_t i = 0; i < m_NumWorkerQueues; ++i)
+    {
+        WorkerQueue& queue = m_WorkerQueues[(OwnQueue + i) % m_NumWorkerQueues];
+        std::lock_guard<std::mutex> queueLock(queue.m_Lock);
+        if (!queue.m_Tasks[Lane].empty())
+        {
+            task = std::move(queue.m_Tasks[Lane].front());
+            queue.m_Tasks[Lane].pop_front();
+            --m_NumWorkerTasks[Lane];
+            ++m_LaneStats[Lane].m_Started;
+            return true;
+        }
+    }
+    return false;
+}
+
+//-------------------------------------------------------------------------------------------------
+void Scheduler::RetireWorkerTask(QueuedTask const& task) noexcept
+{
+    std::shared_lock<std::shared_mutex> eventLock(m_EventLock);
+    RetireTaskConcurrent(task, eventLock);
+    --m_NumOutstandingWorkerTasks;
+}
+
+//-------------------------------------------------------------------------------------------------
+void Scheduler::RetireTaskConcurrent(QueuedTask const& task, std::shared_lock<std::shared_mutex> const& eventLock) noexcept
+{
+    assert(eventLock.owns_lock()); UNREFERENCED_PARAMETER(eventLock);
+    // Every entry from the one this task was submitted against up to the pseudo-end was signaled
+    // while this task was outstanding, so none of them can have reached zero yet. Entries are
+    // left in the list once they fire, and pruned when the next event is queued.
+    for (auto iter = task.m_QueuedEventsAtTimeOfTaskSubmission; iter->m_Event; ++iter)
+    {
+        if (--iter->m_RefCount == 0)
+        {
+            iter->m_Event.set();
+        }
     }
 }
 
@@ -275,69 +803,148 @@ void Scheduler::SetSchedulingModeTask(SchedulingMode mode) noexcept
     SetSchedulingModeImpl(mode, lock); // Releases lock
 }
 
-struct SetSchedulingModeTaskContext
-{
-    Scheduler* pThis;
-    SchedulingMode mode;
-};
 //-------------------------------------------------------------------------------------------------
-void __stdcall Scheduler::SetSchedulingModeTaskStatic(void* pContext)
+void Scheduler::QueueSetSchedulingModeTask(SchedulingMode mode, std::unique_lock<std::mutex> const& lock)
 {
-    std::unique_ptr<SetSchedulingModeTaskContext> spContext(static_cast<SetSchedulingModeTaskContext*>(pContext));
-    spContext->pThis->SetSchedulingModeTask(spContext->mode);
+    SetCurrentMode(mode, lock);
+    // Dropping to zero threads still needs to happen if the task gets canceled
+    m_Tasks.push_back(QueuedTask{
+        Task{ TaskFunction([this, mode]() { SetSchedulingModeTask(mode); }, mode.NumThreads == 0) },
+        m_QueuedEventsPseudoEnd }); // throw
+    m_Tasks.back().m_Sequence = m_NextSequence++;
 }
 
 //-------------------------------------------------------------------------------------------------
-void Scheduler::QueueSetSchedulingModeTask(SchedulingMode mode, std::unique_lock<std::mutex> const& lock)
+void Scheduler::SetCurrentMode(SchedulingMode mode, std::unique_lock<std::mutex> const& lock)
 {
     assert(lock.owns_lock()); UNREFERENCED_PARAMETER(lock);
+    // Work-stealing submissions read the current mode under the event lock instead of the scheduler lock
+    std::lock_guard<std::shared_mutex> eventLock(m_EventLock);
     m_CurrentMode = mode;
-    std::unique_ptr<SetSchedulingModeTaskContext> spContext(new SetSchedulingModeTaskContext{ this, mode }); // throw
-    m_Tasks.push_back(QueuedTask{
-        Task{
-            SetSchedulingModeTaskStatic,
-            mode.NumThreads == 0 ? SetSchedulingModeTaskStatic : nullptr,
-            spContext.get()
-        },
-        m_QueuedEventsPseudoEnd }); // throw
-    spContext.release();
 }
 
 //-------------------------------------------------------------------------------------------------
 void Scheduler::CancelExistingTasks() noexcept
 {
     decltype(m_Tasks) TasksToCancel;
+    decltype(m_Tasks) LaneTasksToCancel[NumTaskPriorities];
     {
         std::lock_guard<std::mutex> lock(m_Lock);
         std::swap(TasksToCancel, m_Tasks);
+        for (uint32_t Lane = 0; Lane < NumTaskPriorities; ++Lane)
+        {
+            std::swap(LaneTasksToCancel[Lane], m_LaneTasks[Lane]);
+        }
     }
 
-    for (auto& task : TasksToCancel)
+    for (uint32_t Lane = 0; Lane < NumTaskPriorities; ++Lane)
     {
-        if (task.m_Cancel)
+        m_LaneStats[Lane].m_Canceled += LaneTasksToCancel[Lane].size();
+        for (auto& task : LaneTasksToCancel[Lane])
         {
-            task.m_Cancel(task.m_pContext);
+            task.m_Function.Cancel();
+        }
+    }
+
+    for (uint32_t i = 0; i < m_NumWorkerQueues; ++i)
+    {
+        for (uint32_t Lane = 0; Lane < NumTaskPriorities; ++Lane)
+        {
+            decltype(m_Tasks) WorkerTasksToCancel;
+            {
+                WorkerQueue& queue = m_WorkerQueues[i];
+                std::lock_guard<std::mutex> queueLock(queue.m_Lock);
+                std::swap(WorkerTasksToCancel, queue.m_Tasks[Lane]);
+                m_NumWorkerTasks[Lane] -= (uint32_t)WorkerTasksToCancel.size();
+            }
+
+            m_LaneStats[Lane].m_Canceled += WorkerTasksToCancel.size();
+            for (auto& task : WorkerTasksToCancel)
+            {
+                task.m_Function.Cancel();
+                RetireWorkerTask(task);
+            }
         }
     }
+
+    // Scheduling mode changes go last, since they were only going to run once everything else was started
+    for (auto& task : TasksToCancel)
+    {
+        task.m_Function.Cancel();
+    }
+
     std::unique_lock<std::mutex> lock(m_Lock);
+    for (auto& LaneTasks : LaneTasksToCancel)
+    {
+        for (auto& task : LaneTasks)
+        {
+            RetireTask(task, lock);
+        }
+    }
     for (auto& task : TasksToCancel)
     {
         RetireTask(task, lock);
     }
 }
 
+//-------------------------------------------------------------------------------------------------
+void Scheduler::CancelStrand(StrandKey key) noexcept
+{
+    assert(key != NoStrand);
+    std::unique_lock<std::mutex> lock(m_Lock);
+    while (true)
+    {
+        // Cancel one task at a time, since the cancel callbacks can't run under the lock
+        bool bFoundTask = false;
+        for (auto& LaneTasks : m_LaneTasks)
+        {
+            auto iter = std::find_if(LaneTasks.begin(), LaneTasks.end(),
+                [key](QueuedTask const& t) { return t.m_Strand == key; });
+            if (iter != LaneTasks.end())
+            {
+                QueuedTask task = std::move(*iter);
+                LaneTasks.erase(iter);
+                ++m_LaneStats[(uint32_t)task.m_Priority].m_Canceled;
+
+                lock.unlock();
+                task.m_Function.Cancel();
+                lock.lock();
+
+                RetireTask(task, lock);
+                bFoundTask = true;
+                break;
+            }
+        }
+        if (bFoundTask)
+        {
+            continue;
+        }
+
+        if (!IsStrandRunning(key, lock))
+        {
+            return;
+        }
+
+        // The running task may queue more work on this strand, so check again once it's done
+        ++m_NumStrandWaiters;
+        m_StrandCV.wait(lock);
+        --m_NumStrandWaiters;
+    }
+}
+
 //-------------------------------------------------------------------------------------------------
 void Scheduler::Shutdown() noexcept
 {
     {
         std::lock_guard<std::mutex> lock(m_Lock);
+        std::lock_guard<std::shared_mutex> eventLock(m_EventLock);
         m_bShutdown = true;
     }
 
     CancelExistingTasks();
 
     std::unique_lock<std::mutex> lock(m_Lock);
-    m_CurrentMode = { 0, Priority::Idle };
+    SetCurrentMode({ 0, Priority::Idle }, lock);
     SetSchedulingModeImpl(m_CurrentMode, lock); // Releases lock
     assert(m_Threads.empty());
 
@@ -350,7 +957,7 @@ void Scheduler::Shutdown() noexcept
     // won't modify this - they're already past the point where that's possible.
     for (auto& t : m_ExitingThreads)
     {
-        if (t.get_id() != std::this_thread::get_id())
+        if (t.joinable() && t.get_id() != std::this_thread::get_id())
         {
             t.join();
         }
@@ -361,6 +968,13 @@ void Scheduler::Shutdown() noexcept
 void Scheduler::RetireTask(QueuedTask const& task, std::unique_lock<std::mutex> const& lock) noexcept
 {
     assert(lock.owns_lock()); UNREFERENCED_PARAMETER(lock);
+    if (m_DispatchMode == DispatchMode::WorkStealing)
+    {
+        std::shared_lock<std::shared_mutex> eventLock(m_EventLock);
+        RetireTaskConcurrent(task, eventLock);
+        return;
+    }
+
     for (auto iter = task.m_QueuedEventsAtTimeOfTaskSubmission; iter->m_Event;)
     {
         int refcount = --iter->m_RefCount;
@@ -3,13 +3,20 @@
 #pragma once
 
 #include <vector>
-#include <deque>
+#include <iterator>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <algorithm>
 #include <list>
 #include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include <type_traits>
+#include <utility>
+#include <new>
+#include <cstddef>
+#include <chrono>
 
 #ifndef WIN32_LEAN_AND_MEAN
 #define WIN32_LEAN_AND_MEAN
@@ -24,6 +31,36 @@
 namespace BackgroundTaskScheduler
 {
     enum class Priority { Idle, Normal };
+
+    // SharedQueue: all tasks go through a single FIFO guarded by the scheduler lock.
+    // WorkStealing: tasks are spread across per-worker queues, and idle workers steal
+    // from their peers. Ordering is only FIFO when the scheduler has a single thread.
+    enum class DispatchMode { SharedQueue, WorkStealing };
+
+    // Tasks are started in priority order, so work that something is blocked on can jump ahead
+    // of long-running work that nothing is waiting for yet. To avoid starving the lower lanes,
+    // a lane that has waiting tasks is serviced once it has been passed over StarvationLimit times.
+    enum class TaskPriority { Critical, Normal, Background };
+    constexpr uint32_t NumTaskPriorities = 3;
+    constexpr uint32_t StarvationLimit = 16;
+
+    // Tasks that share a strand key start one at a time, in the order they were submitted, while
+    // tasks from different strands can run in parallel on the same threads. This gives ordering
+    // without dedicating a thread to it. Strands are only supported in shared-queue mode, and
+    // all tasks in a strand are expected to use the same priority.
+    using StrandKey = uint64_t;
+    constexpr StrandKey NoStrand = 0;
+
+    struct LaneCounters
+    {
+        uint64_t Submitted;
+        uint64_t Started;
+        uint64_t Completed;
+        // Tasks that were refused at submission, or canceled before they started.
+        uint64_t Canceled;
+        // Tasks that were started ahead of higher priority work to prevent starvation.
+        uint64_t Promoted;
+    };
     struct SchedulingMode
     {
         uint32_t NumThreads;
@@ -33,12 +70,228 @@ namespace BackgroundTaskScheduler
         bool operator>(SchedulingMode const& b) { return NumThreads > b.NumThreads || (int)ThreadPriority > (int)b.ThreadPriority; }
     };
 
+    // A move-only callable that's run at most once. Closures up to InlineSize bytes are stored
+    // inline, so queueing one doesn't need a heap allocation; larger ones fall back to the heap.
+    // When a task is canceled, the closure is destroyed without running, unless it was created
+    // with bRunOnCancel.
+    class TaskFunction
+    {
+    public:
+        static constexpr size_t InlineSize = 64;
+
+        TaskFunction() noexcept = default;
+        template <typename Fn, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Fn>, TaskFunction>>>
+        TaskFunction(Fn&& fn, bool bRunOnCancel = false)
+            : m_bRunOnCancel(bRunOnCancel)
+        {
+            using Closure = std::decay_t<Fn>;
+            if constexpr (IsInline<Closure>())
+            {
+                new (m_Storage) Closure(std::forward<Fn>(fn));
+                m_pOps = &InlineOps<Closure>;
+            }
+            else
+            {
+                *reinterpret_cast<Closure**>(m_Storage) = new Closure(std::forward<Fn>(fn)); // throw( bad_alloc )
+                m_pOps = &HeapOps<Closure>;
+            }
+        }
+        TaskFunction(TaskFunction&& o) noexcept { *this = std::move(o); }
+        TaskFunction& operator=(TaskFunction&& o) noexcept
+        {
+            if (this != &o)
+            {
+                Reset();
+                if (o.m_pOps)
+                {
+                    o.m_pOps->m_Move(m_Storage, o.m_Storage);
+                }
+                m_pOps = std::exchange(o.m_pOps, nullptr);
+                m_bRunOnCancel = o.m_bRunOnCancel;
+            }
+            return *this;
+        }
+        ~TaskFunction() { Reset(); }
+
+        explicit operator bool() const noexcept { return m_pOps != nullptr; }
+
+        // Invokes the closure and then destroys it.
+        void Run()
+        {
+            auto cleanup = Cleanup{ this };
+            m_pOps->m_Invoke(m_Storage);
+        }
+        void Cancel()
+        {
+            if (m_bRunOnCancel && m_pOps)
+            {
+                Run();
+            }
+            Reset();
+        }
+        void Reset() noexcept
+        {
+            if (m_pOps)
+            {
+                std::exchange(m_pOps, nullptr)->m_Destroy(m_Storage);
+            }
+        }
+
+    private:
+        struct Ops
+        {
+            void (*m_Invoke)(void* pStorage);
+            // Move-constructs into pDst and destroys pSrc.
+            void (*m_Move)(void* pDst, void* pSrc) noexcept;
+            void (*m_Destroy)(void* pStorage) noexcept;
+        };
+        struct Cleanup
+        {
+            TaskFunction* m_pThis;
+            ~Cleanup() { m_pThis->Reset(); }
+        };
+
+        template <typename Closure> static constexpr bool IsInline()
+        {
+            return sizeof(Closure) <= InlineSize &&
+                alignof(Closure) <= alignof(std::max_align_t) &&
+                std::is_nothrow_move_constructible_v<Closure>;
+        }
+        template <typename Closure> static constexpr Ops InlineOps = {
+            [](void* pStorage) { (*static_cast<Closure*>(pStorage))(); },
+            [](void* pDst, void* pSrc) noexcept
+            {
+                new (pDst) Closure(std::move(*static_cast<Closure*>(pSrc)));
+                static_cast<Closure*>(pSrc)->~Closure();
+            },
+            [](void* pStorage) noexcept { static_cast<Closure*>(pStorage)->~Closure(); }
+        };
+        template <typename Closure> static constexpr Ops HeapOps = {
+            [](void* pStorage) { (**static_cast<Closure**>(pStorage))(); },
+            [](void* pDst, void* pSrc) noexcept { *static_cast<Closure**>(pDst) = *static_cast<Closure**>(pSrc); },
+            [](void* pStorage) noexcept { delete *static_cast<Closure**>(pStorage); }
+        };
+
+        alignas(std::max_align_t) unsigned char m_Storage[InlineSize];
+        Ops const* m_pOps = nullptr;
+        bool m_bRunOnCancel = false;
+    };
+
+    // A FIFO stored in a ring buffer that only grows, so once it has reached its working size,
+    // queueing and dequeueing don't allocate. (std::deque allocates a block per element for
+    // elements as large as a task on some implementations.)
+    template <typename T> class TaskQueue
+    {
+    public:
+        class iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = T*;
+            using reference = T&;
+
+            iterator() noexcept = default;
+            iterator(TaskQueue* pQueue, size_t Index) noexcept : m_pQueue(pQueue), m_Index(Index) {}
+            T& operator*() const noexcept { return m_pQueue->at(m_Index); }
+            T* operator->() const noexcept { return &m_pQueue->at(m_Index); }
+            iterator& operator++() noexcept { ++m_Index; return *this; }
+            iterator operator++(int) noexcept { iterator ret = *this; ++m_Index; return ret; }
+            bool operator==(iterator const& o) const noexcept { return m_Index == o.m_Index; }
+            bool operator!=(iterator const& o) const noexcept { return m_Index != o.m_Index; }
+
+        private:
+            friend class TaskQueue;
+            TaskQueue* m_pQueue = nullptr;
+            size_t m_Index = 0;
+        };
+
+        TaskQueue() = default;
+        TaskQueue(TaskQueue&& o) noexcept { swap(o); }
+        TaskQueue& operator=(TaskQueue&& o) noexcept { TaskQueue(std::move(o)).swap(*this); return *this; }
+        void swap(TaskQueue& o) noexcept
+        {
+            m_Storage.swap(o.m_Storage);
+            std::swap(m_Head, o.m_Head);
+            std::swap(m_Size, o.m_Size);
+        }
+        friend void swap(TaskQueue& a, TaskQueue& b) noexcept { a.swap(b); }
+
+        bool empty() const noexcept { return m_Size == 0; }
+        size_t size() const noexcept { return m_Size; }
+        iterator begin() noexcept { return { this, 0 }; }
+        iterator end() noexcept { return { this, m_Size }; }
+        T& front() noexcept { return at(0); }
+        T const& front() const noexcept { return at(0); }
+        T& back() noexcept { return at(m_Size - 1); }
+
+        void push_back(T&& value)
+        {
+            if (m_Size == m_Storage.size())
+            {
+                Grow(); // throw( bad_alloc )
+            }
+            at(m_Size) = std::move(value);
+            ++m_Size;
+        }
+        void pop_front() noexcept
+        {
+            front() = T{};
+            m_Head = (m_Head + 1) % m_Storage.size();
+            --m_Size;
+        }
+        void pop_back() noexcept
+        {
+            back() = T{};
+            --m_Size;
+        }
+        // Shifts whichever side of the erased element is shorter, so erasing the front is O(1).
+        iterator erase(iterator it) noexcept
+        {
+            if (it.m_Index < m_Size / 2)
+            {
+                for (size_t i = it.m_Index; i > 0; --i)
+                {
+                    at(i) = std::move(at(i - 1));
+                }
+                pop_front();
+            }
+            else
+            {
+                for (size_t i = it.m_Index; i + 1 < m_Size; ++i)
+                {
+                    at(i) = std::move(at(i + 1));
+                }
+                pop_back();
+            }
+            return it;
+        }
+
+    private:
+        T& at(size_t Index) noexcept { return m_Storage[(m_Head + Index) % m_Storage.size()]; }
+        T const& at(size_t Index) const noexcept { return m_Storage[(m_Head + Index) % m_Storage.size()]; }
+        void Grow()
+        {
+            std::vector<T> NewStorage(std::max<size_t>(m_Storage.size() * 2, 16)); // throw( bad_alloc )
+            for (size_t i = 0; i < m_Size; ++i)
+            {
+                NewStorage[i] = std::move(at(i));
+            }
+            m_Storage.swap(NewStorage);
+            m_Head = 0;
+        }
+
+        std::vector<T> m_Storage;
+        size_t m_Head = 0;
+        size_t m_Size = 0;
+    };
+
     struct Task
     {
-        using FnType = void(APIENTRY*)(void* pContext);
-        FnType m_Callback;
-        FnType m_Cancel;
-        void* m_pContext;
+        TaskFunction m_Function;
+        TaskPriority m_Priority = TaskPriority::Normal;
+        StrandKey m_Strand = NoStrand;
     };
 
     class Scheduler
@@ -55,21 +308,28 @@ namespace BackgroundTaskScheduler
         struct QueuedTask : Task
         {
             std::list<QueuedEventSignal>::iterator m_QueuedEventsAtTimeOfTaskSubmission;
+            // Order of submission across the lanes and the mode changes, in shared-queue mode
+            uint64_t m_Sequence = 0;
             QueuedTask() = default;
-            QueuedTask(Task const& t, decltype(m_QueuedEventsAtTimeOfTaskSubmission) iter)
-                : Task(t), m_QueuedEventsAtTimeOfTaskSubmission(iter)
+            QueuedTask(Task&& t, decltype(m_QueuedEventsAtTimeOfTaskSubmission) iter)
+                : Task(std::move(t)), m_QueuedEventsAtTimeOfTaskSubmission(iter)
             {
             }
-            QueuedTask(QueuedTask const&) = default;
             QueuedTask(QueuedTask&&) = default;
-            QueuedTask& operator=(QueuedTask const&) = default;
             QueuedTask& operator=(QueuedTask&&) = default;
         };
 
-        // These are the tasks that are waiting for a thread to consume them.
-        std::deque<QueuedTask> m_Tasks;
+        // These are the scheduling mode changes that are waiting for a thread to consume them.
+        // In shared-queue mode, one is picked up once every lane task queued before it has been started,
+        // and lane tasks queued after it wait until it's been applied. In work-stealing mode, once there's nothing else to start.
+        TaskQueue<QueuedTask> m_Tasks;
+        uint64_t m_NextSequence = 0;
+        bool m_bApplyingModeChange = false;
+        // These are the tasks that are waiting for a thread to consume them in shared-queue mode,
+        // with one FIFO per priority.
+        TaskQueue<QueuedTask> m_LaneTasks[NumTaskPriorities];
         // This is a counter of how many tasks are currently being processed by
-        // worker threads. Adding this to the size of m_Tasks enables determining
+        // worker threads. Adding this to the number of queued tasks enables determining
         // the total number of currently not-completed tasks.
         uint32_t m_TasksInProgress = 0;
         std::vector<std::thread> m_Threads;
@@ -77,30 +337,111 @@ namespace BackgroundTaskScheduler
         mutable std::mutex m_Lock;
         std::condition_variable m_CV;
 
+        // Strands that currently have a task running. There's capacity reserved for one per thread.
+        std::vector<StrandKey> m_RunningStrands;
+        std::condition_variable m_StrandCV;
+        uint32_t m_NumStrandWaiters = 0;
+
         SchedulingMode m_CurrentMode = { 0, Priority::Idle };
         SchedulingMode m_EffectiveMode = { 0, Priority::Idle };
         bool m_bShutdown = false;
+        // Threads that are waiting for work, in either dispatch mode.
+        std::atomic<uint32_t> m_NumSleepingWorkers = 0;
+
+        // Autoscaling state. While tasks are waiting and no thread is idle to take them, a thread is
+        // added, up to m_AutoScaleMaxThreads. A thread that has been idle for m_AutoScaleIdleTimeout
+        // exits, down to the thread count that was last requested through SetSchedulingMode.
+        // Zero means autoscaling is disabled. The other settings are guarded by m_Lock.
+        std::atomic<uint32_t> m_AutoScaleMaxThreads = 0;
+        std::chrono::milliseconds m_AutoScaleIdleTimeout{};
+        uint32_t m_RequestedNumThreads = 0;
+
+        // Work-stealing state. Each worker owns the queue at (ThreadID % m_NumWorkerQueues),
+        // and tasks submitted from outside of the pool are distributed round-robin.
+        // Pushing or popping only takes the lock of the queue being touched; the scheduler
+        // lock is only needed to put a worker to sleep or to wake one up.
+        struct WorkerQueue
+        {
+            std::mutex m_Lock;
+            TaskQueue<QueuedTask> m_Tasks[NumTaskPriorities];
+        };
+        const DispatchMode m_DispatchMode;
+        const uint32_t m_NumWorkerQueues;
+        std::unique_ptr<WorkerQueue[]> m_WorkerQueues;
+        std::atomic<uint32_t> m_NextWorkerQueue = 0;
+        // Tasks sitting in worker queues, waiting to be picked up, per priority.
+        std::atomic<uint32_t> m_NumWorkerTasks[NumTaskPriorities] = {};
+        // Tasks that have been put into worker queues and not yet retired.
+        std::atomic<uint32_t> m_NumOutstandingWorkerTasks = 0;
+        std::atomic<uint32_t> m_EffectiveNumThreads = 0;
+        // Guards m_QueuedEventsPseudoEnd and the m_QueuedEvents list structure in work-stealing mode.
+        // Shared by submitting and retiring threads, exclusive when queueing event signals or
+        // when changing whether tasks are accepted. Ordered after m_Lock.
+        std::shared_mutex m_EventLock;
+
+        struct LaneStats
+        {
+            std::atomic<uint64_t> m_Submitted = 0;
+            std::atomic<uint64_t> m_Started = 0;
+            std::atomic<uint64_t> m_Completed = 0;
+            std::atomic<uint64_t> m_Canceled = 0;
+            std::atomic<uint64_t> m_Promoted = 0;
+            // How many times a task from a higher lane was started while this lane had work.
+            std::atomic<uint32_t> m_PassedOver = 0;
+        };
+        LaneStats m_LaneStats[NumTaskPriorities];
+
+        // Picks the lane to start a task from, or NumTaskPriorities if none have work.
+        uint32_t SelectLane(bool const (&HasWork)[NumTaskPriorities], bool& bPromoted) noexcept;
+        uint32_t GetNumWorkerTasks() const noexcept;
 
         // These methods require the lock to be held.
         // Const-ref methods just require it, non-const-ref methods may release it.
-        bool IsSchedulerIdle(std::unique_lock<std::mutex> const&) const noexcept { return m_Tasks.empty() && m_TasksInProgress == 0; }
+        size_t GetNumQueuedTasks(std::unique_lock<std::mutex> const&) const noexcept;
+        bool IsSchedulerIdle(std::unique_lock<std::mutex> const& lock) const noexcept
+        {
+            return GetNumQueuedTasks(lock) == 0 && m_TasksInProgress == 0 && m_NumOutstandingWorkerTasks == 0;
+        }
+        // Only starts tasks that were queued before the next mode change.
+        bool TryPopLaneTask(QueuedTask& task, std::unique_lock<std::mutex> const&) noexcept;
+        bool IsModeChangeRunnable(std::unique_lock<std::mutex> const&) const noexcept;
+        bool IsStrandRunning(StrandKey key, std::unique_lock<std::mutex> const&) const noexcept;
+        void ReleaseStrand(StrandKey key, std::unique_lock<std::mutex> const&) noexcept;
         void SetSchedulingModeImpl(SchedulingMode mode, std::unique_lock<std::mutex>& lock); // Releases lock
         void QueueSetSchedulingModeTask(SchedulingMode mode, std::unique_lock<std::mutex> const&);
+        void SetCurrentMode(SchedulingMode mode, std::unique_lock<std::mutex> const&);
         void RetireTask(QueuedTask const& task, std::unique_lock<std::mutex> const&) noexcept;
+        void GrowForBacklog(size_t Backlog, std::unique_lock<std::mutex>& lock) noexcept; // May release lock
+        // Returns true if the thread should exit, in which case the lock has been released.
+        bool WaitForWork(int ThreadID, std::unique_lock<std::mutex>& lock) noexcept;
 
         // These methods will take the lock.
         void SetSchedulingModeTask(SchedulingMode mode) noexcept;
-        static void __stdcall SetSchedulingModeTaskStatic(void* pContext);
         void TaskThread(int ThreadID) noexcept;
 
+        // Work-stealing helpers, which don't require the scheduler lock.
+        bool QueueWorkerTask(Task& task);
+        bool TryPopWorkerTask(int ThreadID, QueuedTask& task) noexcept;
+        bool TryPopWorkerLaneTask(int ThreadID, uint32_t Lane, QueuedTask& task) noexcept;
+        void RetireWorkerTask(QueuedTask const& task) noexcept;
+        void RetireTaskConcurrent(QueuedTask const& task, std::shared_lock<std::shared_mutex> const&) noexcept;
+        void WorkStealingTaskThread(int ThreadID) noexcept;
+
     public:
-        Scheduler();
+        Scheduler(DispatchMode dispatchMode = DispatchMode::SharedQueue);
         ~Scheduler() { Shutdown(); }
 
         void SetSchedulingMode(SchedulingMode mode);
+        // Lets the scheduler add threads beyond the requested count, up to MaxThreads, while tasks
+        // are backing up, and drop back down once the extra threads have been idle for IdleTimeout.
+        void EnableAutoScaling(uint32_t MaxThreads, std::chrono::milliseconds IdleTimeout);
         void QueueTask(Task task);
         void SignalEventOnCompletionOfCurrentTasks(XPlatHelpers::Event hEvent, SchedulingMode modeAfterSignal);
         void CancelExistingTasks() noexcept;
+        // Cancels the strand's tasks which haven't started, and waits for a running one to finish.
+        // Must not be called from a task in the strand.
+        void CancelStrand(StrandKey key) noexcept;
+        static StrandKey CreateStrandKey() noexcept;
         void Shutdown() noexcept;
 
         SchedulingMode GetCurrentMode() const
@@ -113,5 +454,7 @@ namespace BackgroundTaskScheduler
             std::lock_guard<std::mutex> lock(m_Lock);
             return m_EffectiveMode;
         }
+        DispatchMode GetDispatchMode() const noexcept { return m_DispatchMode; }
+        LaneCounters GetLaneCounters(TaskPriority priority) const noexcept;
     };
 }
\ No newline at end of file
@@ -0,0 +1,119 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#ifndef assert
+#include <assert.h>
+#endif
+
+// A vector which stores up to InlineCapacity elements inside the object itself, and only
+// goes to the heap once it grows past that. Only the subset of the std::vector interface
+// that's actually needed is implemented. Elements must be nothrow-move-constructible.
+template <typename T, size_t InlineCapacity>
+class SmallVector
+{
+    static_assert(InlineCapacity > 0);
+    static_assert(std::is_nothrow_move_constructible_v<T>);
+
+public:
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = T const*;
+
+    SmallVector() noexcept = default;
+    ~SmallVector()
+    {
+        clear();
+        if (!IsInline())
+        {
+            ::operator delete(m_Data);
+        }
+    }
+    SmallVector(SmallVector const&) = delete;
+    SmallVector& operator=(SmallVector const&) = delete;
+
+    iterator begin() noexcept { return m_Data; }
+    iterator end() noexcept { return m_Data + m_Size; }
+    const_iterator begin() const noexcept { return m_Data; }
+    const_iterator end() const noexcept { return m_Data + m_Size; }
+    size_t size() const noexcept { return m_Size; }
+    bool empty() const noexcept { return m_Size == 0; }
+    T& operator[](size_t i) noexcept { assert(i < m_Size); return m_Data[i]; }
+    T const& operator[](size_t i) const noexcept { assert(i < m_Size); return m_Data[i]; }
+
+    void reserve(size_t Capacity)
+    {
+        if (Capacity <= m_Capacity)
+        {
+            return;
+        }
+        T* NewData = static_cast<T*>(::operator new(Capacity * sizeof(T)));
+        for (size_t i = 0; i < m_Size; ++i)
+        {
+            new (NewData + i) T(std::move(m_Data[i]));
+            m_Data[i].~T();
+        }
+        if (!IsInline())
+        {
+            ::operator delete(m_Data);
+        }
+        m_Data = NewData;
+        m_Capacity = Capacity;
+    }
+
+    template <typename... TArgs>
+    T& emplace_back(TArgs&&... args)
+    {
+        if (m_Size == m_Capacity)
+        {
+            // Construct first in case args alias an existing element.
+            T Temp(std::forward<TArgs>(args)...);
+            reserve(m_Capacity * 2);
+            return *new (m_Data + m_Size++) T(std::move(Temp));
+        }
+        return *new (m_Data + m_Size++) T(std::forward<TArgs>(args)...);
+    }
+    void push_back(T const& t) { emplace_back(t); }
+    void push_back(T&& t) { emplace_back(std::move(t)); }
+
+    iterator erase(iterator first, iterator last) noexcept
+    {
+        assert(first >= begin() && first <= last && last <= end());
+        if (first == last)
+        {
+            return first;
+        }
+        iterator newEnd = std::move(last, end(), first);
+        for (iterator i = newEnd; i != end(); ++i)
+        {
+            i->~T();
+        }
+        m_Size = newEnd - m_Data;
+        return first;
+    }
+    iterator erase(iterator pos) noexcept { return erase(pos, pos + 1); }
+
+    // Destroys the elements but keeps any heap storage for reuse.
+    void clear() noexcept
+    {
+        for (size_t i = 0; i < m_Size; ++i)
+        {
+            m_Data[i].~T();
+        }
+        m_Size = 0;
+    }
+
+private:
+    bool IsInline() const noexcept { return m_Data == reinterpret_cast<T const*>(m_Inline); }
+
+    T* m_Data = reinterpret_cast<T*>(m_Inline);
+    size_t m_Size = 0;
+    size_t m_Capacity = InlineCapacity;
+    alignas(T) unsigned char m_Inline[sizeof(T) * InlineCapacity];
+};
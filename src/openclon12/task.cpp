@@ -33,7 +33,7 @@ clWaitForEvents(cl_uint             num_events,
     {
         // Flush pass
         {
-            auto Lock = g_Platform->GetTaskPoolLock();
+            auto Lock = context.GetTaskPoolLock();
             for (cl_uint i = 0; i < num_events; ++i)
             {
                 Task* t = static_cast<Task*>(event_list[i]);
@@ -87,7 +87,7 @@ clGetEventInfo(cl_event         event,
     case CL_EVENT_COMMAND_TYPE: return RetValue(task.m_CommandType);
     case CL_EVENT_COMMAND_EXECUTION_STATUS:
     {
-        auto Lock = g_Platform->GetTaskPoolLock();
+        auto Lock = context.GetTaskPoolLock();
         auto state = task.GetState();
         if (state == Task::State::Ready)
             state = Task::State::Submitted;
@@ -112,7 +112,7 @@ clCreateUserEvent(cl_context    context_,
     try
     {
         if (errcode_ret) *errcode_ret = CL_SUCCESS;
-        return new UserEvent(context);
+        return new (context) UserEvent(context);
     }
     catch (std::bad_alloc &) { return ReportError(nullptr, CL_OUT_OF_HOST_MEMORY); }
     catch (std::exception &e) { return ReportError(e.what(), CL_OUT_OF_RESOURCES); }
@@ -176,12 +176,9 @@ clSetUserEventStatus(cl_event   event,
     try
     {
         UserEvent& e = static_cast<UserEvent&>(task);
-        auto Lock = g_Platform->GetTaskPoolLock();
+        auto Lock = context.GetTaskPoolLock();
         e.Complete(execution_status, Lock);
-        for (cl_uint i = 0; i < context.GetDeviceCount(); ++i)
-        {
-            context.GetD3DDevice(i).Flush(Lock);
-        }
+        context.FlushAllDevices(Lock);
     }
     catch (std::bad_alloc &) { return ReportError(nullptr, CL_OUT_OF_HOST_MEMORY); }
     catch (std::exception &e) { return ReportError(e.what(), CL_OUT_OF_RESOURCES); }
@@ -291,9 +288,9 @@ clEnqueueMarkerWithWaitList(cl_command_queue  command_queue,
 
     try
     {
-        std::unique_ptr<Task> task(new DummyTask(context, CL_COMMAND_MARKER, command_queue));
+        std::unique_ptr<Task> task(new (context) DummyTask(context, CL_COMMAND_MARKER, command_queue));
 
-        auto Lock = g_Platform->GetTaskPoolLock();
+        auto Lock = context.GetTaskPoolLock();
         if (num_events_in_wait_list)
         {
             task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
@@ -347,9 +344,9 @@ clEnqueueBarrierWithWaitList(cl_command_queue  command_queue,
 
     try
     {
-        std::unique_ptr<Task> task(new DummyTask(context, CL_COMMAND_BARRIER, command_queue));
+        std::unique_ptr<Task> task(new (context) DummyTask(context, CL_COMMAND_BARRIER, command_queue));
 
-        auto Lock = g_Platform->GetTaskPoolLock();
+        auto Lock = context.GetTaskPoolLock();
         if (num_events_in_wait_list)
         {
             task->AddDependencies(event_wait_list, num_events_in_wait_list, Lock);
@@ -500,9 +497,13 @@ void Task::AddDependencies(const cl_event* event_wait_list, cl_uint num_events_i
                     task->GetState() == Task::State::Queued ||
                     task->GetState() == Task::State::Submitted)
                 {
-                    auto insertRet = task->m_TasksWaitingOnThis.insert(this);
-                    if (insertRet.second)
+                    // The two lists mirror each other until this task is submitted, so checking the
+                    // (short) list on this side is enough to skip duplicates.
+                    if (std::find_if(m_TasksToWaitOn.begin(), m_TasksToWaitOn.end(),
+                            [task](ref_ptr_int const& p) { return p.Get() == task; }) == m_TasksToWaitOn.end())
                     {
+                        task->m_TasksWaitingOnThis.emplace_back(this);
+                        // Can't throw, capacity was reserved above
                         m_TasksToWaitOn.emplace_back(task);
                     }
                 }
@@ -524,7 +525,26 @@ void Task::AddDependencies(const cl_event* event_wait_list, cl_uint num_events_i
 
 cl_int Task::WaitForCompletion()
 {
-    m_CompletionFuture.wait();
+    // Blocking calls are usually made right after a flush, and small tasks can finish quickly,
+    // so spin for a bit before paying for a sleep and a wake.
+    constexpr uint32_t SpinCount = 1024;
+    uint32_t State = m_CompletionState.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < SpinCount && State != Completed; ++i)
+    {
+        YieldProcessor();
+        State = m_CompletionState.load(std::memory_order_acquire);
+    }
+
+    while (State != Completed)
+    {
+        if (State == Pending &&
+            !m_CompletionState.compare_exchange_weak(State, PendingWithWaiters, std::memory_order_acquire))
+        {
+            continue;
+        }
+        XPlatHelpers::WaitOnAddress(m_CompletionState, PendingWithWaiters);
+        State = m_CompletionState.load(std::memory_order_acquire);
+    }
     return (cl_int)m_State;
 }
 
@@ -534,7 +554,7 @@ void Task::RegisterCallback(cl_int command_exec_callback_type, NotificationReque
     bool bCallNotification = false;
     cl_int StateToSend = 0;
     {
-        auto Lock = g_Platform->GetTaskPoolLock();
+        auto Lock = m_Parent->GetTaskPoolLock();
         if ((cl_int)GetState() <= command_exec_callback_type)
         {
             bCallNotification = true;
@@ -588,12 +608,14 @@ void Task::Ready(TaskPoolLock const& lock)
         assert(newEnd != task->m_TasksToWaitOn.end());
         task->m_TasksToWaitOn.erase(newEnd, task->m_TasksToWaitOn.end());
 
-        if (task->m_TasksToWaitOn.empty() &&
+        if (!task->HasUnmetDependencies() &&
             task->m_State == State::Submitted)
         {
             task->m_D3DDevice->ReadyTask(task.Get(), lock);
         }
     }
+
+    LeaveQueueEpoch(CL_SUCCESS, lock);
 }
 
 void Task::Started(TaskPoolLock const &)
@@ -668,7 +690,7 @@ void Task::Complete(cl_int error, TaskPoolLock const& lock)
 
             task->m_TasksToWaitOn.erase(newEnd, task->m_TasksToWaitOn.end());
 
-            if (task->m_TasksToWaitOn.empty() &&
+            if (!task->HasUnmetDependencies() &&
                 task->m_State == State::Submitted)
             {
                 task->m_D3DDevice->ReadyTask(task.Get(), lock);
@@ -676,9 +698,53 @@ void Task::Complete(cl_int error, TaskPoolLock const& lock)
         }
     }
 
+    LeaveQueueEpoch(error, lock);
+    if (m_ClosedEpoch)
+    {
+        // Failed before the epoch it was waiting on drained
+        m_ClosedEpoch->m_Waiter = nullptr;
+        m_ClosedEpoch.reset();
+    }
+
     m_TasksToWaitOn.clear();
     m_TasksWaitingOnThis.clear();
-    m_CompletionPromise.set_value();
+    if (m_CompletionState.exchange(Completed, std::memory_order_release) == PendingWithWaiters)
+    {
+        XPlatHelpers::WakeByAddressAll(m_CompletionState);
+    }
+}
+
+void Task::LeaveQueueEpoch(cl_int error, TaskPoolLock const& lock)
+{
+    if (!m_QueueEpoch)
+    {
+        return;
+    }
+    std::shared_ptr<QueueEpoch> Epoch = std::move(m_QueueEpoch);
+    --Epoch->m_PendingTasks;
+
+    Task* Waiter = Epoch->m_Waiter;
+    if (!Waiter)
+    {
+        return;
+    }
+    if (error < 0)
+    {
+        // Same as a failed explicit dependency
+        if (Waiter->m_State >= State::Running)
+        {
+            Waiter->Complete(error, lock);
+        }
+    }
+    else if (Epoch->m_PendingTasks == 0)
+    {
+        Waiter->m_ClosedEpoch.reset();
+        if (!Waiter->HasUnmetDependencies() &&
+            Waiter->m_State == State::Submitted)
+        {
+            Waiter->m_D3DDevice->ReadyTask(Waiter, lock);
+        }
+    }
 }
 
 void Task::FireNotification(NotificationRequest const& callback, cl_int state)
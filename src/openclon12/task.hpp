@@ -3,8 +3,9 @@
 #pragma once
 #include "platform.hpp"
 #include "context.hpp"
+#include "smallvector.hpp"
 #include <mutex>
-#include <future>
+#include <atomic>
 
 #include "Query.hpp"
 
@@ -66,6 +67,15 @@
 // --- Then, all tasks that were part of that command list are marked complete. This enables new tasks to be marked ready.
 // --- If there are any newly ready tasks, then another worker thread work item is created to execute those.
 
+// Tasks queued on an out-of-order queue between two markers or barriers form an epoch. The marker
+// or barrier that closes an epoch waits for the epoch's tasks to become ready, rather than taking
+// a dependency on each of them.
+struct QueueEpoch
+{
+    uint32_t m_PendingTasks = 0;
+    class Task* m_Waiter = nullptr;
+};
+
 class Task : public CLChildBase<Task, Context, cl_event>
 {
     struct NotificationRequest
@@ -78,6 +88,7 @@ class Task : public CLChildBase<Task, Context, cl_event>
 public:
     struct DependencyException {};
     friend class D3DDevice;
+    friend class CommandQueue;
     enum class State
     {
         // API-visible states (sorted in reverse order so CL_COMPLETE == CL_SUCCESS == 0)
@@ -92,6 +103,7 @@ public:
 
     void Record();
     State GetState() const { return m_State; }
+    bool HasUnmetDependencies() const { return !m_TasksToWaitOn.empty() || m_ClosedEpoch; }
     cl_ulong& GetTimestamp(cl_profiling_info timestampType);
 
     void AddDependencies(const cl_event* event_wait_list, cl_uint num_events_in_wait_list, TaskPoolLock const&);
@@ -107,6 +119,11 @@ public:
     Task(Context& Parent, D3DDevice& device);
     virtual ~Task();
 
+    // Tasks are allocated from their context's pool: new (context) SomeTask(context, ...)
+    static void* operator new(size_t Size, Context& Parent) { return Parent.GetTaskAllocator().Allocate(Size); }
+    static void operator delete(void* p, Context&) noexcept { TaskAllocator::Free(p); }
+    static void operator delete(void* p) noexcept { TaskAllocator::Free(p); }
+
     static cl_ulong TimestampToNanoseconds(cl_ulong Ticks, cl_ulong Frequency);
     static cl_ulong TimestampFromQPC();
 
@@ -115,25 +132,43 @@ protected:
     void Ready(TaskPoolLock const&);
     void Started(TaskPoolLock const&);
     void Complete(cl_int error, TaskPoolLock const&);
+    void LeaveQueueEpoch(cl_int error, TaskPoolLock const&);
 
     virtual void MigrateResources() = 0;
     virtual void RecordImpl() = 0;
     virtual void OnComplete() { }
+    // Called on the device's completion thread once the GPU work is done, before the task lock is taken
+    // to complete it. For CPU work that would otherwise hold up everything else waiting on that lock.
+    // The next submission may be recording at the same time, so this can't use the immediate context.
+    virtual void OnGPUWorkComplete() { }
 
     void FireNotification(NotificationRequest const& callback, cl_int state);
     void FireNotifications();
 
-    // State changes can only be made while holding the task pool lock
+    // State changes can only be made while holding the parent context's task pool lock
     State m_State = State::Queued;
     cl_ulong m_ProfilingTimestamps[4] = {};
 
-    std::vector<ref_ptr_int> m_TasksToWaitOn;
-    std::set<ref_ptr_int> m_TasksWaitingOnThis;
+    // Most tasks have at most their in-order predecessor and a barrier or marker on either side
+    SmallVector<ref_ptr_int, 2> m_TasksToWaitOn;
+    SmallVector<ref_ptr_int, 2> m_TasksWaitingOnThis;
+
+    // Owned by m_CommandQueue: which of its lists this task is linked into, and the epochs
+    // this task belongs to and (for markers and barriers) waits on
+    enum class QueueList : uint8_t { None, Queued, Outstanding };
+    QueueList m_QueueList = QueueList::None;
+    LIST_ENTRY m_QueueListEntry = {};
+    std::shared_ptr<QueueEpoch> m_QueueEpoch;
+    std::shared_ptr<QueueEpoch> m_ClosedEpoch;
     std::vector<NotificationRequest> m_CompletionCallbacks;
     std::vector<NotificationRequest> m_RunningCallbacks;
     std::vector<NotificationRequest> m_SubmittedCallbacks;
-    std::promise<void> m_CompletionPromise;
-    std::future<void> m_CompletionFuture{ m_CompletionPromise.get_future() };
+
+    // Published once m_State is final. Waiters block on this word directly, so a task that's
+    // never waited on doesn't need a synchronization object, and completing it only has to wake
+    // anyone if a waiter has marked it.
+    enum CompletionState : uint32_t { Pending, PendingWithWaiters, Completed };
+    std::atomic<uint32_t> m_CompletionState = Pending;
 
     std::shared_ptr<D3D12TranslationLayer::TimestampQuery> m_StartTimestamp;
     std::shared_ptr<D3D12TranslationLayer::TimestampQuery> m_StopTimestamp;
@@ -0,0 +1,25 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+#pragma once
+
+#include <CL/cl.h>
+
+// Entry points that let the tests check on driver internals. They're only built into the ICD when
+// CMake's ENABLE_TEST_HOOKS is on, which defines CLON12_TEST_HOOKS, and aren't part of any extension,
+// so they're only reachable by name through clGetExtensionFunctionAddressForPlatform.
+
+// Totals across all of the program's devices. Everything but bytes counts since the program was built.
+struct clon12_specialization_cache_stats
+{
+    cl_ulong hits;
+    cl_ulong misses;
+    cl_ulong evictions;
+    cl_ulong entries;
+    cl_ulong bytes; // Currently resident
+};
+
+typedef cl_int (CL_API_CALL *clGetProgramSpecializationCacheStatsCLON12_fn)(
+    cl_program program, clon12_specialization_cache_stats* stats);
+
+extern CL_API_ENTRY cl_int CL_API_CALL
+clGetProgramSpecializationCacheStatsCLON12(cl_program program, clon12_specialization_cache_stats* stats);
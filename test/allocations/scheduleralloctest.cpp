@@ -0,0 +1,101 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+#include "gtest/gtest.h"
+#include "scheduler.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+using namespace BackgroundTaskScheduler;
+
+// Counts every heap allocation in the process. This replaces the global allocator, which is why
+// this test is its own executable: the only other thread here is the scheduler's.
+static std::atomic<uint64_t> g_NumAllocations = 0;
+
+static void* CountedAlloc(size_t size)
+{
+    ++g_NumAllocations;
+    if (void* p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size) { return CountedAlloc(size); }
+void* operator new[](size_t size) { return CountedAlloc(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+struct CountingTask
+{
+    std::atomic<uint32_t>* pCounter;
+    void operator()() { ++*pCounter; }
+};
+
+TEST(Scheduler, TaskSubmissionAllocations)
+{
+    constexpr uint32_t NumTasks = 100000;
+    Scheduler scheduler;
+    scheduler.SetSchedulingMode({ 1, Priority::Normal });
+    std::atomic<uint32_t> Counter = 0;
+
+    auto Drain = [&]()
+    {
+        XPlatHelpers::unique_event done;
+        done.create();
+        scheduler.SignalEventOnCompletionOfCurrentTasks(done.get(), scheduler.GetCurrentMode());
+        done.wait();
+    };
+    auto Measure = [&](const char* name, auto&& queue)
+    {
+        uint64_t AllocationsBefore = g_NumAllocations;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < NumTasks; ++i)
+        {
+            queue();
+        }
+        Drain();
+        auto end = std::chrono::steady_clock::now();
+        double AllocationsPerTask = (g_NumAllocations - AllocationsBefore) / (double)NumTasks;
+        printf("%s: %.3f allocations and %.0fns per task\n", name, AllocationsPerTask,
+            std::chrono::duration<double, std::nano>(end - start).count() / NumTasks);
+        return AllocationsPerTask;
+    };
+
+    // Grow the queue to its working size first
+    for (uint32_t i = 0; i < NumTasks; ++i)
+    {
+        scheduler.QueueTask({ CountingTask{ &Counter } });
+    }
+    Drain();
+
+    double Inline = Measure("Inline closure", [&]()
+    {
+        scheduler.QueueTask({ [&Counter, a = uint64_t(1), b = uint64_t(2)]() { Counter += (uint32_t)(a + b); } });
+    });
+    double HeapContext = Measure("Separately allocated context", [&]()
+    {
+        struct Context { std::atomic<uint32_t>* pCounter; uint64_t a, b; };
+        scheduler.QueueTask({ [spContext = std::make_unique<Context>(Context{ &Counter, 1, 2 })]()
+        {
+            *spContext->pCounter += (uint32_t)(spContext->a + spContext->b);
+        } });
+    });
+    double Large = Measure("Closure larger than inline storage", [&]()
+    {
+        uint64_t data[TaskFunction::InlineSize / sizeof(uint64_t)] = { 3 };
+        scheduler.QueueTask({ [&Counter, data]() { Counter += (uint32_t)data[0]; } });
+    });
+
+    EXPECT_LT(Inline, 0.01);
+    EXPECT_GE(HeapContext, 1.0);
+    EXPECT_GE(Large, 1.0);
+    EXPECT_EQ(Counter, NumTasks * 10);
+}
@@ -0,0 +1,195 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+#include "gtest/gtest.h"
+#include "autotuner.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <sstream>
+
+using LocalSize = LocalSizeAutotuner::LocalSize;
+
+static LocalSizeAutotuner::Key MakeKey(uint32_t x, uint32_t y = 1, uint32_t z = 1)
+{
+    return { "adapter", "kernel", { x, y, z } };
+}
+
+// Runs trials until the tuple is tuned, timing each launch with the given function.
+template <typename TFn>
+static uint32_t TuneWithTimings(LocalSizeAutotuner& tuner, LocalSizeAutotuner::Key const& key,
+                                LocalSize const& heuristic, uint32_t workDim, TFn&& timing)
+{
+    uint32_t trials = 0;
+    for (; trials < 1000; ++trials)
+    {
+        auto selection = tuner.Select(key, heuristic, workDim);
+        if (!selection.Candidate)
+        {
+            break;
+        }
+        tuner.ReportTiming(key, *selection.Candidate, timing(selection.Size));
+    }
+    return trials;
+}
+
+TEST(LocalSizeAutotuner, Candidates)
+{
+    LocalSize heuristic = { 64, 1, 1 };
+    auto candidates = LocalSizeAutotuner::GenerateCandidates({ 4096, 1, 1 }, 1, heuristic);
+    ASSERT_FALSE(candidates.empty());
+    EXPECT_EQ(candidates[0], heuristic);
+    // 32 through 1024 threads, with the heuristic's 64 only listed once
+    EXPECT_EQ(candidates.size(), 6u);
+
+    candidates = LocalSizeAutotuner::GenerateCandidates({ 256, 256, 1 }, 2, { 16, 4, 1 });
+    for (auto& size : candidates)
+    {
+        EXPECT_EQ(256u % size[0], 0u);
+        EXPECT_EQ(256u % size[1], 0u);
+        EXPECT_EQ(size[2], 1u);
+        EXPECT_LE((uint32_t)size[0] * size[1] * size[2], LocalSizeAutotuner::MaxThreadsPerGroup);
+        EXPECT_EQ(std::count(candidates.begin(), candidates.end(), size), 1);
+    }
+    // Both the row-major and the square shape for a full group
+    EXPECT_NE(std::find(candidates.begin(), candidates.end(), LocalSize{ 256, 4, 1 }), candidates.end());
+    EXPECT_NE(std::find(candidates.begin(), candidates.end(), LocalSize{ 32, 32, 1 }), candidates.end());
+
+    // The Z limit is lower than the others
+    candidates = LocalSizeAutotuner::GenerateCandidates({ 1, 1, 4096 }, 3, { 1, 1, 64 });
+    for (auto& size : candidates)
+    {
+        EXPECT_LE(size[2], LocalSizeAutotuner::MaxDims[2]);
+    }
+
+    // Odd sizes have no power-of-two candidates, so there's nothing to tune
+    LocalSizeAutotuner tuner;
+    auto selection = tuner.Select(MakeKey(1001), { 7, 1, 1 }, 1);
+    EXPECT_EQ(selection.Size, (LocalSize{ 7, 1, 1 }));
+    EXPECT_FALSE(selection.Candidate);
+}
+
+TEST(LocalSizeAutotuner, PicksFastest)
+{
+    LocalSizeAutotuner tuner(std::string(), 2);
+    auto key = MakeKey(1 << 20);
+    LocalSize heuristic = { 64, 1, 1 };
+
+    // Fastest at 256 threads, and slower the further away from that
+    uint32_t trials = TuneWithTimings(tuner, key, heuristic, 1, [](LocalSize const& size)
+    {
+        int64_t distance = (int64_t)size[0] - 256;
+        return (uint64_t)(1000 + (distance < 0 ? -distance : distance));
+    });
+    EXPECT_EQ(trials, 2 * LocalSizeAutotuner::GenerateCandidates(key.GlobalSize, 1, heuristic).size());
+    EXPECT_EQ(tuner.GetTunedSize(key), (LocalSize{ 256, 1, 1 }));
+
+    auto selection = tuner.Select(key, heuristic, 1);
+    EXPECT_EQ(selection.Size, (LocalSize{ 256, 1, 1 }));
+    EXPECT_FALSE(selection.Candidate);
+
+    // Other global sizes are tuned separately
+    EXPECT_FALSE(tuner.GetTunedSize(MakeKey(1 << 19)));
+    EXPECT_TRUE(tuner.Select(MakeKey(1 << 19), heuristic, 1).Candidate);
+}
+
+TEST(LocalSizeAutotuner, UsesBestSample)
+{
+    LocalSizeAutotuner tuner(std::string(), 3);
+    auto key = MakeKey(1024);
+    uint32_t launchesOf128 = 0;
+    // 128 threads is the fastest, but its first sample is disturbed by something else on the GPU
+    TuneWithTimings(tuner, key, { 64, 1, 1 }, 1, [&](LocalSize const& size)
+    {
+        if (size[0] == 128)
+            return ++launchesOf128 == 1 ? 100000ull : 50ull;
+        return 100ull;
+    });
+    EXPECT_EQ(launchesOf128, 3u);
+    EXPECT_EQ(tuner.GetTunedSize(key), (LocalSize{ 128, 1, 1 }));
+}
+
+TEST(LocalSizeAutotuner, TiesFavorHeuristic)
+{
+    LocalSizeAutotuner tuner(std::string(), 1);
+    auto key = MakeKey(4096);
+    LocalSize heuristic = { 512, 1, 1 };
+    TuneWithTimings(tuner, key, heuristic, 1, [](LocalSize const&) { return 10ull; });
+    EXPECT_EQ(tuner.GetTunedSize(key), heuristic);
+}
+
+TEST(LocalSizeAutotuner, LostTrials)
+{
+    LocalSizeAutotuner tuner(std::string(), 1);
+    auto key = MakeKey(4096);
+    LocalSize heuristic = { 64, 1, 1 };
+    size_t numCandidates = LocalSizeAutotuner::GenerateCandidates(key.GlobalSize, 1, heuristic).size();
+
+    // Trials whose launches fail never report back. They get handed out again instead of stalling tuning.
+    for (size_t i = 0; i < numCandidates; ++i)
+    {
+        EXPECT_TRUE(tuner.Select(key, heuristic, 1).Candidate);
+    }
+    for (size_t i = 0; i < numCandidates; ++i)
+    {
+        auto selection = tuner.Select(key, heuristic, 1);
+        ASSERT_TRUE(selection.Candidate);
+        EXPECT_EQ(tuner.ReportTiming(key, *selection.Candidate, 10), i == numCandidates - 1);
+    }
+    EXPECT_TRUE(tuner.GetTunedSize(key));
+
+    // Late reports for a tuned tuple are ignored
+    EXPECT_FALSE(tuner.ReportTiming(key, 0, 1));
+    EXPECT_FALSE(tuner.ReportTiming(MakeKey(8192), 0, 1));
+}
+
+TEST(LocalSizeAutotuner, SaveAndLoad)
+{
+    LocalSizeAutotuner tuner(std::string(), 1);
+    auto key = MakeKey(256, 256);
+    TuneWithTimings(tuner, key, { 16, 16, 1 }, 2, [](LocalSize const& size) { return size == LocalSize{ 32, 32, 1 } ? 1ull : 2ull; });
+    // In-progress tuples aren't saved
+    tuner.Select(MakeKey(1 << 20), { 64, 1, 1 }, 1);
+
+    std::stringstream stream;
+    tuner.Save(stream);
+    stream << "malformed line\n"
+           << "adapter other 100 1 1 3 1 1\n"   // Doesn't divide the global size
+           << "adapter other 4096 1 1 2048 1 1\n"; // Too large
+
+    LocalSizeAutotuner loaded;
+    loaded.Load(stream);
+    EXPECT_EQ(loaded.GetTunedSize(key), (LocalSize{ 32, 32, 1 }));
+    EXPECT_FALSE(loaded.GetTunedSize(MakeKey(1 << 20)));
+    EXPECT_FALSE(loaded.GetTunedSize({ "adapter", "other", { 100, 1, 1 } }));
+    EXPECT_FALSE(loaded.GetTunedSize({ "adapter", "other", { 4096, 1, 1 } }));
+
+    // Loaded results are used without any trials
+    auto selection = loaded.Select(key, { 16, 16, 1 }, 2);
+    EXPECT_EQ(selection.Size, (LocalSize{ 32, 32, 1 }));
+    EXPECT_FALSE(selection.Candidate);
+
+    // Keys are specific to the adapter
+    EXPECT_FALSE(loaded.GetTunedSize({ "other", "kernel", key.GlobalSize }));
+}
+
+TEST(LocalSizeAutotuner, Persist)
+{
+    auto path = (std::filesystem::temp_directory_path() / "clon12_autotunertest.txt").string();
+    std::filesystem::remove(path);
+
+    auto key = MakeKey(1 << 16);
+    {
+        LocalSizeAutotuner tuner(path, 1);
+        TuneWithTimings(tuner, key, { 64, 1, 1 }, 1, [](LocalSize const& size) { return (uint64_t)size[0]; });
+        EXPECT_EQ(tuner.GetTunedSize(key), (LocalSize{ 32, 1, 1 }));
+        // Tuning doesn't write the file by itself, that's left to the caller
+        EXPECT_FALSE(std::filesystem::exists(path));
+        tuner.Persist();
+        EXPECT_TRUE(std::filesystem::exists(path));
+    }
+    {
+        LocalSizeAutotuner tuner(path, 1);
+        EXPECT_EQ(tuner.GetTunedSize(key), (LocalSize{ 32, 1, 1 }));
+    }
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,173 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+#include "gtest/gtest.h"
+#include "blobcache.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+static BlobCache::Blob MakeBlob(size_t size, unsigned char fill = 0)
+{
+    std::shared_ptr<unsigned char[]> data(new unsigned char[size]);
+    memset(data.get(), fill, size);
+    return { std::move(data), size };
+}
+
+// Keys whose second half matches all land in the same shard
+static BlobCache::Key ShardKey(uint64_t i)
+{
+    return { i, 0 };
+}
+
+TEST(BlobCache, FindShares)
+{
+    BlobCache cache(BlobCache::NumShards * 1024);
+    auto blob = MakeBlob(100, 7);
+    cache.Insert({ 1, 2 }, blob);
+    EXPECT_FALSE(cache.Find({ 2, 1 }).first);
+
+    auto found = cache.Find({ 1, 2 });
+    EXPECT_EQ(found.first.get(), blob.first.get());
+    EXPECT_EQ(found.second, 100u);
+    EXPECT_EQ(cache.GetByteSize(), 100u);
+
+    // Replacing a key releases the old blob's budget
+    cache.Insert({ 1, 2 }, MakeBlob(50));
+    EXPECT_EQ(cache.Find({ 1, 2 }).second, 50u);
+    EXPECT_EQ(cache.GetByteSize(), 50u);
+
+    cache.Clear();
+    EXPECT_FALSE(cache.Find({ 1, 2 }).first);
+    EXPECT_EQ(cache.GetByteSize(), 0u);
+    // Cleared blobs are still valid for whoever found them
+    EXPECT_EQ(found.first[99], 7);
+}
+
+TEST(BlobCache, EvictsLeastRecentlyUsed)
+{
+    BlobCache cache(BlobCache::NumShards * 1000);
+    ASSERT_EQ(cache.GetMaxBlobSize(), 1000u);
+
+    cache.Insert(ShardKey(1), MakeBlob(400));
+    cache.Insert(ShardKey(2), MakeBlob(400));
+    // Using 1 makes 2 the oldest
+    EXPECT_TRUE(cache.Find(ShardKey(1)).first);
+    cache.Insert(ShardKey(3), MakeBlob(400));
+
+    EXPECT_TRUE(cache.Find(ShardKey(1)).first);
+    EXPECT_FALSE(cache.Find(ShardKey(2)).first);
+    EXPECT_TRUE(cache.Find(ShardKey(3)).first);
+    EXPECT_EQ(cache.GetByteSize(), 800u);
+
+    // Too big to ever fit, so it isn't kept and doesn't evict anything
+    cache.Insert(ShardKey(4), MakeBlob(1001));
+    EXPECT_FALSE(cache.Find(ShardKey(4)).first);
+    EXPECT_EQ(cache.GetByteSize(), 800u);
+
+    // Other shards have their own budgets
+    cache.Insert({ 1, 1 }, MakeBlob(1000));
+    EXPECT_TRUE(cache.Find(ShardKey(1)).first);
+    EXPECT_TRUE(cache.Find({ 1, 1 }).first);
+}
+
+TEST(BlobCache, Disabled)
+{
+    BlobCache cache(0);
+    cache.Insert({ 1, 2 }, MakeBlob(1));
+    EXPECT_FALSE(cache.Find({ 1, 2 }).first);
+}
+
+TEST(BlobCache, Concurrent)
+{
+    BlobCache cache(BlobCache::NumShards * 64 * 100);
+    std::vector<std::thread> threads;
+    for (uint64_t t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&cache, t]()
+        {
+            for (uint64_t i = 0; i < 1000; ++i)
+            {
+                BlobCache::Key key = { t, i };
+                cache.Insert(key, MakeBlob(100, (unsigned char)i));
+                auto found = cache.Find({ t, i / 2 });
+                if (found.first)
+                {
+                    EXPECT_EQ(found.first[0], (unsigned char)(i / 2));
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    EXPECT_LE(cache.GetByteSize(), BlobCache::NumShards * 64 * 100u);
+}
+
+TEST(BlobCache, HashKeyParts)
+{
+    const void* parts[] = { "ab", "", "cdef" };
+    size_t sizes[] = { 2, 0, 4 };
+    EXPECT_EQ(BlobCache::HashKey(parts, sizes, 3), BlobCache::HashKey("abcdef", 6));
+    EXPECT_NE(BlobCache::HashKey(parts, sizes, 3), BlobCache::HashKey("abcdeg", 6));
+}
+
+// Not a pass/fail test, just reports what a lookup keyed by a whole program's source costs.
+TEST(BlobCache, LargeKeyBenchmark)
+{
+    std::string source(1024 * 1024, ' ');
+    std::mt19937 rng(1234);
+    for (auto& c : source)
+    {
+        c = (char)('a' + rng() % 26);
+    }
+    std::string options = "-cl-std=CL3.0 -cl-fast-relaxed-math -DBLOCK_SIZE=64";
+    uint64_t features = 0xff;
+    const void* parts[] = { source.data(), options.data(), &features };
+    size_t sizes[] = { source.size(), options.size(), sizeof(features) };
+
+    BlobCache cache(BlobCache::NumShards * 1024 * 1024);
+    cache.Insert(BlobCache::HashKey(parts, sizes, 3), MakeBlob(64 * 1024));
+
+    constexpr int Iterations = 64;
+    using Clock = std::chrono::steady_clock;
+    auto MicrosecondsPer = [](Clock::duration d) { return std::chrono::duration<double, std::micro>(d).count() / Iterations; };
+
+    BlobCache::Key inPlace = {}, concatenated = {};
+    auto start = Clock::now();
+    for (int i = 0; i < Iterations; ++i)
+    {
+        inPlace = BlobCache::HashKey(parts, sizes, 3);
+    }
+    auto inPlaceTime = Clock::now() - start;
+
+    start = Clock::now();
+    for (int i = 0; i < Iterations; ++i)
+    {
+        std::vector<unsigned char> combined(sizes[0] + sizes[1] + sizes[2]);
+        size_t offset = 0;
+        for (int p = 0; p < 3; ++p)
+        {
+            memcpy(combined.data() + offset, parts[p], sizes[p]);
+            offset += sizes[p];
+        }
+        concatenated = BlobCache::HashKey(combined.data(), combined.size());
+    }
+    auto concatenatedTime = Clock::now() - start;
+    EXPECT_EQ(inPlace, concatenated);
+
+    start = Clock::now();
+    for (int i = 0; i < Iterations; ++i)
+    {
+        EXPECT_TRUE(cache.Find(BlobCache::HashKey(parts, sizes, 3)).first);
+    }
+    auto lookupTime = Clock::now() - start;
+
+    printf("1MB key: hashed in place %.1fus, concatenated then hashed %.1fus, hashed and found %.1fus\n",
+           MicrosecondsPer(inPlaceTime), MicrosecondsPer(concatenatedTime), MicrosecondsPer(lookupTime));
+}
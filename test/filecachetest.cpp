@@ -0,0 +1,182 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+#include "gtest/gtest.h"
+#include "filecache.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+static std::filesystem::path GetTestPath()
+{
+    auto path = std::filesystem::temp_directory_path() / "clon12_filecachetest.cache";
+    std::filesystem::remove(path);
+    return path;
+}
+
+static bool Store(FileCache& cache, std::string const& key, std::string const& value)
+{
+    const void* keys[] = { key.data() };
+    size_t keySizes[] = { key.size() };
+    return cache.Store(keys, keySizes, 1, value.data(), value.size());
+}
+
+static std::string Find(FileCache& cache, std::string const& key)
+{
+    const void* keys[] = { key.data() };
+    size_t keySizes[] = { key.size() };
+    auto found = cache.Find(keys, keySizes, 1);
+    return found.first ? std::string(reinterpret_cast<char*>(found.first.get()), found.second) : "<missing>";
+}
+
+TEST(FileCache, StoreAndFind)
+{
+    auto path = GetTestPath();
+    {
+        FileCache cache(path, 1);
+        EXPECT_EQ(Find(cache, "key"), "<missing>");
+        EXPECT_TRUE(Store(cache, "key", "value"));
+        EXPECT_TRUE(Store(cache, "other key", std::string(10000, 'x')));
+        EXPECT_TRUE(Store(cache, "empty", ""));
+        EXPECT_EQ(Find(cache, "key"), "value");
+        EXPECT_EQ(Find(cache, "other key"), std::string(10000, 'x'));
+        EXPECT_EQ(Find(cache, "empty"), "");
+        EXPECT_EQ(Find(cache, "ke"), "<missing>");
+
+        // The latest value for a key wins
+        EXPECT_TRUE(Store(cache, "key", "new value"));
+        EXPECT_EQ(Find(cache, "key"), "new value");
+
+        // Split keys match the same key in one piece
+        const void* keys[] = { "ot", "her ", "key" };
+        size_t keySizes[] = { 2, 4, 3 };
+        auto found = cache.Find(keys, keySizes, 3);
+        ASSERT_TRUE(found.first);
+        EXPECT_EQ(found.second, 10000u);
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(FileCache, Persist)
+{
+    auto path = GetTestPath();
+    {
+        FileCache cache(path, 1);
+        EXPECT_TRUE(Store(cache, "key", "value"));
+    }
+    {
+        FileCache cache(path, 1);
+        EXPECT_EQ(Find(cache, "key"), "value");
+    }
+    {
+        // A different version empties the file
+        FileCache cache(path, 2);
+        EXPECT_EQ(Find(cache, "key"), "<missing>");
+    }
+    {
+        FileCache cache(path, 1);
+        EXPECT_EQ(Find(cache, "key"), "<missing>");
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(FileCache, SharedFile)
+{
+    auto path = GetTestPath();
+    {
+        // Stands in for two processes with the same file
+        FileCache writer(path, 1);
+        FileCache reader(path, 1);
+        EXPECT_EQ(Find(reader, "key"), "<missing>");
+        EXPECT_TRUE(Store(writer, "key", "value"));
+        EXPECT_EQ(Find(reader, "key"), "value");
+
+        writer.Clear();
+        EXPECT_EQ(Find(reader, "key"), "<missing>");
+        EXPECT_TRUE(Store(writer, "key2", "value2"));
+        EXPECT_EQ(Find(reader, "key2"), "value2");
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(FileCache, ReadOnly)
+{
+    auto path = GetTestPath();
+    EXPECT_ANY_THROW(FileCache(path, 1, FileCache::DefaultMaxSize, FileCache::Access::ReadOnly));
+    {
+        FileCache cache(path, 1);
+        EXPECT_TRUE(Store(cache, "key", "value"));
+    }
+    {
+        FileCache bundle(path, 1, FileCache::DefaultMaxSize, FileCache::Access::ReadOnly);
+        EXPECT_EQ(Find(bundle, "key"), "value");
+        EXPECT_FALSE(Store(bundle, "key2", "value2"));
+        bundle.Clear();
+        EXPECT_EQ(Find(bundle, "key"), "value");
+
+        // Still sees what other processes add
+        FileCache writer(path, 1);
+        EXPECT_TRUE(Store(writer, "key2", "value2"));
+        EXPECT_EQ(Find(bundle, "key2"), "value2");
+    }
+    // Read-only files with the wrong version are rejected rather than emptied
+    EXPECT_ANY_THROW(FileCache(path, 2, FileCache::DefaultMaxSize, FileCache::Access::ReadOnly));
+    {
+        FileCache cache(path, 1);
+        EXPECT_EQ(Find(cache, "key"), "value");
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(FileCache, Corruption)
+{
+    auto path = GetTestPath();
+    {
+        FileCache cache(path, 1);
+        EXPECT_TRUE(Store(cache, "key", "value"));
+        EXPECT_TRUE(Store(cache, "key2", "value2"));
+    }
+    {
+        // A record that was written but never committed is ignored, and gets overwritten
+        std::ofstream file(path, std::ios::binary | std::ios::app);
+        file << "garbage that was never committed";
+    }
+    {
+        // Flip a byte of the last value, as if that write never made it to disk
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        auto pos = contents.rfind("value2");
+        ASSERT_NE(pos, std::string::npos);
+        file.seekp(pos);
+        file.put('V');
+    }
+    {
+        FileCache cache(path, 1);
+        EXPECT_EQ(Find(cache, "key"), "value");
+        EXPECT_EQ(Find(cache, "key2"), "<missing>");
+        EXPECT_TRUE(Store(cache, "key3", "value3"));
+        EXPECT_EQ(Find(cache, "key3"), "value3");
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(FileCache, MaxSize)
+{
+    auto path = GetTestPath();
+    {
+        FileCache cache(path, 1, 4096);
+        EXPECT_FALSE(Store(cache, "too big", std::string(4096, 'x')));
+
+        // Filling the file empties it, rather than failing the store
+        std::string value(1000, 'x');
+        for (int i = 0; i < 8; ++i)
+        {
+            EXPECT_TRUE(Store(cache, std::to_string(i), value));
+            EXPECT_EQ(Find(cache, std::to_string(i)), value);
+        }
+        EXPECT_EQ(Find(cache, "0"), "<missing>");
+        EXPECT_LE(std::filesystem::file_size(path), 4096u);
+    }
+    std::filesystem::remove(path);
+}
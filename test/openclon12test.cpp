@@ -14,11 +14,17 @@
 #include <utility>
 #include <algorithm>
 #include <numeric>
+#include <thread>
+#include <chrono>
+#include <cstdio>
 
 #include <d3d12.h>
 
 #include <gl/GL.h>
 #include "gl_tokens.hpp"
+#ifdef CLON12_TEST_HOOKS
+#include "testhooks.hpp"
+#endif
 
 #include <wil/resource.h>
 
@@ -243,6 +249,47 @@ TEST(OpenCLOn12, Printf)
     queue.finish();
 }
 
+TEST(OpenCLOn12, PrintfReuse)
+{
+    auto&& [context, device] = GetWARPContext();
+    if (!context.get())
+    {
+        return;
+    }
+    cl::CommandQueue queue(context, device);
+
+    const char* kernel_source =
+    R"(
+    kernel void test_printf(int launch) {
+        printf("launch %d\n", launch);
+    })";
+
+    cl::Program program(context, kernel_source, true /*build*/);
+    cl::Kernel kernel(program, "test_printf");
+
+    // More launches in flight than there are pooled printf buffers, and each one that reuses a buffer
+    // must only print its own output.
+    constexpr int NumLaunches = 20;
+    testing::internal::CaptureStdout();
+    for (int i = 0; i < NumLaunches; ++i)
+    {
+        kernel.setArg(0, i);
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(1));
+    }
+    queue.finish();
+    std::string output = testing::internal::GetCapturedStdout();
+
+    size_t pos = 0;
+    for (int i = 0; i < NumLaunches; ++i)
+    {
+        std::string line = "launch " + std::to_string(i) + "\n";
+        pos = output.find(line, pos);
+        ASSERT_NE(pos, std::string::npos) << line;
+        pos += line.size();
+        EXPECT_EQ(output.find(line, pos), std::string::npos) << line;
+    }
+}
+
 TEST(OpenCLOn12, RecursiveFlush)
 {
     auto&& [context, device] = GetWARPContext();
@@ -285,6 +332,545 @@ TEST(OpenCLOn12, RecursiveFlush)
     EXPECT_EQ(queue1Task2.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>(), CL_COMPLETE);
 }
 
+// Enqueues from several host threads at once, each with its own context. Contexts don't share a task
+// graph lock, so they make progress independently, and none of them may see another's work.
+TEST(OpenCLOn12, ConcurrentContextEnqueues)
+{
+    constexpr uint32_t NumThreads = 4;
+    constexpr uint32_t NumSlots = 16;
+    constexpr uint32_t EnqueuesPerThread = NumSlots * 16;
+    constexpr uint32_t EnqueuesPerFlush = 32;
+
+    struct HostThreadState
+    {
+        cl::Context context;
+        cl::CommandQueue queue;
+        cl::Buffer buffer;
+    };
+    std::vector<HostThreadState> states;
+    for (uint32_t i = 0; i < NumThreads; ++i)
+    {
+        auto&& [context, device] = GetWARPContext();
+        if (!context.get())
+        {
+            return;
+        }
+        cl::CommandQueue queue(context, device);
+        cl::Buffer buffer(context, CL_MEM_READ_WRITE, NumSlots * sizeof(uint32_t));
+        states.push_back({ context, queue, buffer });
+    }
+
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < NumThreads; ++t)
+    {
+        threads.emplace_back([&state = states[t], t]()
+        {
+            try
+            {
+                // Each slot is filled several times, so the last fill for it must be the one that lands
+                for (uint32_t i = 0; i < EnqueuesPerThread; ++i)
+                {
+                    uint32_t pattern = t * EnqueuesPerThread + i;
+                    state.queue.enqueueFillBuffer(state.buffer, pattern, (i % NumSlots) * sizeof(pattern), sizeof(pattern));
+                    if (i % EnqueuesPerFlush == EnqueuesPerFlush - 1)
+                    {
+                        state.queue.flush();
+                    }
+                }
+                state.queue.finish();
+            }
+            catch (cl::Error& e)
+            {
+                ADD_FAILURE() << e.what() << ": " << e.err();
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (uint32_t t = 0; t < NumThreads; ++t)
+    {
+        uint32_t result[NumSlots] = {};
+        states[t].queue.enqueueReadBuffer(states[t].buffer, true, 0, sizeof(result), result);
+        for (uint32_t slot = 0; slot < NumSlots; ++slot)
+        {
+            EXPECT_EQ(result[slot], t * EnqueuesPerThread + EnqueuesPerThread - NumSlots + slot);
+        }
+    }
+}
+
+TEST(OpenCLOn12, EnqueueKernelThroughput)
+{
+    auto&& [context, device] = GetWARPContext();
+    if (!context.get())
+    {
+        return;
+    }
+    cl::CommandQueue queue(context, device);
+
+    const char* kernel_source =
+    "__kernel void main_test(__global uint *output)\n\
+    {\n\
+        output[get_global_id(0)] += 1;\n\
+    }\n";
+
+    const size_t width = 4;
+    cl::Buffer buffer(context, CL_MEM_READ_WRITE, width * sizeof(uint32_t));
+    cl::Program program(context, kernel_source, true /*build*/);
+    cl::Kernel kernel(program, "main_test");
+    kernel.setArg(0, buffer);
+
+    uint32_t zero = 0;
+    queue.enqueueFillBuffer(buffer, zero, 0, width * sizeof(uint32_t));
+    // Warm up, so the first iteration doesn't pay for specialization
+    queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(width));
+    queue.finish();
+
+    constexpr uint32_t NumEnqueues = 10000;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < NumEnqueues; ++i)
+    {
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(width));
+    }
+    auto end = std::chrono::steady_clock::now();
+    queue.finish();
+    auto endWithExecution = std::chrono::steady_clock::now();
+
+    double EnqueueSeconds = std::chrono::duration<double>(end - start).count();
+    double TotalSeconds = std::chrono::duration<double>(endWithExecution - start).count();
+    printf("%.0f kernel enqueues per second, %.0f including execution\n",
+           NumEnqueues / EnqueueSeconds, NumEnqueues / TotalSeconds);
+
+    uint32_t result[width] = {};
+    queue.enqueueReadBuffer(buffer, true, 0, sizeof(result), result);
+    for (uint32_t i = 0; i < width; ++i)
+    {
+        EXPECT_EQ(result[i], NumEnqueues + 1);
+    }
+}
+
+TEST(OpenCLOn12, OutOfOrderMarkers)
+{
+    auto&& [context, device] = GetWARPContext();
+    if (!context.get())
+    {
+        return;
+    }
+    cl::CommandQueue queue(context, device, CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE);
+
+    constexpr uint32_t NumBuffers = 64;
+    constexpr uint32_t EnqueuesPerMarker = NumBuffers;
+    constexpr uint32_t NumEnqueues = NumBuffers * 80;
+    std::vector<cl::Buffer> buffers;
+    for (uint32_t i = 0; i < NumBuffers; ++i)
+    {
+        buffers.emplace_back(context, CL_MEM_READ_WRITE, sizeof(uint32_t));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<cl::Event> markers;
+    for (uint32_t i = 0; i < NumEnqueues; ++i)
+    {
+        queue.enqueueFillBuffer(buffers[i % NumBuffers], i, 0, sizeof(i));
+        if (i % EnqueuesPerMarker == EnqueuesPerMarker - 1)
+        {
+            markers.emplace_back();
+            queue.enqueueMarkerWithWaitList(nullptr, &markers.back());
+            // Each buffer is filled once between barriers, so the last fill wins
+            queue.enqueueBarrierWithWaitList();
+        }
+    }
+    queue.finish();
+    auto end = std::chrono::steady_clock::now();
+    printf("%.0f out-of-order enqueues per second with markers\n",
+           NumEnqueues / std::chrono::duration<double>(end - start).count());
+
+    for (auto& marker : markers)
+    {
+        EXPECT_EQ(marker.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>(), CL_COMPLETE);
+    }
+    for (uint32_t i = 0; i < NumBuffers; ++i)
+    {
+        uint32_t result = 0;
+        queue.enqueueReadBuffer(buffers[i], true, 0, sizeof(result), &result);
+        EXPECT_EQ(result, NumEnqueues - NumBuffers + i);
+    }
+}
+
+TEST(OpenCLOn12, SubmissionPipelining)
+{
+    const char* kernel_source =
+    "__kernel void main_test(__global uint *output, uint iterations)\n\
+    {\n\
+        uint value = output[get_global_id(0)];\n\
+        for (uint i = 0; i < iterations; ++i)\n\
+            value = value * 1664525u + 1013904223u;\n\
+        output[get_global_id(0)] = value;\n\
+    }\n";
+
+    // The limit is read when the D3D device is created
+    auto ResetLimit = wil::scope_exit([]() { _putenv_s("CLON12_MAX_SUBMISSIONS_IN_FLIGHT", ""); });
+
+    // Without pipelining, with the default, and without a limit. Each launch builds on the previous one's
+    // output, so work that's dropped, repeated, or run out of order across submissions changes the result.
+    for (const char* MaxInFlight : { "1", "", "0" })
+    {
+        _putenv_s("CLON12_MAX_SUBMISSIONS_IN_FLIGHT", MaxInFlight);
+        auto&& [context, device] = GetWARPContext();
+        if (!context.get())
+        {
+            return;
+        }
+        cl::CommandQueue queue(context, device);
+
+        constexpr uint32_t Iterations = 100;
+        const size_t width = 256;
+        cl::Buffer buffer(context, CL_MEM_READ_WRITE, width * sizeof(uint32_t));
+        cl::Program program(context, kernel_source, true /*build*/);
+        cl::Kernel kernel(program, "main_test");
+        kernel.setArg(0, buffer);
+        kernel.setArg(1, Iterations);
+
+        std::vector<uint32_t> expected(width);
+        std::iota(expected.begin(), expected.end(), 0u);
+        queue.enqueueWriteBuffer(buffer, false, 0, width * sizeof(uint32_t), expected.data());
+
+        constexpr uint32_t NumBatches = 32;
+        constexpr uint32_t KernelsPerBatch = 4;
+        std::vector<cl::Event> lastInBatch(NumBatches);
+        for (uint32_t batch = 0; batch < NumBatches; ++batch)
+        {
+            for (uint32_t i = 0; i < KernelsPerBatch; ++i)
+            {
+                cl::Event* event = i == KernelsPerBatch - 1 ? &lastInBatch[batch] : nullptr;
+                queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(width), cl::NullRange, nullptr, event);
+            }
+            queue.flush();
+        }
+        queue.finish();
+
+        for (auto& event : lastInBatch)
+        {
+            EXPECT_EQ(event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>(), CL_COMPLETE);
+        }
+
+        for (auto& value : expected)
+        {
+            for (uint32_t i = 0; i < NumBatches * KernelsPerBatch * Iterations; ++i)
+            {
+                value = value * 1664525u + 1013904223u;
+            }
+        }
+        std::vector<uint32_t> result(width, 0xdeaddead);
+        queue.enqueueReadBuffer(buffer, true, 0, width * sizeof(uint32_t), result.data());
+        for (uint32_t i = 0; i < width; ++i)
+        {
+            EXPECT_EQ(result[i], expected[i]) << "Max submissions in flight: " << (*MaxInFlight ? MaxInFlight : "(default)");
+        }
+    }
+}
+
+TEST(OpenCLOn12, DependentKernels)
+{
+    auto&& [context, device] = GetWARPContext();
+    if (!context.get())
+    {
+        return;
+    }
+    cl::CommandQueue queue(context, device);
+
+    const char* kernel_source =
+    "__kernel void add_one(__global const uint *input, __global uint *output)\n\
+    {\n\
+        output[get_global_id(0)] = input[get_global_id(0)] + 1;\n\
+    }\n\
+    __kernel void fill(__global uint *output, uint value)\n\
+    {\n\
+        output[get_global_id(0)] = value;\n\
+    }\n";
+
+    const size_t width = 1024;
+    std::vector<uint32_t> zeroes(width, 0);
+    cl::Buffer buffers[2] =
+    {
+        cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, width * sizeof(uint32_t), zeroes.data()),
+        cl::Buffer(context, CL_MEM_READ_WRITE, width * sizeof(uint32_t)),
+    };
+    cl::Buffer independent(context, CL_MEM_READ_WRITE, width * sizeof(uint32_t));
+
+    cl::Program program(context, kernel_source, true /*build*/);
+    cl::Kernel addOne[2] = { cl::Kernel(program, "add_one"), cl::Kernel(program, "add_one") };
+    cl::Kernel fill(program, "fill");
+    fill.setArg(0, independent);
+
+    // Ping-pong between the two buffers, so every dispatch reads the previous one's output and
+    // overwrites the previous one's input, with an unrelated dispatch in between.
+    constexpr uint32_t NumIterations = 64;
+    for (uint32_t i = 0; i < NumIterations; ++i)
+    {
+        auto& kernel = addOne[i % 2];
+        kernel.setArg(0, buffers[i % 2]);
+        kernel.setArg(1, buffers[(i + 1) % 2]);
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(width));
+
+        fill.setArg(1, i);
+        queue.enqueueNDRangeKernel(fill, cl::NullRange, cl::NDRange(width));
+    }
+
+    std::vector<uint32_t> result(width, 0xdeaddead);
+    queue.enqueueReadBuffer(buffers[NumIterations % 2], true, 0, width * sizeof(uint32_t), result.data());
+    for (uint32_t i = 0; i < width; ++i)
+    {
+        EXPECT_EQ(result[i], NumIterations);
+    }
+
+    queue.enqueueReadBuffer(independent, true, 0, width * sizeof(uint32_t), result.data());
+    for (uint32_t i = 0; i < width; ++i)
+    {
+        EXPECT_EQ(result[i], NumIterations - 1);
+    }
+}
+
+TEST(OpenCLOn12, SpeculativeSpecialization)
+{
+    auto&& [context, device] = GetWARPContext();
+    if (!context.get())
+    {
+        return;
+    }
+    cl::CommandQueue queue(context, device);
+
+    const char* kernel_source =
+    "__kernel void reverse_groups(__global uint *output, __local uint *scratch)\n\
+    {\n\
+        scratch[get_local_id(0)] = get_global_id(0);\n\
+        barrier(CLK_LOCAL_MEM_FENCE);\n\
+        output[get_global_id(0)] = scratch[get_local_size(0) - get_local_id(0) - 1];\n\
+    }\n";
+
+    cl::Program program(context, kernel_source, true /*build*/);
+
+    // Speculative work queued for a kernel must not outlive it or keep anything from being released
+    {
+        cl::Kernel discarded(program, "reverse_groups");
+        discarded.setArg(1, cl::Local(64 * sizeof(uint32_t)));
+    }
+
+    const size_t width = 1024;
+    cl::Buffer buffer(context, CL_MEM_READ_WRITE, width * sizeof(uint32_t));
+    cl::Kernel kernel(program, "reverse_groups");
+    kernel.setArg(0, buffer);
+
+    // Both a local size the speculation may have guessed, and ones it can't have
+    for (size_t localSize : { 32, 64, 16 })
+    {
+        kernel.setArg(1, cl::Local(localSize * sizeof(uint32_t)));
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(width), cl::NDRange(localSize));
+
+        std::vector<uint32_t> result(width, 0xdeaddead);
+        queue.enqueueReadBuffer(buffer, true, 0, width * sizeof(uint32_t), result.data());
+        for (uint32_t i = 0; i < width; ++i)
+        {
+            uint32_t groupStart = i - i % (uint32_t)localSize;
+            EXPECT_EQ(result[i], groupStart + (uint32_t)localSize - 1 - (i - groupStart));
+        }
+    }
+}
+
+TEST(OpenCLOn12, SpecializationCacheEviction)
+{
+    // With no budget, every specialization is evicted as soon as it's recorded,
+    // so each launch below has to rebuild its PSO from the on-disk caches
+    _putenv_s("CLON12_SPECIALIZATION_CACHE_SIZE_MB", "0");
+    auto&& [context, device] = GetWARPContext();
+    if (!context.get())
+    {
+        _putenv_s("CLON12_SPECIALIZATION_CACHE_SIZE_MB", "");
+        return;
+    }
+    cl::CommandQueue queue(context, device);
+
+    const char* kernel_source =
+    "__kernel void group_sum(__global uint *output, __local uint *scratch)\n\
+    {\n\
+        scratch[get_local_id(0)] = 1;\n\
+        barrier(CLK_LOCAL_MEM_FENCE);\n\
+        uint sum = 0;\n\
+        for (uint i = 0; i < get_local_size(0); ++i)\n\
+            sum += scratch[i];\n\
+        output[get_global_id(0)] = sum;\n\
+    }\n";
+
+    cl::Program program(context, kernel_source, true /*build*/);
+    _putenv_s("CLON12_SPECIALIZATION_CACHE_SIZE_MB", "");
+
+    // Evictions can only be counted when the ICD was built with its test hooks
+#ifdef CLON12_TEST_HOOKS
+    auto GetStats = reinterpret_cast<clGetProgramSpecializationCacheStatsCLON12_fn>(
+        clGetExtensionFunctionAddressForPlatform(device.getInfo<CL_DEVICE_PLATFORM>(), "clGetProgramSpecializationCacheStatsCLON12"));
+    ASSERT_NE(GetStats, nullptr);
+    auto Stats = [&]()
+    {
+        clon12_specialization_cache_stats stats = {};
+        EXPECT_EQ(GetStats(program(), &stats), CL_SUCCESS);
+        return stats;
+    };
+#endif
+
+    const size_t width = 256;
+    cl::Buffer buffer(context, CL_MEM_READ_WRITE, width * sizeof(uint32_t));
+    cl::Kernel kernel(program, "group_sum");
+    kernel.setArg(0, buffer);
+
+#ifdef CLON12_TEST_HOOKS
+    const cl_ulong initialEvictions = Stats().evictions;
+    cl_ulong launches = 0;
+#endif
+    for (uint32_t iteration = 0; iteration < 2; ++iteration)
+    {
+        for (size_t localSize : { 8, 16, 32 })
+        {
+            kernel.setArg(1, cl::Local(localSize * sizeof(uint32_t)));
+            queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(width), cl::NDRange(localSize));
+
+            std::vector<uint32_t> result(width, 0xdeaddead);
+            queue.enqueueReadBuffer(buffer, true, 0, width * sizeof(uint32_t), result.data());
+            for (uint32_t i = 0; i < width; ++i)
+            {
+                EXPECT_EQ(result[i], localSize);
+            }
+
+#ifdef CLON12_TEST_HOOKS
+            // Launches drop their entry once they're recorded, which has happened by the time the read is done,
+            // so each one has been evicted. Speculative builds can add more evictions, but never fewer.
+            EXPECT_GE(Stats().evictions - initialEvictions, ++launches);
+#endif
+        }
+    }
+
+#ifdef CLON12_TEST_HOOKS
+
+    // Speculative builds finish in the background, and are evicted as soon as they're done,
+    // so nothing stays resident
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (Stats().bytes != 0 && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(Stats().bytes, 0u);
+#endif
+}
+
+TEST(OpenCLOn12, ManyKernels)
+{
+    auto&& [context, device] = GetWARPContext();
+    if (!context.get())
+    {
+        return;
+    }
+    cl::CommandQueue queue(context, device);
+
+    // Enough kernels that building them is spread across the compile threads
+    const uint32_t numKernels = 64;
+    std::string kernel_source;
+    for (uint32_t i = 0; i < numKernels; ++i)
+    {
+        kernel_source += "__kernel void k" + std::to_string(i) +
+            "(__global uint *output) { output[get_global_id(0)] = get_global_id(0) * " + std::to_string(i) + "; }\n";
+    }
+
+    cl::Program program(context, kernel_source, true /*build*/);
+    EXPECT_EQ(program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(device), CL_BUILD_SUCCESS);
+
+    std::vector<cl::Kernel> kernels;
+    program.createKernels(&kernels);
+    ASSERT_EQ(kernels.size(), numKernels);
+
+    const size_t width = 64;
+    cl::Buffer buffer(context, CL_MEM_READ_WRITE, width * sizeof(uint32_t));
+    for (auto& kernel : kernels)
+    {
+        uint32_t multiplier = std::stoul(kernel.getInfo<CL_KERNEL_FUNCTION_NAME>().substr(1));
+        kernel.setArg(0, buffer);
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(width));
+
+        std::vector<uint32_t> result(width, 0xdeaddead);
+        queue.enqueueReadBuffer(buffer, true, 0, width * sizeof(uint32_t), result.data());
+        for (uint32_t i = 0; i < width; ++i)
+        {
+            EXPECT_EQ(result[i], i * multiplier);
+        }
+    }
+}
+
+TEST(OpenCLOn12, ConcurrentDispatch)
+{
+    // Several threads launching the same kernel, with different local sizes so that
+    // specializations are being looked up while others are still being inserted
+    constexpr uint32_t NumThreads = 4;
+    constexpr uint32_t EnqueuesPerThread = 200;
+    auto&& [context, device] = GetWARPContext();
+    if (!context.get())
+    {
+        return;
+    }
+
+    const char* kernel_source =
+    "__kernel void write_local_size(__global uint *output)\n\
+    {\n\
+        output[get_global_id(0)] = get_local_size(0);\n\
+    }\n";
+
+    cl::Program program(context, kernel_source, true /*build*/);
+    cl::Kernel kernel(program, "write_local_size");
+
+    const size_t width = 256;
+    std::vector<cl::CommandQueue> queues;
+    std::vector<cl::Buffer> buffers;
+    std::vector<cl::Kernel> kernels;
+    for (uint32_t i = 0; i < NumThreads; ++i)
+    {
+        queues.emplace_back(context, device);
+        buffers.emplace_back(context, CL_MEM_READ_WRITE, width * sizeof(uint32_t));
+        kernels.push_back(kernel.clone());
+        kernels.back().setArg(0, buffers.back());
+    }
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < NumThreads; ++i)
+    {
+        threads.emplace_back([&, i]()
+        {
+            try
+            {
+                size_t localSize = 8;
+                for (uint32_t j = 0; j < EnqueuesPerThread; ++j)
+                {
+                    localSize = size_t(8) << ((i + j) % 4);
+                    queues[i].enqueueNDRangeKernel(kernels[i], cl::NullRange, cl::NDRange(width), cl::NDRange(localSize));
+                }
+
+                std::vector<uint32_t> result(width, 0xdeaddead);
+                queues[i].enqueueReadBuffer(buffers[i], true, 0, width * sizeof(uint32_t), result.data());
+                for (uint32_t j = 0; j < width; ++j)
+                {
+                    EXPECT_EQ(result[j], localSize);
+                }
+            }
+            catch (cl::Error& e)
+            {
+                ADD_FAILURE() << e.what() << ": " << e.err();
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
 TEST(OpenCLOn12, SPIRV)
 {
     // This is the pre-assembled SPIR-V from the compiler DLL's "spec_constant" test:
@@ -0,0 +1,484 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+#include "gtest/gtest.h"
+#include "scheduler.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace BackgroundTaskScheduler;
+
+// Counts how many times it runs, or how many times it's destroyed without running.
+struct CountingTask
+{
+    std::atomic<uint32_t>* pCounter;
+    std::atomic<uint32_t>* pCanceled = nullptr;
+
+    CountingTask(std::atomic<uint32_t>* counter, std::atomic<uint32_t>* canceled = nullptr) noexcept
+        : pCounter(counter), pCanceled(canceled) {}
+    CountingTask(CountingTask&& o) noexcept
+        : pCounter(o.pCounter), pCanceled(std::exchange(o.pCanceled, nullptr)) {}
+    ~CountingTask()
+    {
+        if (pCanceled)
+        {
+            ++*pCanceled;
+        }
+    }
+    void operator()()
+    {
+        ++*pCounter;
+        pCanceled = nullptr;
+    }
+};
+
+static SchedulingMode GetAllThreadsMode()
+{
+    return { std::max(std::thread::hardware_concurrency(), 1u), Priority::Normal };
+}
+
+// Submits many tiny tasks from several producers at once, and returns the time it took
+// for all of them to be retired.
+static double MeasureThroughput(DispatchMode dispatchMode, uint32_t NumProducers, uint32_t TasksPerProducer)
+{
+    Scheduler scheduler(dispatchMode);
+    scheduler.SetSchedulingMode(GetAllThreadsMode());
+
+    std::atomic<uint32_t> Counter = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> producers;
+    for (uint32_t i = 0; i < NumProducers; ++i)
+    {
+        producers.emplace_back([&]()
+        {
+            for (uint32_t j = 0; j < TasksPerProducer; ++j)
+            {
+                scheduler.QueueTask({ CountingTask(&Counter) });
+            }
+        });
+    }
+    for (auto& thread : producers)
+    {
+        thread.join();
+    }
+
+    XPlatHelpers::unique_event done;
+    done.create();
+    scheduler.SignalEventOnCompletionOfCurrentTasks(done.get(), scheduler.GetCurrentMode());
+    done.wait();
+
+    auto end = std::chrono::steady_clock::now();
+    EXPECT_EQ(Counter, NumProducers * TasksPerProducer);
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+TEST(Scheduler, WorkStealingSignalsAndCancels)
+{
+    Scheduler scheduler(DispatchMode::WorkStealing);
+    std::atomic<uint32_t> Counter = 0;
+    std::atomic<uint32_t> Canceled = 0;
+
+    // No threads - tasks get canceled immediately
+    scheduler.QueueTask({ CountingTask(&Counter, &Canceled) });
+    EXPECT_EQ(Canceled, 1u);
+
+    scheduler.SetSchedulingMode(GetAllThreadsMode());
+    for (uint32_t i = 0; i < 1000; ++i)
+    {
+        scheduler.QueueTask({ CountingTask(&Counter) });
+    }
+
+    // Events signal once every task submitted before them has been retired
+    XPlatHelpers::unique_event first, second;
+    first.create();
+    second.create();
+    scheduler.SignalEventOnCompletionOfCurrentTasks(first.get(), scheduler.GetCurrentMode());
+    for (uint32_t i = 0; i < 1000; ++i)
+    {
+        scheduler.QueueTask({ CountingTask(&Counter) });
+    }
+    scheduler.SignalEventOnCompletionOfCurrentTasks(second.get(), { 0, Priority::Idle });
+    first.wait();
+    EXPECT_GE(Counter, 1000u);
+    second.wait();
+    EXPECT_EQ(Counter, 2000u);
+
+    scheduler.Shutdown();
+    scheduler.QueueTask({ CountingTask(&Counter, &Canceled) });
+    EXPECT_EQ(Canceled, 2u);
+}
+
+// Runs lane tasks on a single thread after a gate task is released, and records the order they started in.
+struct PriorityOrderRecorder
+{
+    Scheduler scheduler;
+    XPlatHelpers::unique_event gateStarted, gateReleased;
+    std::mutex lock;
+    std::vector<TaskPriority> order;
+
+    PriorityOrderRecorder(DispatchMode dispatchMode)
+        : scheduler(dispatchMode)
+    {
+        gateStarted.create();
+        gateReleased.create();
+        scheduler.SetSchedulingMode({ 1, Priority::Normal });
+        scheduler.QueueTask({ [this]()
+            {
+                gateStarted.set();
+                gateReleased.wait();
+            }, TaskPriority::Normal });
+        gateStarted.wait();
+    }
+
+    void Queue(TaskPriority priority)
+    {
+        scheduler.QueueTask({ [this, priority]()
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                order.push_back(priority);
+            }, priority });
+    }
+
+    void Run()
+    {
+        XPlatHelpers::unique_event done;
+        done.create();
+        scheduler.SignalEventOnCompletionOfCurrentTasks(done.get(), scheduler.GetCurrentMode());
+        gateReleased.set();
+        done.wait();
+    }
+};
+
+TEST(Scheduler, PriorityLanes)
+{
+    for (auto dispatchMode : { DispatchMode::SharedQueue, DispatchMode::WorkStealing })
+    {
+        PriorityOrderRecorder recorder(dispatchMode);
+        recorder.Queue(TaskPriority::Background);
+        recorder.Queue(TaskPriority::Normal);
+        recorder.Queue(TaskPriority::Critical);
+        recorder.Queue(TaskPriority::Normal);
+        recorder.Run();
+
+        std::vector<TaskPriority> expected = { TaskPriority::Critical, TaskPriority::Normal, TaskPriority::Normal, TaskPriority::Background };
+        EXPECT_EQ(recorder.order, expected);
+
+        auto critical = recorder.scheduler.GetLaneCounters(TaskPriority::Critical);
+        EXPECT_EQ(critical.Submitted, 1u);
+        EXPECT_EQ(critical.Completed, 1u);
+        auto normal = recorder.scheduler.GetLaneCounters(TaskPriority::Normal);
+        EXPECT_EQ(normal.Submitted, 3u); // Includes the gate
+        EXPECT_EQ(normal.Completed, 3u);
+    }
+}
+
+TEST(Scheduler, PriorityLanesDontStarve)
+{
+    for (auto dispatchMode : { DispatchMode::SharedQueue, DispatchMode::WorkStealing })
+    {
+        PriorityOrderRecorder recorder(dispatchMode);
+        recorder.Queue(TaskPriority::Background);
+        for (uint32_t i = 0; i < StarvationLimit * 4; ++i)
+        {
+            recorder.Queue(TaskPriority::Critical);
+        }
+        recorder.Run();
+
+        auto iter = std::find(recorder.order.begin(), recorder.order.end(), TaskPriority::Background);
+        ASSERT_NE(iter, recorder.order.end());
+        EXPECT_EQ(iter - recorder.order.begin(), (ptrdiff_t)StarvationLimit);
+        EXPECT_EQ(recorder.scheduler.GetLaneCounters(TaskPriority::Background).Promoted, 1u);
+    }
+}
+
+TEST(Scheduler, StrandsRunInOrder)
+{
+    constexpr uint32_t NumStrands = 4;
+    constexpr uint32_t TasksPerStrand = 2000;
+
+    struct StrandState
+    {
+        std::atomic<bool> bRunning = false;
+        uint32_t NextExpected = 0;
+        bool bFailed = false;
+    };
+    StrandState strands[NumStrands];
+
+    Scheduler scheduler;
+    scheduler.SetSchedulingMode({ NumStrands, Priority::Normal });
+    StrandKey keys[NumStrands];
+    for (auto& key : keys)
+    {
+        key = Scheduler::CreateStrandKey();
+    }
+
+    for (uint32_t i = 0; i < TasksPerStrand; ++i)
+    {
+        for (uint32_t j = 0; j < NumStrands; ++j)
+        {
+            scheduler.QueueTask({ [&strand = strands[j], i]()
+                {
+                    if (strand.bRunning.exchange(true) || strand.NextExpected != i)
+                    {
+                        strand.bFailed = true;
+                    }
+                    ++strand.NextExpected;
+                    strand.bRunning = false;
+                }, TaskPriority::Normal, keys[j] });
+        }
+    }
+
+    XPlatHelpers::unique_event done;
+    done.create();
+    scheduler.SignalEventOnCompletionOfCurrentTasks(done.get(), { 0, Priority::Idle });
+    done.wait();
+
+    for (auto& strand : strands)
+    {
+        EXPECT_FALSE(strand.bFailed);
+        EXPECT_EQ(strand.NextExpected, TasksPerStrand);
+    }
+}
+
+TEST(Scheduler, CancelStrand)
+{
+    Scheduler scheduler;
+    scheduler.SetSchedulingMode({ 2, Priority::Normal });
+    StrandKey key = Scheduler::CreateStrandKey();
+
+    XPlatHelpers::unique_event started, release;
+    started.create();
+    release.create();
+    scheduler.QueueTask({ [&]()
+        {
+            started.set();
+            release.wait();
+        }, TaskPriority::Normal, key });
+    started.wait();
+
+    std::atomic<uint32_t> Counter = 0, Canceled = 0;
+    for (uint32_t i = 0; i < 10; ++i)
+    {
+        scheduler.QueueTask({ CountingTask(&Counter, &Canceled), TaskPriority::Normal, key });
+    }
+
+    std::thread releaser([&]() { std::this_thread::sleep_for(std::chrono::milliseconds(10)); release.set(); });
+    scheduler.CancelStrand(key);
+    releaser.join();
+
+    // Everything that was queued behind the running task was canceled, and that task has finished
+    EXPECT_EQ(Counter, 0u);
+    EXPECT_EQ(Canceled, 10u);
+    EXPECT_EQ(scheduler.GetLaneCounters(TaskPriority::Normal).Canceled, 10u);
+    EXPECT_EQ(scheduler.GetLaneCounters(TaskPriority::Normal).Completed, 1u);
+}
+
+TEST(Scheduler, ModeChangesRunInOrder)
+{
+    Scheduler scheduler;
+    scheduler.SetSchedulingMode({ 2, Priority::Normal });
+    StrandKey key = Scheduler::CreateStrandKey();
+
+    XPlatHelpers::unique_event started, release, done;
+    started.create();
+    release.create();
+    done.create();
+    scheduler.QueueTask({ [&]()
+        {
+            started.set();
+            release.wait();
+        }, TaskPriority::Normal, key });
+    started.wait();
+
+    // The second strand task can't start yet, so the mode change has to wait behind it,
+    // and the task queued after the mode change has to wait for it, even with a thread free
+    std::atomic<uint32_t> Counter = 0, Canceled = 0;
+    scheduler.QueueTask({ CountingTask(&Counter, &Canceled), TaskPriority::Normal, key });
+    scheduler.SetSchedulingMode({ 1, Priority::Normal });
+    uint32_t NumThreadsSeen = 0;
+    scheduler.QueueTask({ [&]()
+        {
+            NumThreadsSeen = scheduler.GetEffectiveMode().NumThreads;
+            done.set();
+        } });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    release.set();
+    done.wait();
+    EXPECT_EQ(Counter, 1u);
+    EXPECT_EQ(NumThreadsSeen, 1u);
+}
+
+// Models D3DDevice: each submission is recorded, and then handed off to wait for completion, with each device's
+// application thread waiting for one submission before sending the next. Compares a pair of dedicated
+// single-threaded schedulers per device against strands on a shared pool.
+TEST(Scheduler, StrandLatency)
+{
+    constexpr uint32_t NumDevices = 4;
+    constexpr uint32_t SubmissionsPerDevice = 500;
+
+    struct Submission
+    {
+        Scheduler* pCompletionScheduler;
+        StrandKey CompletionStrand;
+        XPlatHelpers::unique_event Completed;
+    };
+
+    auto Measure = [](bool bStrands, uint32_t& NumThreads)
+    {
+        std::vector<std::unique_ptr<Scheduler>> schedulers;
+        if (bStrands)
+        {
+            NumThreads = std::min(NumDevices * 2, std::max(2u, std::thread::hardware_concurrency()));
+            schedulers.emplace_back(new Scheduler);
+            schedulers[0]->SetSchedulingMode({ NumThreads, Priority::Normal });
+        }
+        else
+        {
+            NumThreads = NumDevices * 2;
+            for (uint32_t i = 0; i < NumThreads; ++i)
+            {
+                schedulers.emplace_back(new Scheduler);
+                schedulers.back()->SetSchedulingMode({ 1, Priority::Normal });
+            }
+        }
+
+        std::atomic<int64_t> TotalLatencyNs = 0;
+        std::vector<std::thread> applications;
+        for (uint32_t device = 0; device < NumDevices; ++device)
+        {
+            applications.emplace_back([&, device]()
+            {
+                Scheduler& execution = *schedulers[bStrands ? 0 : device * 2];
+                Scheduler& completion = *schedulers[bStrands ? 0 : device * 2 + 1];
+                StrandKey ExecutionStrand = bStrands ? Scheduler::CreateStrandKey() : NoStrand;
+                Submission submission = { &completion, bStrands ? Scheduler::CreateStrandKey() : NoStrand, {} };
+                submission.Completed.create();
+
+                for (uint32_t i = 0; i < SubmissionsPerDevice; ++i)
+                {
+                    auto start = std::chrono::steady_clock::now();
+                    execution.QueueTask({ [&submission]()
+                        {
+                            submission.pCompletionScheduler->QueueTask({ [&submission]() { submission.Completed.set(); },
+                                TaskPriority::Normal, submission.CompletionStrand });
+                        }, TaskPriority::Normal, ExecutionStrand });
+                    submission.Completed.wait();
+                    TotalLatencyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                }
+            });
+        }
+        for (auto& thread : applications)
+        {
+            thread.join();
+        }
+        return TotalLatencyNs / (double)(NumDevices * SubmissionsPerDevice) / 1000.0;
+    };
+
+    uint32_t DedicatedThreads, StrandThreads;
+    double DedicatedLatencyUs = Measure(false, DedicatedThreads);
+    double StrandLatencyUs = Measure(true, StrandThreads);
+    printf("%u devices: dedicated schedulers use %u threads, %.1fus average submit-to-complete; "
+        "strands use %u threads, %.1fus average submit-to-complete\n",
+        NumDevices, DedicatedThreads, DedicatedLatencyUs, StrandThreads, StrandLatencyUs);
+}
+
+// Holds every task that waits on it until it's opened.
+struct Gate
+{
+    std::mutex lock;
+    std::condition_variable cv;
+    bool bOpen = false;
+
+    void Wait()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        cv.wait(guard, [this]() { return bOpen; });
+    }
+    void Open()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            bOpen = true;
+        }
+        cv.notify_all();
+    }
+};
+
+// Polls until the condition holds, or gives up after a few seconds.
+template <typename Fn> static bool WaitUntil(Fn&& condition)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!condition())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+TEST(Scheduler, AutoScaling)
+{
+    constexpr uint32_t MaxThreads = 4;
+    constexpr uint32_t NumTasks = MaxThreads * 2;
+    for (auto dispatchMode : { DispatchMode::SharedQueue, DispatchMode::WorkStealing })
+    {
+        Scheduler scheduler(dispatchMode);
+        scheduler.EnableAutoScaling(MaxThreads, std::chrono::milliseconds(20));
+        scheduler.SetSchedulingMode({ 1, Priority::Normal });
+
+        // Every task blocks its thread, so the backlog keeps outnumbering the idle threads
+        Gate gate;
+        std::atomic<uint32_t> Started = 0;
+        for (uint32_t i = 0; i < NumTasks; ++i)
+        {
+            scheduler.QueueTask({ [&]() { ++Started; gate.Wait(); } });
+        }
+        EXPECT_TRUE(WaitUntil([&]() { return Started == MaxThreads; }));
+        EXPECT_EQ(scheduler.GetEffectiveMode().NumThreads, MaxThreads);
+
+        XPlatHelpers::unique_event done;
+        done.create();
+        scheduler.SignalEventOnCompletionOfCurrentTasks(done.get(), scheduler.GetCurrentMode());
+        gate.Open();
+        done.wait();
+        EXPECT_EQ(Started, NumTasks);
+
+        // Once idle, the extra threads exit, but not below the requested count
+        EXPECT_TRUE(WaitUntil([&]() { return scheduler.GetEffectiveMode().NumThreads == 1; }));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        EXPECT_EQ(scheduler.GetEffectiveMode().NumThreads, 1u);
+        EXPECT_EQ(scheduler.GetCurrentMode().NumThreads, 1u);
+
+        // The remaining thread still picks up work, and the pool grows again for the next burst
+        Started = 0;
+        gate.bOpen = false;
+        for (uint32_t i = 0; i < NumTasks; ++i)
+        {
+            scheduler.QueueTask({ [&]() { ++Started; gate.Wait(); } });
+        }
+        EXPECT_TRUE(WaitUntil([&]() { return Started == MaxThreads; }));
+        gate.Open();
+        EXPECT_TRUE(WaitUntil([&]() { return Started == NumTasks; }));
+    }
+}
+
+TEST(Scheduler, Throughput)
+{
+    constexpr uint32_t NumProducers = 8;
+    constexpr uint32_t TasksPerProducer = 50000;
+
+    double SharedQueueMs = MeasureThroughput(DispatchMode::SharedQueue, NumProducers, TasksPerProducer);
+    double WorkStealingMs = MeasureThroughput(DispatchMode::WorkStealing, NumProducers, TasksPerProducer);
+
+    printf("%u tasks on %u threads: shared queue %.1fms, work stealing %.1fms\n",
+        NumProducers * TasksPerProducer, GetAllThreadsMode().NumThreads, SharedQueueMs, WorkStealingMs);
+}